@@ -0,0 +1,15 @@
+#!/bin/sh
+# Benchmark the DoF orderings on the same mesh: assembly time, Jacobian
+# matrix-vector product and iterations of a linear solve. The results of
+# each ordering are appended to dof_ordering.csv in the current directory.
+#
+# Usage: benchmark_dof_ordering.sh <build_dir> <n_processes> [mesh X,Y] [preconditioner]
+
+BUILD_DIR=${1:-../build}
+MPI_PROCS=${2:-4}
+MESH_DIMS=${3:-100,100}
+PRECONDITIONER=${4:-2}
+
+for ORDERING in none cuthill-mckee hilbert downstream; do
+    mpiexec -n $MPI_PROCS $BUILD_DIR/PreconditionerBenchmark -m $MESH_DIMS -n 100 -p $PRECONDITIONER -O $ORDERING
+done
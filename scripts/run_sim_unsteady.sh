@@ -20,7 +20,13 @@ singularity -s exec /home/users/gdaneri/mk_latest.sif /bin/bash -c '
    
    start_time=$(date +%s.%N)
    
-   mpiexec -n $MPI_PROCS /home/users/gdaneri/navier_stokes_solver/lab_new/build/NSSolver -M -T 0.03,0.01 -t 0.000000001 -m 60,40 -s 1 -r 1.0  -p 1
+   # resume from the last checkpoint if a previous job was killed
+   RESTART=""
+   if [ -f checkpoint.bin ]; then
+       RESTART="-R checkpoint.bin"
+   fi
+
+   mpiexec -n $MPI_PROCS /home/users/gdaneri/navier_stokes_solver/lab_new/build/NSSolver -M -T 0.03,0.01 -t 0.000000001 -m 60,40 -s 1 -r 1.0  -p 1 -k 10 $RESTART
    end_time=$(date +%s.%N)
    duration=$(awk "BEGIN {print $end_time - $start_time}")
    
@@ -0,0 +1,328 @@
+#ifndef CELLWISEVECTORIO_HPP
+#define CELLWISEVECTORIO_HPP
+
+#include <deal.II/base/exceptions.h>
+#include <deal.II/base/mpi.h>
+
+#include <deal.II/dofs/dof_handler.h>
+
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace dealii;
+
+// Parallel binary files of finite element vectors, independent of the way the
+// mesh is partitioned. They are written and read collectively with MPI-IO and
+// consist of
+//   - a fixed-size header, identifying the mesh and the finite element;
+//   - a block of metadata of the caller (e.g. the state of the time
+//     stepping), of arbitrary size;
+//   - one record for each coarse cell, holding the DoF values of the cell for
+//     each vector, stored at the position given by the coarse cell id.
+// The coarse cell ids only depend on the serial mesh the distributed one has
+// been built from, so each process reads and writes only the records of its
+// own cells, and a file can be read on any number of processes, also by a
+// different solver using the same mesh and finite element.
+namespace CellwiseVectorIO
+{
+  struct FileHeader
+  {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t dofs_per_cell;
+    std::uint64_t n_coarse_cells;
+    std::uint64_t n_dofs;
+    std::uint32_t n_vectors;
+    std::uint32_t metadata_size;
+  };
+
+  constexpr char file_magic[8] = "NSCELLS";
+  constexpr std::uint32_t file_version = 1;
+
+  // Metadata of the solution files of the stationary solver, which are used
+  // as initial condition by the unsteady one.
+  struct StationarySolutionState
+  {
+    char magic[8];
+    double nu;
+    double inlet_velocity;
+  };
+
+  constexpr char stationary_solution_magic[8] = "NSSTAT";
+
+  // Locally owned cells, sorted by coarse cell id as required by MPI file
+  // views, and the corresponding displacements in units of records.
+  template <int dim>
+  void
+  collect_owned_cells(
+      const DoFHandler<dim> &dof_handler,
+      std::vector<typename DoFHandler<dim>::active_cell_iterator> &cells,
+      std::vector<int> &displacements)
+  {
+    std::vector<std::pair<types::coarse_cell_id,
+                          typename DoFHandler<dim>::active_cell_iterator>>
+        sorted_cells;
+    for (const auto &cell : dof_handler.active_cell_iterators())
+      if (cell->is_locally_owned())
+      {
+        AssertThrow(cell->level() == 0,
+                    ExcMessage("Cell-wise vector files require a mesh "
+                               "without refinement."));
+        sorted_cells.emplace_back(cell->id().get_coarse_cell_id(), cell);
+      }
+
+    std::sort(sorted_cells.begin(),
+              sorted_cells.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    cells.clear();
+    displacements.clear();
+    for (const auto &[id, cell] : sorted_cells)
+    {
+      cells.push_back(cell);
+      displacements.push_back(static_cast<int>(id));
+    }
+  }
+
+  // Set the view of the file to the records at the given displacements,
+  // after the header and the metadata. The types must be freed by the caller.
+  inline void
+  set_record_view(MPI_File file,
+                  const MPI_Offset offset,
+                  const unsigned int record_size,
+                  const std::vector<int> &displacements,
+                  MPI_Datatype &record_type,
+                  MPI_Datatype &file_type)
+  {
+    int ierr = MPI_Type_contiguous(record_size, MPI_DOUBLE, &record_type);
+    AssertThrowMPI(ierr);
+    ierr = MPI_Type_commit(&record_type);
+    AssertThrowMPI(ierr);
+
+    ierr = MPI_Type_create_indexed_block(displacements.size(),
+                                         1,
+                                         displacements.data(),
+                                         record_type,
+                                         &file_type);
+    AssertThrowMPI(ierr);
+    ierr = MPI_Type_commit(&file_type);
+    AssertThrowMPI(ierr);
+
+    ierr = MPI_File_set_view(
+        file, offset, record_type, file_type, "native", MPI_INFO_NULL);
+    AssertThrowMPI(ierr);
+  }
+
+  // Write the given vectors (with ghost elements) and metadata. The file is
+  // first written under a temporary name, so that an existing file is only
+  // replaced by a complete one.
+  template <int dim, typename VectorType>
+  void
+  write(const std::string &file_name,
+        const DoFHandler<dim> &dof_handler,
+        const std::vector<const VectorType *> &vectors,
+        const void *metadata,
+        const unsigned int metadata_size,
+        const MPI_Comm comm)
+  {
+    const unsigned int dofs_per_cell = dof_handler.get_fe().dofs_per_cell;
+    const unsigned int n_vectors = vectors.size();
+    const unsigned int record_size = n_vectors * dofs_per_cell;
+
+    std::vector<typename DoFHandler<dim>::active_cell_iterator> cells;
+    std::vector<int> displacements;
+    collect_owned_cells(dof_handler, cells, displacements);
+
+    std::vector<double> buffer(cells.size() * record_size);
+    Vector<double> cell_values(dofs_per_cell);
+    for (unsigned int c = 0; c < cells.size(); ++c)
+    {
+      for (unsigned int v = 0; v < n_vectors; ++v)
+      {
+        cells[c]->get_dof_values(*vectors[v], cell_values);
+        std::copy(cell_values.begin(),
+                  cell_values.end(),
+                  buffer.begin() + (c * n_vectors + v) * dofs_per_cell);
+      }
+    }
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, file_magic, sizeof(header.magic));
+    header.version = file_version;
+    header.dofs_per_cell = dofs_per_cell;
+    header.n_coarse_cells = dof_handler.get_triangulation().n_global_coarse_cells();
+    header.n_dofs = dof_handler.n_dofs();
+    header.n_vectors = n_vectors;
+    header.metadata_size = metadata_size;
+
+    const std::string tmp_file_name = file_name + ".tmp";
+
+    MPI_File file;
+    int ierr = MPI_File_open(comm,
+                             tmp_file_name.c_str(),
+                             MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                             MPI_INFO_NULL,
+                             &file);
+    AssertThrow(ierr == MPI_SUCCESS,
+                ExcMessage("Could not open " + tmp_file_name + " for writing."));
+    ierr = MPI_File_set_size(file, 0);
+    AssertThrowMPI(ierr);
+
+    if (Utilities::MPI::this_mpi_process(comm) == 0)
+    {
+      ierr = MPI_File_write_at(
+          file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+      AssertThrowMPI(ierr);
+      if (metadata_size > 0)
+      {
+        ierr = MPI_File_write_at(file,
+                                 sizeof(header),
+                                 metadata,
+                                 metadata_size,
+                                 MPI_BYTE,
+                                 MPI_STATUS_IGNORE);
+        AssertThrowMPI(ierr);
+      }
+    }
+
+    MPI_Datatype record_type, file_type;
+    set_record_view(file,
+                    sizeof(header) + metadata_size,
+                    record_size,
+                    displacements,
+                    record_type,
+                    file_type);
+    ierr = MPI_File_write_all(
+        file, buffer.data(), cells.size(), record_type, MPI_STATUS_IGNORE);
+    AssertThrowMPI(ierr);
+
+    ierr = MPI_File_close(&file);
+    AssertThrowMPI(ierr);
+    MPI_Type_free(&file_type);
+    MPI_Type_free(&record_type);
+
+    if (Utilities::MPI::this_mpi_process(comm) == 0)
+      AssertThrow(std::rename(tmp_file_name.c_str(), file_name.c_str()) == 0,
+                  ExcMessage("Could not write " + file_name));
+  }
+
+  // Read the header and the metadata of a file, checking that it has been
+  // written with the same mesh and finite element.
+  template <int dim>
+  FileHeader
+  read_header(const std::string &file_name,
+              const DoFHandler<dim> &dof_handler,
+              std::vector<char> &metadata,
+              const MPI_Comm comm)
+  {
+    MPI_File file;
+    int ierr = MPI_File_open(
+        comm, file_name.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+    AssertThrow(ierr == MPI_SUCCESS,
+                ExcMessage("Could not open " + file_name));
+
+    FileHeader header;
+    ierr = MPI_File_read_at(
+        file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    AssertThrowMPI(ierr);
+
+    AssertThrow(std::memcmp(header.magic, file_magic, sizeof(header.magic)) == 0 &&
+                    header.version == file_version,
+                ExcMessage(file_name + " is not a solution file of this solver."));
+    AssertThrow(header.dofs_per_cell == dof_handler.get_fe().dofs_per_cell &&
+                    header.n_coarse_cells ==
+                        dof_handler.get_triangulation().n_global_coarse_cells() &&
+                    header.n_dofs == dof_handler.n_dofs(),
+                ExcMessage(file_name + " was written with a different mesh or "
+                                       "finite element."));
+
+    metadata.resize(header.metadata_size);
+    if (header.metadata_size > 0)
+    {
+      ierr = MPI_File_read_at(file,
+                              sizeof(header),
+                              metadata.data(),
+                              header.metadata_size,
+                              MPI_BYTE,
+                              MPI_STATUS_IGNORE);
+      AssertThrowMPI(ierr);
+    }
+
+    ierr = MPI_File_close(&file);
+    AssertThrowMPI(ierr);
+
+    return header;
+  }
+
+  // Read the vectors of a file into the given vectors (without ghost
+  // elements), which must already be sized and as many as those in the file.
+  template <int dim, typename VectorType>
+  void
+  read(const std::string &file_name,
+       const DoFHandler<dim> &dof_handler,
+       const std::vector<VectorType *> &vectors,
+       const MPI_Comm comm)
+  {
+    std::vector<char> metadata;
+    const FileHeader header =
+        read_header(file_name, dof_handler, metadata, comm);
+    AssertThrow(header.n_vectors == vectors.size(),
+                ExcMessage(file_name + " holds a different number of vectors."));
+
+    const unsigned int dofs_per_cell = header.dofs_per_cell;
+    const unsigned int n_vectors = header.n_vectors;
+    const unsigned int record_size = n_vectors * dofs_per_cell;
+
+    std::vector<typename DoFHandler<dim>::active_cell_iterator> cells;
+    std::vector<int> displacements;
+    collect_owned_cells(dof_handler, cells, displacements);
+
+    std::vector<double> buffer(cells.size() * record_size);
+
+    MPI_File file;
+    int ierr = MPI_File_open(
+        comm, file_name.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+    AssertThrowMPI(ierr);
+
+    MPI_Datatype record_type, file_type;
+    set_record_view(file,
+                    sizeof(header) + header.metadata_size,
+                    record_size,
+                    displacements,
+                    record_type,
+                    file_type);
+    ierr = MPI_File_read_all(
+        file, buffer.data(), cells.size(), record_type, MPI_STATUS_IGNORE);
+    AssertThrowMPI(ierr);
+
+    ierr = MPI_File_close(&file);
+    AssertThrowMPI(ierr);
+    MPI_Type_free(&file_type);
+    MPI_Type_free(&record_type);
+
+    // Each process sets the entries of the DoFs it owns.
+    const IndexSet &owned_dofs = dof_handler.locally_owned_dofs();
+    std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+    for (unsigned int v = 0; v < n_vectors; ++v)
+    {
+      for (unsigned int c = 0; c < cells.size(); ++c)
+      {
+        cells[c]->get_dof_indices(dof_indices);
+        for (unsigned int i = 0; i < dofs_per_cell; ++i)
+          if (owned_dofs.is_element(dof_indices[i]))
+            (*vectors[v])(dof_indices[i]) =
+                buffer[(c * n_vectors + v) * dofs_per_cell + i];
+      }
+      vectors[v]->compress(VectorOperation::insert);
+    }
+  }
+}
+
+#endif
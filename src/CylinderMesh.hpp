@@ -0,0 +1,384 @@
+#ifndef CYLINDERMESH_HPP
+#define CYLINDERMESH_HPP
+
+#include <deal.II/base/exceptions.h>
+#include <deal.II/base/numbers.h>
+#include <deal.II/base/point.h>
+#include <deal.II/base/tensor.h>
+
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/grid/manifold_lib.h>
+#include <deal.II/grid/tria.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace dealii;
+
+// Boundary-fitted quadrilateral mesh of the channel with a cylinder of the
+// benchmark (the geometry of mesh/*.geo), made of structured blocks:
+//   - an O-grid around the cylinder, filling the box of side 0.4 (the height
+//     of the channel in y) centered on it. Its cells are bounded by rays
+//     from the center of the cylinder to the sides of the box, and graded
+//     radially so that the first layer on the cylinder has cells of aspect
+//     ratio about 1;
+//   - upstream of the box, if the cylinder is further than 0.2 from the
+//     inlet, uniform cells as large as those on the walls of the box;
+//   - the wake, from the box to the outlet, continuing the rows of the
+//     O-grid on the right side of the box, with cells growing geometrically
+//     in the flow direction from the size of those on the walls of the box.
+// In 3D the plane mesh is extruded along z, with as many layers as the inlet
+// has cells in y. The faces on the cylinder are attached to a
+// SphericalManifold (CylindricalManifold in 3D), so that a higher-order
+// mapping sees the exact circle and refinement puts the new vertices on it.
+// The boundary ids are those of the meshes read from file: 6 walls, 7 inlet,
+// 8 outlet, 10 cylinder.
+namespace CylinderMesh
+{
+  // Number of cells along the curves of the geometry, as the Transfinite
+  // Curve counts of the .geo files.
+  struct Parameters
+  {
+    unsigned int n_cylinder;
+    unsigned int n_wall;
+    unsigned int n_inlet;
+  };
+
+  // Counts of mesh/2dMeshCoarse.geo, mesh/2dMesh.geo and mesh/2dMeshFine.geo.
+  constexpr Parameters coarse{80, 40, 30};
+  constexpr Parameters medium{200, 100, 70};
+  constexpr Parameters fine{300, 150, 100};
+
+  // Geometry of the 2D-2 and 3D-2Z benchmarks of Schaefer and Turek: the 3D
+  // channel is longer, has a square section and the cylinder is further
+  // from the inlet.
+  template <int dim>
+  struct Geometry
+  {
+    static constexpr double channel_length = dim == 2 ? 2.2 : 2.5;
+    static constexpr double cylinder_x = dim == 2 ? 0.2 : 0.5;
+  };
+
+  constexpr double channel_height = 0.41;
+  constexpr double cylinder_y = 0.2;
+  constexpr double cylinder_radius = 0.05;
+
+  // The manifold of the cylinder has the same id as its boundary.
+  constexpr types::manifold_id cylinder_manifold_id = 10;
+
+  // Parse "coarse", "medium", "fine" or the three counts "NC,NW,NI".
+  inline Parameters
+  parameters_from_string(const std::string &value)
+  {
+    if (value == "coarse")
+      return coarse;
+    if (value == "medium")
+      return medium;
+    if (value == "fine")
+      return fine;
+
+    const auto first = value.find(',');
+    const auto second =
+        first == std::string::npos ? first : value.find(',', first + 1);
+    if (second == std::string::npos)
+      throw std::invalid_argument("Invalid mesh " + value +
+                                  ". Use coarse, medium, fine or NC,NW,NI.");
+
+    return {static_cast<unsigned int>(std::atoi(value.substr(0, first).c_str())),
+            static_cast<unsigned int>(
+                std::atoi(value.substr(first + 1, second - first - 1).c_str())),
+            static_cast<unsigned int>(
+                std::atoi(value.substr(second + 1).c_str()))};
+  }
+
+  inline std::string
+  parameters_to_string(const Parameters &parameters)
+  {
+    return std::to_string(parameters.n_cylinder) + "," +
+           std::to_string(parameters.n_wall) + "," +
+           std::to_string(parameters.n_inlet);
+  }
+
+  // Coordinates 0 = x_0 < ... < x_n = length of n cells growing
+  // geometrically from first_size. The cells are uniform if first_size is
+  // not smaller than length / n.
+  inline std::vector<double>
+  graded_coordinates(const double length,
+                     const unsigned int n,
+                     const double first_size)
+  {
+    double ratio = 1.0;
+    if (first_size * n < length)
+    {
+      // Bisection on the ratio r of first_size * (r^n - 1) / (r - 1) = length.
+      const auto total = [&](const double r) {
+        return first_size * (std::pow(r, n) - 1.0) / (r - 1.0);
+      };
+      double low = 1.0 + 1e-12;
+      double high = 2.0;
+      while (total(high) < length)
+        high *= 2.0;
+      for (unsigned int it = 0; it < 200 && high - low > 1e-14; ++it)
+      {
+        const double mid = 0.5 * (low + high);
+        (total(mid) < length ? low : high) = mid;
+      }
+      ratio = 0.5 * (low + high);
+    }
+
+    std::vector<double> x(n + 1, 0.0);
+    double size = ratio == 1.0 ? length / n : first_size;
+    for (unsigned int i = 1; i <= n; ++i)
+    {
+      x[i] = x[i - 1] + size;
+      size *= ratio;
+    }
+    x[n] = length;
+
+    return x;
+  }
+
+  // Point in the plane z = 0 of the axis of the cylinder.
+  template <int dim>
+  Point<dim>
+  cylinder_center()
+  {
+    Point<dim> center;
+    center[0] = Geometry<dim>::cylinder_x;
+    center[1] = cylinder_y;
+    return center;
+  }
+
+  // Plane mesh of a channel of the given length with the cylinder at
+  // x = cylinder_x, without boundary ids.
+  inline void
+  create_plane(Triangulation<2> &tria,
+               const Parameters &parameters,
+               const double channel_length,
+               const double cylinder_x)
+  {
+    constexpr unsigned int dim = 2;
+
+    // The cylinder has an even number of cells, n_inlet on each of the
+    // vertical sides of the box and n_box on each horizontal one.
+    const unsigned int n_cylinder =
+        parameters.n_cylinder + parameters.n_cylinder % 2;
+    const unsigned int n_inlet = parameters.n_inlet;
+    AssertThrow(n_inlet > 0 && n_cylinder > 2 * n_inlet,
+                ExcMessage("The cylinder must have more than twice as many "
+                           "cells as the inlet."));
+    const unsigned int n_box = (n_cylinder - 2 * n_inlet) / 2;
+
+    const Point<dim> center(cylinder_x, cylinder_y);
+    const double box_length = 2.0 * cylinder_y;
+    const double box_start = cylinder_x - cylinder_y;
+    const double box_end = box_start + box_length;
+    AssertThrow(box_start > -1e-12 && box_end < channel_length,
+                ExcMessage("The cylinder is too close to the inlet or the "
+                           "outlet."));
+
+    const unsigned int n_upstream =
+        box_start > 1e-12 ?
+            std::max<unsigned int>(
+                1, std::lround(box_start / (box_length / n_box))) :
+            0;
+    AssertThrow(parameters.n_wall > n_box + n_upstream,
+                ExcMessage("The walls must have more cells than the sides of "
+                           "the cylinder region (" +
+                           std::to_string(n_box + n_upstream) + ")."));
+    const unsigned int n_wake = parameters.n_wall - n_box - n_upstream;
+    const unsigned int n_radial = std::max(2u, n_cylinder / 8);
+
+    // Point k of the sides of the box, counterclockwise from its lower left
+    // corner.
+    const auto box_point = [&](const unsigned int k) {
+      if (k <= n_box)
+        return Point<dim>(box_start + box_length * k / n_box, 0.0);
+      if (k <= n_box + n_inlet)
+        return Point<dim>(box_end, channel_height * (k - n_box) / n_inlet);
+      if (k <= 2 * n_box + n_inlet)
+        return Point<dim>(box_start +
+                              box_length * (2 * n_box + n_inlet - k) / n_box,
+                          channel_height);
+      return Point<dim>(box_start,
+                        channel_height * (n_cylinder - k) / n_inlet);
+    };
+
+    // Radial coordinate along the rays, in [0, 1], with a first layer as
+    // thick as the cells on the cylinder are wide.
+    const double first_layer =
+        2.0 * numbers::PI * cylinder_radius / n_cylinder /
+        (std::min(cylinder_y, channel_height - cylinder_y) - cylinder_radius);
+    const std::vector<double> t =
+        graded_coordinates(1.0, n_radial, first_layer);
+
+    std::vector<Point<dim>> vertices;
+    std::vector<CellData<dim>> cells;
+
+    // O-grid: vertex j of ray k has index k * (n_radial + 1) + j.
+    const auto o_grid_vertex = [&](const unsigned int k, const unsigned int j) {
+      return (k % n_cylinder) * (n_radial + 1) + j;
+    };
+    for (unsigned int k = 0; k < n_cylinder; ++k)
+    {
+      const Point<dim> outer = box_point(k);
+      const Tensor<1, dim> direction = (outer - center) / (outer - center).norm();
+      const Point<dim> inner = center + cylinder_radius * direction;
+      for (unsigned int j = 0; j <= n_radial; ++j)
+        vertices.push_back(inner + t[j] * (outer - inner));
+    }
+
+    // The reference x direction is radial and the y direction
+    // counterclockwise, so that the cells are positively oriented.
+    for (unsigned int k = 0; k < n_cylinder; ++k)
+      for (unsigned int j = 0; j < n_radial; ++j)
+      {
+        CellData<dim> cell_data;
+        cell_data.vertices = {o_grid_vertex(k, j),
+                              o_grid_vertex(k, j + 1),
+                              o_grid_vertex(k + 1, j),
+                              o_grid_vertex(k + 1, j + 1)};
+        cells.push_back(cell_data);
+      }
+
+    // Upstream block: the last column of vertices is the left side of the
+    // box.
+    const unsigned int first_upstream_vertex = vertices.size();
+    const auto upstream_vertex = [&](const unsigned int c, const unsigned int i) {
+      return c == n_upstream ?
+                 o_grid_vertex(2 * n_box + 2 * n_inlet - i, n_radial) :
+                 first_upstream_vertex + c * (n_inlet + 1) + i;
+    };
+    for (unsigned int c = 0; c < n_upstream; ++c)
+      for (unsigned int i = 0; i <= n_inlet; ++i)
+        vertices.emplace_back(box_start * c / n_upstream,
+                              channel_height * i / n_inlet);
+
+    for (unsigned int c = 0; c < n_upstream; ++c)
+      for (unsigned int i = 0; i < n_inlet; ++i)
+      {
+        CellData<dim> cell_data;
+        cell_data.vertices = {upstream_vertex(c, i),
+                              upstream_vertex(c + 1, i),
+                              upstream_vertex(c, i + 1),
+                              upstream_vertex(c + 1, i + 1)};
+        cells.push_back(cell_data);
+      }
+
+    // Wake: the first column of vertices is the right side of the box.
+    const std::vector<double> x = graded_coordinates(
+        channel_length - box_end, n_wake, box_length / n_box);
+    const unsigned int first_wake_vertex = vertices.size();
+    const auto wake_vertex = [&](const unsigned int c, const unsigned int i) {
+      return c == 0 ? o_grid_vertex(n_box + i, n_radial)
+                    : first_wake_vertex + (c - 1) * (n_inlet + 1) + i;
+    };
+    for (unsigned int c = 1; c <= n_wake; ++c)
+      for (unsigned int i = 0; i <= n_inlet; ++i)
+        vertices.emplace_back(box_end + x[c],
+                              channel_height * i / n_inlet);
+
+    for (unsigned int c = 0; c < n_wake; ++c)
+      for (unsigned int i = 0; i < n_inlet; ++i)
+      {
+        CellData<dim> cell_data;
+        cell_data.vertices = {wake_vertex(c, i),
+                              wake_vertex(c + 1, i),
+                              wake_vertex(c, i + 1),
+                              wake_vertex(c + 1, i + 1)};
+        cells.push_back(cell_data);
+      }
+
+    tria.create_triangulation(vertices, cells, SubCellData());
+  }
+
+  // Set the boundary ids, and the manifold of the faces on the cylinder,
+  // from the position of the faces.
+  template <int dim>
+  void
+  set_boundary_ids(Triangulation<dim> &tria)
+  {
+    const Point<dim> center = cylinder_center<dim>();
+
+    // Distance from the axis of the cylinder, in the xy plane.
+    const auto on_cylinder = [&](const Point<dim> &p) {
+      Tensor<1, 2> r;
+      r[0] = p[0] - center[0];
+      r[1] = p[1] - center[1];
+      return std::fabs(r.norm() - cylinder_radius) < 1e-10 * cylinder_radius;
+    };
+    for (const auto &cell : tria.active_cell_iterators())
+      for (const auto &face : cell->face_iterators())
+        if (face->at_boundary())
+        {
+          const Point<dim> face_center = face->center();
+          bool cylinder_face = true;
+          for (const unsigned int v : face->vertex_indices())
+            cylinder_face = cylinder_face && on_cylinder(face->vertex(v));
+
+          if (std::fabs(face_center[0]) < 1e-12)
+            face->set_boundary_id(7); // inlet
+          else if (std::fabs(face_center[0] - Geometry<dim>::channel_length) <
+                   1e-12)
+            face->set_boundary_id(8); // outlet
+          else if (cylinder_face)
+          {
+            face->set_boundary_id(10); // cylinder
+            face->set_all_manifold_ids(cylinder_manifold_id);
+          }
+          else
+            face->set_boundary_id(6); // walls
+        }
+  }
+
+  // Attach the manifold of the cylinder to a triangulation built by create(),
+  // or from the description of such a mesh, which only holds the ids.
+  template <int dim>
+  void
+  attach_manifold(Triangulation<dim> &tria)
+  {
+    if constexpr (dim == 2)
+      tria.set_manifold(cylinder_manifold_id,
+                        SphericalManifold<dim>(cylinder_center<dim>()));
+    else
+    {
+      Tensor<1, dim> direction;
+      direction[dim - 1] = 1.0;
+      tria.set_manifold(cylinder_manifold_id,
+                        CylindricalManifold<dim>(direction,
+                                                 cylinder_center<dim>()));
+    }
+  }
+
+  template <int dim>
+  void
+  create(Triangulation<dim> &tria, const Parameters &parameters)
+  {
+    if constexpr (dim == 2)
+      create_plane(tria,
+                   parameters,
+                   Geometry<dim>::channel_length,
+                   Geometry<dim>::cylinder_x);
+    else
+    {
+      Triangulation<2> plane;
+      create_plane(plane,
+                   parameters,
+                   Geometry<dim>::channel_length,
+                   Geometry<dim>::cylinder_x);
+      GridGenerator::extrude_triangulation(plane,
+                                           parameters.n_inlet + 1,
+                                           channel_height,
+                                           tria);
+    }
+
+    set_boundary_ids(tria);
+    attach_manifold(tria);
+  }
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef LINEARALGEBRA_HPP
+#define LINEARALGEBRA_HPP
+
+#include <deal.II/base/config.h>
+
+// Linear algebra backend of NSSolver. By default the solver stack is built on
+// the Epetra based TrilinosWrappers, which run a single thread inside each MPI
+// process. Configuring with -DUSE_TPETRA=ON defines NS_USE_TPETRA and switches
+// it to deal.II's Tpetra wrappers, whose SpMV, vector updates and Ifpack2
+// preconditioners run in the default Kokkos execution space: if Kokkos was
+// built with OpenMP, each MPI process then uses OMP_NUM_THREADS cores.
+#ifdef NS_USE_TPETRA
+
+#  if !defined(DEAL_II_TRILINOS_WITH_TPETRA) || !DEAL_II_VERSION_GTE(9, 6, 0)
+#    error "The Tpetra backend requires deal.II >= 9.6 built with Trilinos Tpetra"
+#  endif
+
+#  include <deal.II/base/memory_space.h>
+
+#  include <deal.II/lac/block_sparsity_pattern.h>
+#  include <deal.II/lac/trilinos_tpetra_block_sparse_matrix.h>
+#  include <deal.II/lac/trilinos_tpetra_block_vector.h>
+#  include <deal.II/lac/trilinos_tpetra_precondition.h>
+#  include <deal.II/lac/trilinos_tpetra_sparse_matrix.h>
+#  include <deal.II/lac/trilinos_tpetra_sparsity_pattern.h>
+
+namespace LA
+{
+  // Memory space of all the Tpetra objects, i.e. the Kokkos default
+  // execution space.
+  using MemorySpace = dealii::MemorySpace::Default;
+
+  using SparseMatrix =
+      dealii::LinearAlgebra::TpetraWrappers::SparseMatrix<double, MemorySpace>;
+  using BlockSparseMatrix =
+      dealii::LinearAlgebra::TpetraWrappers::BlockSparseMatrix<double, MemorySpace>;
+  using BlockSparsityPattern =
+      dealii::LinearAlgebra::TpetraWrappers::BlockSparsityPattern<MemorySpace>;
+  using PreconditionILU =
+      dealii::LinearAlgebra::TpetraWrappers::PreconditionILU<double, MemorySpace>;
+
+  namespace MPI
+  {
+    using Vector = dealii::LinearAlgebra::TpetraWrappers::Vector<double, MemorySpace>;
+    using BlockVector =
+        dealii::LinearAlgebra::TpetraWrappers::BlockVector<double, MemorySpace>;
+  }
+}
+
+#else
+
+#  include <deal.II/lac/trilinos_block_sparse_matrix.h>
+#  include <deal.II/lac/trilinos_parallel_block_vector.h>
+#  include <deal.II/lac/trilinos_precondition.h>
+#  include <deal.II/lac/trilinos_sparse_matrix.h>
+#  include <deal.II/lac/trilinos_sparsity_pattern.h>
+
+namespace LA
+{
+  using SparseMatrix = dealii::TrilinosWrappers::SparseMatrix;
+  using BlockSparseMatrix = dealii::TrilinosWrappers::BlockSparseMatrix;
+  using BlockSparsityPattern = dealii::TrilinosWrappers::BlockSparsityPattern;
+  using PreconditionILU = dealii::TrilinosWrappers::PreconditionILU;
+  using PreconditionAMG = dealii::TrilinosWrappers::PreconditionAMG;
+
+  namespace MPI
+  {
+    using Vector = dealii::TrilinosWrappers::MPI::Vector;
+    using BlockVector = dealii::TrilinosWrappers::MPI::BlockVector;
+  }
+}
+
+#endif
+
+#endif
@@ -1,114 +1,109 @@
 #include "NSSolver.hpp"
+
+#include <deal.II/lac/dynamic_sparsity_pattern.h>
+#include <deal.II/lac/sparsity_pattern.h>
+
+#include <array>
+#include <cstdint>
 #include <fstream>
+#include <numeric>
+#include <type_traits>
 
-void NSSolver::setup()
+namespace
 {
-  // Create the mesh
-  if (!read_mesh_from_file) 
+  // Largest local array kept on the stack. The local matrices of the 3D
+  // Q3-Q2 kernel (219 DoFs) take almost 400 KB each and are allocated on the
+  // heap instead; the loops over the DoFs keep their compile-time bounds.
+  constexpr std::size_t max_stack_array_bytes = 64 * 1024;
+
+  template <typename T, unsigned int n>
+  constexpr bool on_stack = n > 0 && n * sizeof(T) <= max_stack_array_bytes;
+
+  // Array of n values on the stack, or a vector of the given size if n is 0
+  // (the size is only known at run time) or the array is too large.
+  template <typename T, unsigned int n>
+  using LocalArray =
+      std::conditional_t<on_stack<T, n>, std::array<T, n>, std::vector<T>>;
+
+  template <typename T, unsigned int n>
+  LocalArray<T, n>
+  make_local_array(const unsigned int size)
   {
+    if constexpr (!on_stack<T, n>)
+      return std::vector<T>(size);
+    else
     {
-      constexpr unsigned int dim = 2;
-
-      // First: Create a full rectangular mesh with quadrilaterals.
-      Triangulation<dim> full_tria;
-      const Point<dim> bottom_left(0.0, 0.0);
-      const Point<dim> top_right(2.2, 0.41);
-
-      // Use a subdivision that gives reasonable resolution.
-      std::vector<unsigned int> subdivisions{mesh_size_x, mesh_size_y};
-
-      GridGenerator::subdivided_hyper_rectangle(full_tria,
-                                                  subdivisions,
-                                                  bottom_left,
-                                                  top_right);
-
-      // Define the circle parameters.
-      const Point<dim> circle_center((bottom_left[0] + 0.2),
-                                    (bottom_left[1] + top_right[1]) / 2.0);
-      const double circle_radius = 0.05;
-
-      // Prepare vectors to store vertices and cell connectivity.
-      std::vector<Point<dim>> vertices;
-      std::vector<CellData<dim>> cells;
-      SubCellData subcell_data;
-
-      // Copy vertices from the full triangulation.
-      vertices.resize(full_tria.n_vertices());
-      for (unsigned int i = 0; i < full_tria.n_vertices(); ++i)
-        vertices[i] = full_tria.get_vertices()[i];
-
-      // For each cell not inside the circle, copy its vertex indices.
-      for (auto cell = full_tria.begin_active(); cell != full_tria.end(); ++cell)
-      {
-        // Skip the cell if its center lies inside the circle.
-        if ((cell->center() - circle_center).norm() < circle_radius)
-          continue;
-        
-        // Create a CellData object.
-        CellData<dim> cell_data;
-        cell_data.vertices.resize(GeometryInfo<dim>::vertices_per_cell);
-        for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
-          cell_data.vertices[v] = cell->vertex_index(v);
-        // get all the elements which have a distance with the circle center than is comprised between 0.05 +- element_size/2
-        // if the element is inside the circle, we assign it a material id of 10
-        if((cell->center() - circle_center).norm() < circle_radius + cell->diameter()/2 &&
-            (cell->center() - circle_center).norm() > circle_radius - cell->diameter()/2)
-        {
-          cell_data.material_id = 10;
-        }
-        else
-        {
-          cell_data.material_id = 0;
-        }
-        cells.push_back(cell_data);
-      }
+      (void)size;
+      return LocalArray<T, n>{};
+    }
+  }
+}
+
+template <int dim>
+void NSSolver<dim>::setup()
+{
+  Timer setup_timer;
 
-      // Remove vertices that are not used in any cell.
-      GridTools::delete_unused_vertices(vertices, cells, subcell_data);
+  AssertThrow(!cylinder_mesh || !read_mesh_from_file,
+              ExcMessage("The boundary-fitted mesh is generated: it cannot be "
+                         "combined with a mesh file."));
+  AssertThrow(!stabilized() || !projection_scheme,
+              ExcMessage("Equal-order elements are only stabilized in the "
+                         "coupled formulation, not in the pressure-correction "
+                         "scheme."));
 
-      // Create a new triangulation using the filtered vertices and cells.
-      Triangulation<dim> mesh_serial;
-      mesh_serial.create_triangulation(vertices, cells, subcell_data);
+  if (adaptive_refinement)
+  {
+    AssertThrow(!read_mesh_from_file,
+                ExcMessage("Adaptive refinement is only available on the "
+                           "generated (quadrilateral) mesh."));
+    AssertThrow(!projection_scheme && !owner_computes_assembly,
+                ExcMessage("Adaptive refinement is not available with the "
+                           "pressure-correction scheme and the owner-computes "
+                           "assembly."));
+    AssertThrow(checkpoint_interval == 0 && restart_file_name.empty(),
+                ExcMessage("Checkpoints require a mesh without adaptive "
+                           "refinement."));
+#ifdef NS_USE_TPETRA
+    AssertThrow(false,
+                ExcMessage("Adaptive refinement is not available with the "
+                           "Tpetra backend."));
+#endif
+  }
 
-      // Mark boundaries.
-      // Loop over all active cells and then over each face.
-      // - Left side (x = bottom_left[0]) -> boundary id 7 (inlet)
-      // - Right side (x = top_right[0]) -> boundary id 8 (outlet)
-      // - All other boundaries -> boundary id 6.
-      for (auto cell = mesh_serial.begin_active(); cell != mesh_serial.end(); ++cell)
+  // Create the mesh
+  if (!read_mesh_from_file) 
+  {
+    {
+      pcout << "Initializing the mesh" << std::endl;
+
+      if (adaptive_refinement)
       {
-        for (unsigned int face = 0; face < GeometryInfo<dim>::faces_per_cell; ++face)
-        {
-          if (cell->face(face)->at_boundary())
-          {
-            const Point<dim> face_center = cell->face(face)->center();
-            if (std::fabs(face_center[0] - bottom_left[0]) < 1e-12)
-              cell->face(face)->set_boundary_id(7); // inlet
-            else if (std::fabs(face_center[0] - top_right[0]) < 1e-12)
-              cell->face(face)->set_boundary_id(8); // outlet
-            // if the current cell has id 10, assign it boundary id 10
-            else if (cell->material_id() == 10)
-              cell->face(face)->set_boundary_id(10); // circle
-            else
-              cell->face(face)->set_boundary_id(6); // all other boundaries (top, bottom, circular)
-          }
-        }
+        // The adaptive mesh is refined by p4est, which needs the coarse mesh
+        // on every process.
+        Triangulation<dim> mesh_serial;
+        create_serial_mesh(mesh_serial);
+        mesh_adaptive.copy_triangulation(mesh_serial);
       }
-
+      else
       {
-        GridTools::partition_triangulation(mpi_size, mesh_serial);
-        const auto construction_data = TriangulationDescription::Utilities::
-            create_description_from_triangulation(mesh_serial, MPI_COMM_WORLD);
-        mesh.create_triangulation(construction_data);
+        // The description of the distributed mesh only holds the manifold
+        // ids of the cells and faces.
+        if (cylinder_mesh)
+          CylinderMesh::attach_manifold(mesh);
+        create_distributed_mesh([this](Triangulation<dim> &mesh_serial) {
+          create_serial_mesh(mesh_serial);
+        });
       }
+      time_mesh_setup = setup_timer.wall_time();
 
-      pcout << "  Number of elements = " << mesh.n_global_active_cells()
+      pcout << "  Number of elements = " << triangulation().n_global_active_cells()
             << std::endl;
 
       // Output the mesh to a VTU file.
       GridOut grid_out;
       std::ofstream output_file("mesh.msh");
-      grid_out.write_msh(mesh, output_file);
+      grid_out.write_msh(triangulation(), output_file);
       pcout << "Mesh written to mesh.msh" << std::endl;
     }
 
@@ -131,6 +126,14 @@ void NSSolver::setup()
       pcout << "  DoFs per cell              = " << fe->dofs_per_cell
             << std::endl;
 
+      // The cells on the cylinder of the boundary-fitted mesh are curved
+      // with the same degree as the velocity.
+      mapping = std::make_unique<MappingQ<dim>>(
+          cylinder_mesh ? degree_velocity : 1);
+
+      pcout << "  Mapping degree             = " << mapping->get_degree()
+            << std::endl;
+
       quadrature = std::make_unique<QGauss<dim>>(fe->degree + 1);
 
       pcout << "  Quadrature points per cell = " << quadrature->size()
@@ -148,27 +151,20 @@ void NSSolver::setup()
     {
       pcout << "Initializing the mesh" << std::endl;
 
-      // First we read the mesh from file into a serial (i.e. not parallel)
-      // triangulation.
-      Triangulation<dim> mesh_serial;
-
-      {
+      // Only the first process of each group reads the mesh from file, so
+      // that the file is not opened by every process at the same time.
+      pcout << "Mesh file name = " << mesh_file_name << std::endl;
+      create_distributed_mesh([this](Triangulation<dim> &mesh_serial) {
         GridIn<dim> grid_in;
         grid_in.attach_triangulation(mesh_serial);
-        pcout << "Mesh file name = " << mesh_file_name << std::endl;
 
         std::ifstream grid_in_file(mesh_file_name);
+        AssertThrow(grid_in_file,
+                    ExcMessage("Could not open the mesh file " +
+                               mesh_file_name));
         grid_in.read_msh(grid_in_file);
-        pcout << "Here1" << std::endl;
-      }
-
-      // Then, we copy the triangulation into the parallel one.
-      {
-        GridTools::partition_triangulation(mpi_size, mesh_serial);
-        const auto construction_data = TriangulationDescription::Utilities::
-            create_description_from_triangulation(mesh_serial, MPI_COMM_WORLD);
-        mesh.create_triangulation(construction_data);
-      }
+      });
+      time_mesh_setup = setup_timer.wall_time();
 
       // Notice that we write here the number of *global* active cells (across all
       // processes).
@@ -197,6 +193,8 @@ void NSSolver::setup()
       pcout << "  DoFs per cell              = " << fe->dofs_per_cell
             << std::endl;
 
+      mapping = std::make_unique<MappingFE<dim>>(FE_SimplexP<dim>(1));
+
       quadrature = std::make_unique<QGaussSimplex<dim>>(fe->degree + 1);
 
       pcout << "  Quadrature points per cell = " << quadrature->size()
@@ -210,22 +208,78 @@ void NSSolver::setup()
   }
   pcout << "-----------------------------------------------" << std::endl;
 
+  dof_handler.reinit(triangulation());
+  setup_dofs();
+
+  // The cache record of a cold run is complete once the DoFs are set up.
+  if (mesh_cache_record && mesh_cache_status == MeshCacheStatus::cold)
+    write_mesh_cache(mesh_cache_file_name(), *mesh_cache_record);
+  mesh_cache_record.reset();
+
+  build_boundary_face_index();
+  update_time_derivative();
+
+  if (projection_scheme)
+    assemble_projection_matrices();
+
+  time_setup = setup_timer.wall_time();
+  print_partition_statistics();
+  print_setup_statistics();
+}
+
+template <int dim>
+void NSSolver<dim>::setup_dofs()
+{
   // Initialize the DoF handler.
   {
     pcout << "Initializing the DoF handler" << std::endl;
 
-    dof_handler.reinit(mesh);
     dof_handler.distribute_dofs(*fe);
 
-    // We want to reorder DoFs so that all velocity DoFs come first, and then
-    // all pressure DoFs.
     std::vector<unsigned int> block_component(dim + 1, 0);
     block_component[dim] = 1;
-    DoFRenumbering::component_wise(dof_handler, block_component);
+
+    if (mesh_cache_record && mesh_cache_status == MeshCacheStatus::warm)
+    {
+      // The final numbering is read from the mesh cache.
+      AssertThrow(mesh_cache_record->dof_numbers.size() ==
+                      dof_handler.locally_owned_dofs().n_elements(),
+                  ExcMessage("The cached DoF numbering does not match the "
+                             "DoFs of this process."));
+      dof_handler.renumber_dofs(mesh_cache_record->dof_numbers);
+    }
+    else
+    {
+      // The DoFs before the renumbering, to store the final numbering in the
+      // mesh cache.
+      const bool cache_dofs =
+          mesh_cache_record && mesh_cache_status == MeshCacheStatus::cold;
+      const IndexSet initial_owned_dofs = dof_handler.locally_owned_dofs();
+      std::vector<types::global_dof_index> initial_cell_dof_indices;
+      if (cache_dofs)
+        initial_cell_dof_indices = locally_owned_cell_dof_indices();
+
+      renumber_dofs();
+
+      // We want to reorder DoFs so that all velocity DoFs come first, and
+      // then all pressure DoFs. The DoFs of each block keep their relative
+      // order.
+      DoFRenumbering::component_wise(dof_handler, block_component);
+
+      if (cache_dofs)
+        cache_dof_numbers(initial_owned_dofs, initial_cell_dof_indices);
+    }
 
     locally_owned_dofs = dof_handler.locally_owned_dofs();
     DoFTools::extract_locally_relevant_dofs(dof_handler, locally_relevant_dofs);
 
+    // Constraints of the hanging nodes of the adaptive mesh, empty otherwise.
+    hanging_node_constraints.clear();
+    hanging_node_constraints.reinit(locally_relevant_dofs);
+    DoFTools::make_hanging_node_constraints(dof_handler,
+                                            hanging_node_constraints);
+    hanging_node_constraints.close();
+
     // Besides the locally owned and locally relevant indices for the whole
     // system (velocity and pressure), we will also need those for the
     // individual velocity and pressure blocks.
@@ -259,23 +313,38 @@ void NSSolver::setup()
     // terms involving u times v), and pressure DoFs interact with velocity DoFs
     // (there are terms involving p times v or u times q). However, pressure
     // DoFs do not interact with other pressure DoFs (there are no terms
-    // involving p times q). We build a table to store this information, so that
-    // the sparsity pattern can be built accordingly.
+    // involving p times q), except through the PSPG term of the stabilized
+    // equal-order elements. We build a table to store this information, so
+    // that the sparsity pattern can be built accordingly.
     Table<2, DoFTools::Coupling> coupling(dim + 1, dim + 1);
     for (unsigned int c = 0; c < dim + 1; ++c)
     {
       for (unsigned int d = 0; d < dim + 1; ++d)
       {
         if (c == dim && d == dim) // pressure-pressure term
-          coupling[c][d] = DoFTools::none;
+          coupling[c][d] = stabilized() ? DoFTools::always : DoFTools::none;
         else // other combinations
           coupling[c][d] = DoFTools::always;
       }
     }
 
-    TrilinosWrappers::BlockSparsityPattern sparsity(block_owned_dofs,
-                                                    MPI_COMM_WORLD);
-    DoFTools::make_sparsity_pattern(dof_handler, coupling, sparsity);
+    // On a warm run of the mesh cache the locally owned rows are read from
+    // it, on a cold one they are stored in it.
+    const bool cached_sparsity =
+        mesh_cache_record && mesh_cache_status == MeshCacheStatus::warm;
+    const bool cache_sparsity =
+        mesh_cache_record && mesh_cache_status == MeshCacheStatus::cold;
+
+    LA::BlockSparsityPattern sparsity(block_owned_dofs,
+                                                    mpi_comm);
+    if (cached_sparsity)
+      add_cached_sparsity_pattern(mesh_cache_record->jacobian_sparsity,
+                                  sparsity);
+    else
+      DoFTools::make_sparsity_pattern(
+          dof_handler, coupling, sparsity, hanging_node_constraints, false);
+    if (cache_sparsity)
+      cache_sparsity_pattern(coupling, mesh_cache_record->jacobian_sparsity);
     sparsity.compress();
 
     // We also build a sparsity pattern for the pressure mass matrix.
@@ -289,263 +358,694 @@ void NSSolver::setup()
           coupling[c][d] = DoFTools::none;
       }
     }
-    TrilinosWrappers::BlockSparsityPattern sparsity_pressure_mass(
-        block_owned_dofs, MPI_COMM_WORLD);
-    DoFTools::make_sparsity_pattern(dof_handler,
-                                    coupling,
-                                    sparsity_pressure_mass);
+    LA::BlockSparsityPattern sparsity_pressure_mass(
+        block_owned_dofs, mpi_comm);
+    if (cached_sparsity)
+      add_cached_sparsity_pattern(mesh_cache_record->pressure_mass_sparsity,
+                                  sparsity_pressure_mass);
+    else
+      DoFTools::make_sparsity_pattern(dof_handler,
+                                      coupling,
+                                      sparsity_pressure_mass,
+                                      hanging_node_constraints,
+                                      false);
+    if (cache_sparsity)
+      cache_sparsity_pattern(coupling,
+                             mesh_cache_record->pressure_mass_sparsity);
     sparsity_pressure_mass.compress();
 
     pcout << "  Initializing the matrices" << std::endl;
     jacobian_matrix.reinit(sparsity);
     pressure_mass.reinit(sparsity_pressure_mass);
+    if (projection_scheme)
+    {
+      velocity_mass.reinit(sparsity);
+      pressure_laplace.reinit(sparsity_pressure_mass);
+    }
 
     pcout << "  Initializing the system right-hand side" << std::endl;
-    residual_vector.reinit(block_owned_dofs, MPI_COMM_WORLD);
+    residual_vector.reinit(block_owned_dofs, mpi_comm);
     pcout << "  Initializing the solution vector" << std::endl;
-    solution_owned.reinit(block_owned_dofs, MPI_COMM_WORLD);
-    delta_owned.reinit(block_owned_dofs, MPI_COMM_WORLD);
+    solution_owned.reinit(block_owned_dofs, mpi_comm);
+    delta_owned.reinit(block_owned_dofs, mpi_comm);
 
-    solution.reinit(block_owned_dofs, block_relevant_dofs, MPI_COMM_WORLD);
+    solution.reinit(block_owned_dofs, block_relevant_dofs, mpi_comm);
     solution_old = solution;
+    bdf_history_term = solution;
+    convection_velocity = solution;
+    pressure_increment = solution;
   }
+
+  pcout << "-----------------------------------------------" << std::endl;
 }
 
-void NSSolver::assemble_system(bool first_iter)
+template <int dim>
+void NSSolver<dim>::renumber_dofs()
 {
-  const unsigned int dofs_per_cell = fe->dofs_per_cell;
-  const unsigned int n_q = quadrature->size();
-  const unsigned int n_q_face = quadrature_face->size();
+  if (dof_ordering == DoFOrdering::none)
+    return;
 
-  FEValues<dim> fe_values(*fe,
-                          *quadrature,
-                          update_values | update_gradients |
-                              update_quadrature_points | update_JxW_values);
-  FEFaceValues<dim> fe_face_values(*fe,
-                                   *quadrature_face,
-                                   update_values | update_normal_vectors |
-                                       update_JxW_values);
+  if (dof_ordering == DoFOrdering::cuthill_mckee)
+  {
+    // Each process renumbers its locally owned DoFs.
+    DoFRenumbering::Cuthill_McKee(dof_handler, true);
+    return;
+  }
 
-  FullMatrix<double> cell_matrix(dofs_per_cell, dofs_per_cell);
-  FullMatrix<double> cell_pressure_mass_matrix(dofs_per_cell, dofs_per_cell);
-  Vector<double> cell_rhs(dofs_per_cell);
+  // The other orderings sort the locally owned DoFs by a key computed from
+  // their support points.
+  std::map<types::global_dof_index, Point<dim>> support_points;
+  DoFTools::map_dofs_to_support_points(
+      *mapping,
+      dof_handler,
+      support_points);
 
-  std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+  const IndexSet &owned_dofs = dof_handler.locally_owned_dofs();
+  std::vector<Point<dim>> points;
+  points.reserve(owned_dofs.n_elements());
+  for (const auto i : owned_dofs)
+    points.push_back(support_points[i]);
 
-  jacobian_matrix = 0.0;
-  residual_vector = 0.0;
-  pressure_mass = 0.0;
+  std::vector<unsigned int> order(points.size());
+  std::iota(order.begin(), order.end(), 0);
 
-  // Extractors
-  FEValuesExtractors::Vector velocity(0);
-  FEValuesExtractors::Scalar pressure(dim);
+  if (dof_ordering == DoFOrdering::hilbert)
+  {
+    const int bits_per_dim = 64 / dim;
+    const auto coordinates =
+        Utilities::inverse_Hilbert_space_filling_curve(points, bits_per_dim);
+    std::vector<std::uint64_t> keys(points.size());
+    for (unsigned int k = 0; k < points.size(); ++k)
+      keys[k] = Utilities::pack_integers<dim>(coordinates[k], bits_per_dim);
+
+    std::stable_sort(order.begin(), order.end(), [&](const auto a, const auto b) {
+      return keys[a] < keys[b];
+    });
+  }
+  else
+  {
+    // The flow goes from the inlet (x = 0) to the outlet.
+    std::stable_sort(order.begin(), order.end(), [&](const auto a, const auto b) {
+      return points[a][0] < points[b][0];
+    });
+  }
 
-  // We use these vectors to store the old solution (i.e. at previous Newton
-  // iteration) and its gradient on quadrature nodes of the current cell.
-  std::vector<Tensor<1, dim>> velocity_loc(n_q);
-  std::vector<Tensor<1, dim>> velocity_old_loc(n_q);
-  std::vector<Tensor<2, dim>> velocity_gradient_loc(n_q);
-  std::vector<double> pressure_loc(n_q);
+  // The k-th DoF along the ordering takes the k-th locally owned index.
+  std::vector<types::global_dof_index> new_numbers(points.size());
+  for (unsigned int k = 0; k < order.size(); ++k)
+    new_numbers[order[k]] = owned_dofs.nth_index_in_set(k);
+  dof_handler.renumber_dofs(new_numbers);
+}
 
-  // tensor used to store the nonlinear term contribution in each quadrature point
-  // useful when computing (u . nabla) uv, corresponding to c(u;u,v) term
-  Tensor<1, dim> nonlinear_term;
+DoFOrdering dof_ordering_from_string(const std::string &name)
+{
+  if (name == "none")
+    return DoFOrdering::none;
+  if (name == "cuthill-mckee")
+    return DoFOrdering::cuthill_mckee;
+  if (name == "hilbert")
+    return DoFOrdering::hilbert;
+  if (name == "downstream")
+    return DoFOrdering::downstream;
+  throw std::invalid_argument("Invalid DoF ordering " + name + ". Use none, cuthill-mckee, hilbert or downstream.");
+}
 
-  for (const auto &cell : dof_handler.active_cell_iterators())
+std::string dof_ordering_to_string(const DoFOrdering &ordering)
+{
+  switch (ordering)
   {
-    if (!cell->is_locally_owned())
+    case DoFOrdering::none:
+      return "none";
+    case DoFOrdering::cuthill_mckee:
+      return "cuthill-mckee";
+    case DoFOrdering::hilbert:
+      return "hilbert";
+    case DoFOrdering::downstream:
+      return "downstream";
+  }
+  return "unknown";
+}
+
+std::string mesh_cache_status_to_string(const MeshCacheStatus &status)
+{
+  switch (status)
+  {
+    case MeshCacheStatus::none:
+      return "none";
+    case MeshCacheStatus::cold:
+      return "cold";
+    case MeshCacheStatus::warm:
+      return "warm";
+  }
+  return "unknown";
+}
+
+template <int dim>
+void NSSolver<dim>::create_distributed_mesh(
+    const std::function<void(Triangulation<dim> &)> &serial_mesh_generator)
+{
+  TriangulationDescription::Description<dim, dim> construction_data;
+
+  // Load the record of this process from the cache, if a valid one is
+  // available. The DoF numbering and the sparsity patterns it also holds are
+  // used by setup_dofs().
+  std::string cache_file_name;
+  if (!mesh_cache_directory.empty())
+  {
+    cache_file_name = mesh_cache_file_name();
+    mesh_cache_record = std::make_unique<MeshCacheRecord>();
+    mesh_cache_status =
+        read_mesh_cache(cache_file_name, *mesh_cache_record) ?
+            MeshCacheStatus::warm :
+            MeshCacheStatus::cold;
+  }
+
+  if (mesh_cache_status == MeshCacheStatus::warm)
+  {
+    pcout << "  Mesh read from the cache " << cache_file_name << std::endl;
+    construction_data = std::move(mesh_cache_record->construction_data);
+  }
+  else
+  {
+    // Only the first process of each group builds the serial mesh and
+    // partitions it, then it sends to the other processes of the group the
+    // description of their part. By default a group is a shared memory
+    // node, so that the serial mesh is stored once per node.
+    const unsigned int group_size =
+        mesh_group_size > 0 ? mesh_group_size : n_processes_per_node();
+    pcout << "  Serial mesh built by groups of " << group_size
+          << " processes" << std::endl;
+
+    construction_data = TriangulationDescription::Utilities::
+        create_description_from_triangulation_in_groups<dim, dim>(
+            serial_mesh_generator,
+            [this](Triangulation<dim> &mesh_serial,
+                   const MPI_Comm comm,
+                   const unsigned int /*group_size*/) {
+              partition_serial_mesh(mesh_serial,
+                                    Utilities::MPI::n_mpi_processes(comm));
+            },
+            mpi_comm,
+            group_size);
+
+    // The cache is written at the end of setup(), with the DoFs.
+    if (mesh_cache_record)
+      mesh_cache_record->construction_data = construction_data;
+  }
+
+  mesh.create_triangulation(construction_data);
+}
+
+template <int dim>
+void NSSolver<dim>::partition_serial_mesh(Triangulation<dim> &mesh_serial,
+                                     const unsigned int &n_partitions) const
+{
+  // Uniform weights unless the boundary faces have a cost.
+  std::vector<unsigned int> cell_weights;
+  if (outlet_face_weight > 0.0 || cylinder_face_weight > 0.0)
+  {
+    cell_weights.resize(mesh_serial.n_active_cells());
+    for (const auto &cell : mesh_serial.active_cell_iterators())
+      cell_weights[cell->active_cell_index()] = partition_weight(cell);
+  }
+
+  if (partition_minimize_communication)
+  {
+    // The DoFs on a vertex are shared by all the cells around it, so two
+    // cells sharing only a vertex on different processes also exchange ghost
+    // values. Cutting the vertex graph counts these couplings, which the
+    // default face graph ignores.
+    DynamicSparsityPattern dsp;
+    GridTools::get_vertex_connectivity_of_cells(mesh_serial, dsp);
+    SparsityPattern cell_connection_graph;
+    cell_connection_graph.copy_from(dsp);
+
+    GridTools::partition_triangulation(n_partitions,
+                                       cell_weights,
+                                       cell_connection_graph,
+                                       mesh_serial);
+  }
+  else
+  {
+    GridTools::partition_triangulation(n_partitions, cell_weights, mesh_serial);
+  }
+}
+
+template <int dim>
+unsigned int NSSolver<dim>::partition_weight(
+    const typename Triangulation<dim>::active_cell_iterator &cell) const
+{
+  double weight = 1.0;
+  for (const auto f : cell->face_indices())
+  {
+    if (!cell->face(f)->at_boundary())
       continue;
 
-    fe_values.reinit(cell);
+    if (cell->face(f)->boundary_id() == outlet_boundary_id)
+      weight += outlet_face_weight;
+    else if (cell->face(f)->boundary_id() == cylinder_boundary_id)
+      weight += cylinder_face_weight;
+  }
 
-    cell_matrix = 0.0;
-    cell_rhs = 0.0;
-    cell_pressure_mass_matrix = 0.0;
+  return static_cast<unsigned int>(std::round(100.0 * weight));
+}
 
-    // We need to compute the Jacobian matrix and the residual for current
-    // cell. This requires knowing the value and the gradient of u^{(k)}
-    // (stored inside solution) on the quadrature nodes of the current
-    // cell. This can be accomplished through
-    // FEValues::get_function_values and FEValues::get_function_gradients.
-    fe_values[velocity].get_function_values(solution, velocity_loc);
-    fe_values[velocity].get_function_gradients(solution,
-                                               velocity_gradient_loc);
-    fe_values[pressure].get_function_values(solution, pressure_loc);
-    fe_values[velocity].get_function_values(solution_old, velocity_old_loc);
+template <int dim>
+void NSSolver<dim>::print_partition_statistics() const
+{
+  unsigned int n_cells = 0;
+  unsigned long weight = 0;
+  unsigned int edge_cut = 0;
 
-    for (unsigned int q = 0; q < n_q; ++q)
+  for (const auto &cell : triangulation().active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    ++n_cells;
+    weight += partition_weight(cell);
+
+    // Faces shared with a cell of another process. On an adaptive mesh a
+    // face may be shared with several finer cells.
+    for (const auto f : cell->face_indices())
     {
-      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      if (cell->at_boundary(f))
+        continue;
+
+      if (cell->face(f)->has_children())
       {
-        for (unsigned int j = 0; j < dofs_per_cell; ++j)
-        {
-          if (first_iter)
-          {
-            // Viscosity term.
-            cell_matrix(i, j) +=
-                nu *
-                scalar_product(fe_values[velocity].gradient(i, q),
-                               fe_values[velocity].gradient(j, q)) *
-                fe_values.JxW(q);
-
-            // Pressure term in the momentum equation.
-            cell_matrix(i, j) -= fe_values[velocity].divergence(i, q) *
-                                 fe_values[pressure].value(j, q) *
-                                 fe_values.JxW(q);
-
-            // time dependent term (mass matrix)
-            cell_matrix(i, j) += (velocity_loc[q] - velocity_old_loc[q]) *
-                                 fe_values[velocity].value(i, q) / delta_t *
-                                 fe_values.JxW(q);
-
-            // Pressure term in the continuity equation.
-            cell_matrix(i, j) -= fe_values[velocity].divergence(j, q) *
-                                 fe_values[pressure].value(i, q) *
-                                 fe_values.JxW(q);
+        for (unsigned int sf = 0; sf < cell->face(f)->n_children(); ++sf)
+          if (!cell->neighbor_child_on_subface(f, sf)->is_locally_owned())
+            ++edge_cut;
+      }
+      else if (!cell->neighbor(f)->is_locally_owned())
+        ++edge_cut;
+    }
+  }
 
-            // Pressure mass matrix.
-            cell_pressure_mass_matrix(i, j) +=
-                fe_values[pressure].value(i, q) *
-                fe_values[pressure].value(j, q) / nu * fe_values.JxW(q);
-          }
+  const double n_dofs = locally_owned_dofs.n_elements();
+  const double n_ghosts =
+      locally_relevant_dofs.n_elements() - locally_owned_dofs.n_elements();
+
+  const std::vector<std::pair<std::string, double>> values = {
+      {"Cells      ", n_cells},
+      {"Cell weight", weight / 100.0},
+      {"DoFs       ", n_dofs},
+      {"Ghost DoFs ", n_ghosts},
+      {"Edge cut   ", edge_cut}};
+
+  pcout << "Partition statistics (min / avg / max over processes, "
+        << "imbalance = max / avg):" << std::endl;
+  pcout << "  Graph                      = "
+        << (partition_minimize_communication ? "vertex" : "face")
+        << " connectivity" << std::endl;
+  pcout << std::fixed << std::setprecision(1);
+  for (const auto &[name, value] : values)
+  {
+    const Utilities::MPI::MinMaxAvg stats =
+        Utilities::MPI::min_max_avg(value, mpi_comm);
+    pcout << "  " << name << "                = " << stats.min << " / "
+          << stats.avg << " / " << stats.max << ", imbalance "
+          << std::setprecision(3) << (stats.avg > 0 ? stats.max / stats.avg : 1.0)
+          << std::setprecision(1) << std::endl;
+  }
 
-          else
-          {
-            for (unsigned int k = 0; k < dim; k++)
-            {
-              nonlinear_term[k] = 0.0;
-              for (unsigned int l = 0; l < dim; l++)
-              {
-                // compute both terms yielded by the Frechet derivative
-                // (u . nabla) u_old
-                nonlinear_term[k] += velocity_loc[q][l] *
-                                     fe_values[velocity].gradient(j, q)[k][l];
-
-                // (u_old . nabla) u
-                nonlinear_term[k] += fe_values[velocity].value(j, q)[l] *
-                                     velocity_gradient_loc[q][k][l];
-              }
-            }
-
-            // assemble the linearized convective term (u . nabla) uv
-            cell_matrix(i, j) += scalar_product(nonlinear_term, fe_values[velocity].value(i, q)) * fe_values.JxW(q);
-
-            // time dependent term delta_h * v_h / delta_t
-            cell_matrix(i, j) += fe_values[velocity].value(j, q) *
-                                 fe_values[velocity].value(i, q) / delta_t *
-                                 fe_values.JxW(q);
-
-            // Third term - viscosity
-            cell_matrix(i, j) +=
-                nu *
-                scalar_product(fe_values[velocity].gradient(j, q),
-                               fe_values[velocity].gradient(i, q)) *
-                fe_values.JxW(q);
-
-            // Pressure term in the momentum equation.
-            cell_matrix(i, j) -= fe_values[pressure].value(j, q) *
-                                 fe_values[velocity].divergence(i, q) *
-                                 fe_values.JxW(q);
-
-            // Pressure term in the continuity equation.
-            cell_matrix(i, j) += fe_values[pressure].value(i, q) *
-                                 fe_values[velocity].divergence(j, q) *
-                                 fe_values.JxW(q);
-
-            // Pressure mass matrix
-            cell_pressure_mass_matrix(i, j) +=
-                fe_values[pressure].value(i, q) *
-                fe_values[pressure].value(j, q) / nu * fe_values.JxW(q);
-          }
-        }
+  // Each cut face is counted by both processes.
+  pcout << "  Total edge cut             = "
+        << Utilities::MPI::sum(edge_cut, mpi_comm) / 2 << " faces" << std::endl;
+  pcout << "-----------------------------------------------" << std::endl;
 
-        if (first_iter)
-        {
-          continue;
-        }
+  // The values of every process are appended to partition.csv.
+  std::vector<std::vector<double>> gathered;
+  for (const auto &[name, value] : values)
+    gathered.push_back(Utilities::MPI::gather(mpi_comm, value, 0));
 
-        //-R(u,v)
-        // time dependent term
-        cell_rhs(i) -= (velocity_loc[q] - velocity_old_loc[q]) *
-                       fe_values[velocity].value(i, q) / delta_t *
-                       fe_values.JxW(q);
+  if (mpi_rank == 0)
+  {
+    std::ofstream file("partition.csv", std::ios::app);
+    if (file.tellp() == 0)
+      file << "n_processes,process,graph,outlet_face_weight,"
+              "cylinder_face_weight,cells,cell_weight,dofs,ghost_dofs,"
+              "edge_cut\n";
+    for (unsigned int p = 0; p < mpi_size; ++p)
+    {
+      file << mpi_size << "," << p << ","
+           << (partition_minimize_communication ? "vertex" : "face") << ","
+           << outlet_face_weight << "," << cylinder_face_weight;
+      for (const auto &column : gathered)
+        file << "," << column[p];
+      file << "\n";
+    }
+  }
+}
 
-        // a(u,v)
-        cell_rhs(i) -=
-            nu *
-            scalar_product(velocity_gradient_loc[q],
-                           fe_values[velocity].gradient(i, q)) *
-            fe_values.JxW(q);
-
-        // Compute residual associated with Newton linearization of (u . nabla) u
-        // nabla u is a tensor, iterate over both dimensions
-        for (unsigned int k = 0; k < dim; k++)
-        {
-          nonlinear_term[k] = 0.0;
-          for (unsigned int l = 0; l < dim; l++)
-          {
-            // compute (u_old . nabla) u_old
-            nonlinear_term[k] += velocity_loc[q][l] *
-                                 velocity_gradient_loc[q][k][l];
-          }
-        }
+template <int dim>
+unsigned int NSSolver<dim>::n_processes_per_node() const
+{
+  MPI_Comm node_comm;
+  int ierr = MPI_Comm_split_type(
+      mpi_comm, MPI_COMM_TYPE_SHARED, mpi_rank, MPI_INFO_NULL, &node_comm);
+  AssertThrowMPI(ierr);
+  const unsigned int n_local = Utilities::MPI::n_mpi_processes(node_comm);
+  ierr = MPI_Comm_free(&node_comm);
+  AssertThrowMPI(ierr);
+
+  // Groups are made of consecutive processes, so they can only match the
+  // nodes if all of them have the same number of processes.
+  return Utilities::MPI::min(n_local, mpi_comm);
+}
 
-        // assemble the residual associated with the nonlinear convective term
-        cell_rhs(i) -= scalar_product(nonlinear_term, fe_values[velocity].value(i, q)) * fe_values.JxW(q);
+template <int dim>
+void NSSolver<dim>::print_setup_statistics() const
+{
+  Utilities::System::MemoryStats memory_stats;
+  Utilities::System::get_memory_stats(memory_stats);
+
+  // Peak resident memory, in MB.
+  const double peak_memory = memory_stats.VmHWM / 1024.0;
+
+  const Utilities::MPI::MinMaxAvg mesh_stats =
+      Utilities::MPI::min_max_avg(time_mesh_setup, mpi_comm);
+  const Utilities::MPI::MinMaxAvg setup_stats =
+      Utilities::MPI::min_max_avg(time_setup, mpi_comm);
+  const Utilities::MPI::MinMaxAvg memory_minmax =
+      Utilities::MPI::min_max_avg(peak_memory, mpi_comm);
+
+  pcout << "Setup statistics (min / avg / max over processes):" << std::endl;
+  pcout << "  Mesh cache                 = "
+        << mesh_cache_status_to_string(mesh_cache_status) << std::endl;
+  pcout << std::fixed << std::setprecision(3);
+  pcout << "  Mesh construction time [s] = " << mesh_stats.min << " / "
+        << mesh_stats.avg << " / " << mesh_stats.max << std::endl;
+  pcout << "  Total setup time [s]       = " << setup_stats.min << " / "
+        << setup_stats.avg << " / " << setup_stats.max << std::endl;
+  pcout << std::setprecision(1);
+  pcout << "  Peak memory [MB]           = " << memory_minmax.min << " / "
+        << memory_minmax.avg << " / " << memory_minmax.max << " (process "
+        << memory_minmax.max_index << ")" << std::endl;
+  pcout << "-----------------------------------------------" << std::endl;
 
-        // b(v,p)
-        cell_rhs(i) += pressure_loc[q] *
-                       fe_values[velocity].divergence(i, q) *
-                       fe_values.JxW(q);
+  // The values of every process are appended to setup.csv.
+  const std::vector<double> mesh_times =
+      Utilities::MPI::gather(mpi_comm, time_mesh_setup, 0);
+  const std::vector<double> setup_times =
+      Utilities::MPI::gather(mpi_comm, time_setup, 0);
+  const std::vector<double> peak_memories =
+      Utilities::MPI::gather(mpi_comm, peak_memory, 0);
 
-        double velocity_divergence_loc = trace(velocity_gradient_loc[q]);
+  if (mpi_rank == 0)
+  {
+    std::ofstream file("setup.csv", std::ios::app);
+    if (file.tellp() == 0)
+      file << "n_processes,process,mesh_cache,mesh_time,setup_time,peak_memory_mb\n";
+    for (unsigned int p = 0; p < mpi_size; ++p)
+      file << mpi_size << "," << p << ","
+           << mesh_cache_status_to_string(mesh_cache_status) << ","
+           << mesh_times[p] << "," << setup_times[p] << ","
+           << peak_memories[p] << "\n";
+  }
+}
+
+template <int dim>
+void NSSolver<dim>::create_serial_mesh(Triangulation<dim> &mesh_serial) const
+{
+  if (cylinder_mesh)
+  {
+    CylinderMesh::create(mesh_serial, cylinder_mesh_parameters);
+    return;
+  }
+
+  // First: Create a full rectangular mesh with quadrilaterals (a box with
+  // a square section and hexahedra in 3D).
+  Triangulation<dim> full_tria;
+  const Point<dim> bottom_left;
+  Point<dim> top_right;
+  top_right[0] = CylinderMesh::Geometry<dim>::channel_length;
+  for (unsigned int d = 1; d < dim; ++d)
+    top_right[d] = CylinderMesh::channel_height;
+
+  // Use a subdivision that gives reasonable resolution, mesh_size_y cells
+  // along z as along y.
+  std::vector<unsigned int> subdivisions(dim, mesh_size_y);
+  subdivisions[0] = mesh_size_x;
+
+  GridGenerator::subdivided_hyper_rectangle(full_tria,
+                                            subdivisions,
+                                            bottom_left,
+                                            top_right);
+
+  // Define the circle parameters. In 3D the cylinder crosses the channel
+  // along z, and the distances from its axis are taken in the xy plane.
+  Point<dim> circle_center;
+  circle_center[0] = bottom_left[0] + CylinderMesh::Geometry<dim>::cylinder_x;
+  circle_center[1] = (bottom_left[1] + top_right[1]) / 2.0;
+  const double circle_radius = CylinderMesh::cylinder_radius;
+  const auto distance_from_axis = [&](const Point<dim> &p) {
+    return std::hypot(p[0] - circle_center[0], p[1] - circle_center[1]);
+  };
+
+  // Prepare vectors to store vertices and cell connectivity.
+  std::vector<Point<dim>> vertices;
+  std::vector<CellData<dim>> cells;
+  SubCellData subcell_data;
+
+  // Copy vertices from the full triangulation.
+  vertices.resize(full_tria.n_vertices());
+  for (unsigned int i = 0; i < full_tria.n_vertices(); ++i)
+    vertices[i] = full_tria.get_vertices()[i];
+
+  // For each cell not inside the circle, copy its vertex indices.
+  for (auto cell = full_tria.begin_active(); cell != full_tria.end(); ++cell)
+  {
+    // Skip the cell if its center lies inside the circle.
+    if (distance_from_axis(cell->center()) < circle_radius)
+      continue;
+    
+    // Create a CellData object.
+    CellData<dim> cell_data;
+    cell_data.vertices.resize(GeometryInfo<dim>::vertices_per_cell);
+    for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+      cell_data.vertices[v] = cell->vertex_index(v);
+    // get all the elements which have a distance with the circle center than is comprised between 0.05 +- element_size/2
+    // if the element is inside the circle, we assign it a material id of 10
+    if(distance_from_axis(cell->center()) < circle_radius + cell->diameter()/2 &&
+        distance_from_axis(cell->center()) > circle_radius - cell->diameter()/2)
+    {
+      cell_data.material_id = 10;
+    }
+    else
+    {
+      cell_data.material_id = 0;
+    }
+    cells.push_back(cell_data);
+  }
 
-        // b(u,q) - pressure contribution in the continuity equation
-        cell_rhs(i) += velocity_divergence_loc *
-                       fe_values[pressure].value(i, q) * fe_values.JxW(q);
+  // Remove vertices that are not used in any cell.
+  GridTools::delete_unused_vertices(vertices, cells, subcell_data);
+
+  // Create the triangulation using the filtered vertices and cells.
+  mesh_serial.create_triangulation(vertices, cells, subcell_data);
+
+  // Mark boundaries.
+  // Loop over all active cells and then over each face.
+  // - Left side (x = bottom_left[0]) -> boundary id 7 (inlet)
+  // - Right side (x = top_right[0]) -> boundary id 8 (outlet)
+  // - Front and back sides in 3D (z = 0, z = top_right[2]) -> boundary id 6
+  // - All other boundaries -> boundary id 6.
+  for (auto cell = mesh_serial.begin_active(); cell != mesh_serial.end(); ++cell)
+  {
+    for (unsigned int face = 0; face < GeometryInfo<dim>::faces_per_cell; ++face)
+    {
+      if (cell->face(face)->at_boundary())
+      {
+        const Point<dim> face_center = cell->face(face)->center();
+        if (std::fabs(face_center[0] - bottom_left[0]) < 1e-12)
+          cell->face(face)->set_boundary_id(7); // inlet
+        else if (std::fabs(face_center[0] - top_right[0]) < 1e-12)
+          cell->face(face)->set_boundary_id(8); // outlet
+        else if (dim == 3 &&
+                 (std::fabs(face_center[dim - 1] - bottom_left[dim - 1]) < 1e-12 ||
+                  std::fabs(face_center[dim - 1] - top_right[dim - 1]) < 1e-12))
+          cell->face(face)->set_boundary_id(6); // front and back
+        // if the current cell has id 10, assign it boundary id 10
+        else if (cell->material_id() == 10)
+          cell->face(face)->set_boundary_id(10); // circle
+        else
+          cell->face(face)->set_boundary_id(6); // all other boundaries (top, bottom, circular)
       }
     }
+  }
+}
+
+template <int dim>
+void NSSolver<dim>::build_boundary_face_index()
+{
+  pcout << "Initializing the boundary face index" << std::endl;
+
+  const unsigned int dofs_per_cell = fe->dofs_per_cell;
+  const unsigned int n_q_face = quadrature_face->size();
+
+  FEFaceValues<dim> fe_face_values(*mapping,
+                                   *fe,
+                                   *quadrature_face,
+                                   update_values | update_gradients |
+                                       update_normal_vectors |
+                                       update_JxW_values);
 
-    // 6 borders
-    // 7 inlet
-    // 8 outlet
-    // 10 cylinder
+  FEValuesExtractors::Vector velocity(0);
+  FEValuesExtractors::Scalar pressure(dim);
 
-    // Boundary integral for Neumann BCs.
-    if (cell->at_boundary())
+  boundary_faces = {{outlet_boundary_id, {}}, {cylinder_boundary_id, {}}};
+
+  // Ghost cells are also indexed, since the owner-computes assembly needs
+  // their contribution to the locally owned rows.
+  for (const auto &cell : dof_handler.active_cell_iterators())
+  {
+    if (cell->is_artificial() || !cell->at_boundary())
+      continue;
+
+    for (unsigned int f = 0; f < cell->n_faces(); ++f)
     {
-      for (unsigned int f = 0; f < cell->n_faces(); ++f)
+      if (!cell->face(f)->at_boundary())
+        continue;
+
+      const auto faces = boundary_faces.find(cell->face(f)->boundary_id());
+      if (faces == boundary_faces.end())
+        continue;
+
+      fe_face_values.reinit(cell, f);
+
+      BoundaryFaceData face;
+      face.locally_owned = cell->is_locally_owned();
+      face.dof_indices.resize(dofs_per_cell);
+      cell->get_dof_indices(face.dof_indices);
+
+      face.normals.resize(n_q_face);
+      face.JxW.resize(n_q_face);
+      face.velocity_values.resize(n_q_face * dofs_per_cell);
+      face.velocity_gradients.resize(n_q_face * dofs_per_cell);
+      face.pressure_values.resize(n_q_face * dofs_per_cell);
+
+      for (unsigned int q = 0; q < n_q_face; ++q)
       {
-        if (cell->face(f)->at_boundary() &&
-            cell->face(f)->boundary_id() == 8)
-        {
-          fe_face_values.reinit(cell, f);
+        face.normals[q] = fe_face_values.normal_vector(q);
+        face.JxW[q] = fe_face_values.JxW(q);
 
-          for (unsigned int q = 0; q < n_q_face; ++q)
-          {
-            for (unsigned int i = 0; i < dofs_per_cell; ++i)
-            {
-              cell_rhs(i) -=
-                  p_out *
-                  scalar_product(fe_face_values.normal_vector(q),
-                                 fe_face_values[velocity].value(i, q)) *
-                  fe_face_values.JxW(q);
-            }
-          }
+        for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        {
+          face.velocity_values[q * dofs_per_cell + i] =
+              fe_face_values[velocity].value(i, q);
+          face.velocity_gradients[q * dofs_per_cell + i] =
+              fe_face_values[velocity].gradient(i, q);
+          face.pressure_values[q * dofs_per_cell + i] =
+              fe_face_values[pressure].value(i, q);
         }
       }
+
+      faces->second.push_back(std::move(face));
     }
+  }
 
-    cell->get_dof_indices(dof_indices);
+  for (const auto &[id, faces] : boundary_faces)
+    pcout << "  Faces on boundary " << static_cast<unsigned int>(id) << " = "
+          << Utilities::MPI::sum(static_cast<unsigned int>(std::count_if(
+                                     faces.begin(),
+                                     faces.end(),
+                                     [](const BoundaryFaceData &face) {
+                                       return face.locally_owned;
+                                     })),
+                                 mpi_comm)
+          << std::endl;
+}
+
+template <int dim>
+void NSSolver<dim>::assemble_system(bool first_iter)
+{
+  const unsigned int dofs_per_cell = fe->dofs_per_cell;
+  const unsigned int n_q_face = quadrature_face->size();
+
+  Vector<double> cell_rhs(dofs_per_cell);
+
+  jacobian_matrix = 0.0;
+  residual_vector = 0.0;
+  pressure_mass = 0.0;
+
+  ++n_assemblies;
+  Timer timer;
+
+  // The cell loop is specialized on the common elements: Q2-Q1, Q3-Q2 and the
+  // stabilized Q1-Q1 on quadrilaterals (hexahedra in 3D), P2-P1 and the
+  // stabilized P1-P1 on simplices.
+  const bool simplex = fe->reference_cell().is_simplex();
+  if (!simplex && degree_velocity == 2 && degree_pressure == 1)
+    assemble_cells<2, 1, false>(first_iter);
+  else if (!simplex && degree_velocity == 3 && degree_pressure == 2)
+    assemble_cells<3, 2, false>(first_iter);
+  else if (!simplex && degree_velocity == 1 && degree_pressure == 1)
+    assemble_cells<1, 1, false>(first_iter);
+  else if (simplex && degree_velocity == 2 && degree_pressure == 1)
+    assemble_cells<2, 1, true>(first_iter);
+  else if (simplex && degree_velocity == 1 && degree_pressure == 1)
+    assemble_cells<1, 1, true>(first_iter);
+  else
+    assemble_cells<0, 0, false>(first_iter);
+
+  // 6 borders
+  // 7 inlet
+  // 8 outlet
+  // 10 cylinder
+
+  // Boundary integral for Neumann BCs, on the outlet faces cached in setup().
+  const double time_before_faces = timer.wall_time();
+  for (const auto &face : boundary_faces[outlet_boundary_id])
+  {
+    if (!owner_computes_assembly && !face.locally_owned)
+      continue;
+
+    ++n_faces_assembled;
+
+    cell_rhs = 0.0;
+    for (unsigned int q = 0; q < n_q_face; ++q)
+    {
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        cell_rhs(i) -=
+            p_out *
+            scalar_product(face.normals[q],
+                           face.velocity_values[q * dofs_per_cell + i]) *
+            face.JxW[q];
+      }
+    }
 
-    jacobian_matrix.add(dof_indices, cell_matrix);
-    residual_vector.add(dof_indices, cell_rhs);
-    pressure_mass.add(dof_indices, cell_pressure_mass_matrix);
+    if (owner_computes_assembly)
+    {
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        if (locally_owned_dofs.is_element(face.dof_indices[i]))
+          residual_vector(face.dof_indices[i]) += cell_rhs(i);
+    }
+    else
+    {
+#ifdef NS_USE_TPETRA
+      residual_vector.add(face.dof_indices, cell_rhs);
+#else
+      hanging_node_constraints.distribute_local_to_global(
+          cell_rhs, face.dof_indices, residual_vector);
+#endif
+    }
   }
 
+  timer.stop();
+  time_assembly_faces += timer.wall_time() - time_before_faces;
+  time_assembly_cells += timer.wall_time();
+
+  // With the owner-computes assembly there are no off-process entries, so
+  // these calls only finalize the local data.
+  timer.restart();
   jacobian_matrix.compress(VectorOperation::add);
   residual_vector.compress(VectorOperation::add);
   pressure_mass.compress(VectorOperation::add);
+  timer.stop();
+  time_assembly_compress += timer.wall_time();
 
   // Dirichlet Boundary conditions.
   {
@@ -556,7 +1056,10 @@ void NSSolver::assemble_system(bool first_iter)
 
     boundary_values.clear();
 
-    if (first_iter && apply_first)
+    // The inlet velocity is imposed on the first update of the first time
+    // step, either the first Newton iteration or the single semi-implicit
+    // solve, and then kept by zero updates.
+    if ((first_iter || semi_implicit) && apply_first)
     {
       boundary_functions[7] = &inlet_velocity;
     }
@@ -565,68 +1068,421 @@ void NSSolver::assemble_system(bool first_iter)
       boundary_functions[7] = &zero_function;
     }
 
-    VectorTools::interpolate_boundary_values(dof_handler,
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
                                              boundary_functions,
                                              boundary_values,
-                                             ComponentMask(
-                                                 {true, true, false}));
+                                             fe->component_mask(
+                                                 FEValuesExtractors::Vector(0)));
 
     boundary_functions[6] = &zero_function;
     boundary_functions[10] = &zero_function;
-    VectorTools::interpolate_boundary_values(dof_handler,
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
                                              boundary_functions,
                                              boundary_values,
-                                             ComponentMask(
-                                                 {true, true, false}));
+                                             fe->component_mask(
+                                                 FEValuesExtractors::Vector(0)));
+
+#ifdef NS_USE_TPETRA
+    // MatrixTools does not handle Tpetra matrices: clear the rows of the
+    // constrained (velocity) DoFs, with a unit diagonal entry, and store the
+    // prescribed values in the right-hand side and in the solution.
+    std::vector<types::global_dof_index> rows;
+    for (const auto &[dof, value] : boundary_values)
+    {
+      if (!block_owned_dofs[0].is_element(dof))
+        continue;
+      rows.push_back(dof);
+      residual_vector.block(0)[dof] = value;
+      delta_owned.block(0)[dof] = value;
+    }
+    jacobian_matrix.block(0, 0).clear_rows(rows, 1.0);
+    jacobian_matrix.block(0, 1).clear_rows(rows);
+    residual_vector.compress(VectorOperation::insert);
+    delta_owned.compress(VectorOperation::insert);
+#else
+    MatrixTools::apply_boundary_values(
+        boundary_values, jacobian_matrix, delta_owned, residual_vector, false);
+#endif
+  }
+}
+
+template <int dim>
+template <unsigned int degree_velocity_,
+          unsigned int degree_pressure_,
+          bool simplex>
+void NSSolver<dim>::assemble_cells(const bool &first_iter)
+{
+  constexpr unsigned int n_dofs =
+      n_dofs_per_cell(degree_velocity_, degree_pressure_, simplex);
+  const unsigned int dofs_per_cell = n_dofs > 0 ? n_dofs : fe->dofs_per_cell;
+  AssertThrow(dofs_per_cell == fe->dofs_per_cell,
+              ExcMessage("The cell kernel does not match the finite element."));
+  const unsigned int n_q = quadrature->size();
+
+  // Known at compile time in the specialized kernels.
+  const bool stabilization = n_dofs > 0 ?
+                                 degree_velocity_ == degree_pressure_ :
+                                 stabilized();
+
+  FEValues<dim> fe_values(*mapping,
+                          *fe,
+                          *quadrature,
+                          update_values | update_gradients |
+                              update_quadrature_points | update_JxW_values);
+
+  // Local matrices, stored by rows, and right-hand side.
+  auto cell_matrix =
+      make_local_array<double, n_dofs * n_dofs>(dofs_per_cell * dofs_per_cell);
+  auto cell_pressure_mass_matrix =
+      make_local_array<double, n_dofs * n_dofs>(dofs_per_cell * dofs_per_cell);
+  auto cell_rhs = make_local_array<double, n_dofs>(dofs_per_cell);
+
+  // Shape functions on the current quadrature node, evaluated once instead
+  // of in the loops over the DoFs.
+  auto phi_u = make_local_array<Tensor<1, dim>, n_dofs>(dofs_per_cell);
+  auto grad_phi_u = make_local_array<Tensor<2, dim>, n_dofs>(dofs_per_cell);
+  auto div_phi_u = make_local_array<double, n_dofs>(dofs_per_cell);
+  auto phi_p = make_local_array<double, n_dofs>(dofs_per_cell);
+  auto grad_phi_p = make_local_array<Tensor<1, dim>, n_dofs>(dofs_per_cell);
+
+  // Linearized convective term of each shape function, see below.
+  auto convection_phi_u =
+      make_local_array<Tensor<1, dim>, n_dofs>(dofs_per_cell);
+
+  // Stabilization of the equal-order elements: test function of the SUPG
+  // and PSPG terms, tau_M ((u . nabla) v + nabla q), and derivative of the
+  // strong residual of the momentum equation along each shape function.
+  auto stabilization_test_phi =
+      make_local_array<Tensor<1, dim>, n_dofs>(dofs_per_cell);
+  auto residual_phi = make_local_array<Tensor<1, dim>, n_dofs>(dofs_per_cell);
+
+  // Copies of the local matrices and right-hand side for the constraints.
+  FullMatrix<double> cell_matrix_full(dofs_per_cell, dofs_per_cell);
+  FullMatrix<double> cell_pressure_mass_matrix_full(dofs_per_cell,
+                                                    dofs_per_cell);
+  Vector<double> cell_rhs_full(dofs_per_cell);
+
+  std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+
+  // Extractors
+  FEValuesExtractors::Vector velocity(0);
+  FEValuesExtractors::Scalar pressure(dim);
+
+  // We use these vectors to store the old solution (i.e. at previous Newton
+  // iteration) and its gradient on quadrature nodes of the current cell.
+  std::vector<Tensor<1, dim>> velocity_loc(n_q);
+  std::vector<Tensor<1, dim>> velocity_history_loc(n_q);
+  std::vector<Tensor<1, dim>> convection_loc(n_q);
+  std::vector<Tensor<2, dim>> velocity_gradient_loc(n_q);
+  std::vector<double> pressure_loc(n_q);
+  std::vector<Tensor<1, dim>> pressure_gradient_loc(n_q);
+
+  for (const auto &cell : dof_handler.active_cell_iterators())
+  {
+    // With the owner-computes assembly also ghost cells are assembled, since
+    // they contribute to the rows of the DoFs owned by this process.
+    if (owner_computes_assembly ? cell->is_artificial()
+                                : !cell->is_locally_owned())
+      continue;
+
+    ++n_cells_assembled;
+
+    fe_values.reinit(cell);
+
+    std::fill(cell_matrix.begin(), cell_matrix.end(), 0.0);
+    std::fill(cell_rhs.begin(), cell_rhs.end(), 0.0);
+    std::fill(cell_pressure_mass_matrix.begin(),
+              cell_pressure_mass_matrix.end(),
+              0.0);
+
+    // We need to compute the Jacobian matrix and the residual for current
+    // cell. This requires knowing the value and the gradient of u^{(k)}
+    // (stored inside solution) on the quadrature nodes of the current
+    // cell. This can be accomplished through
+    // FEValues::get_function_values and FEValues::get_function_gradients.
+    fe_values[velocity].get_function_values(solution, velocity_loc);
+    fe_values[velocity].get_function_gradients(solution,
+                                               velocity_gradient_loc);
+    fe_values[pressure].get_function_values(solution, pressure_loc);
+    fe_values[velocity].get_function_values(bdf_history_term,
+                                            velocity_history_loc);
+
+    // In the semi-implicit mode the convection field is the extrapolated
+    // velocity, otherwise it is the current Newton iterate.
+    if (semi_implicit)
+      fe_values[velocity].get_function_values(convection_velocity,
+                                              convection_loc);
+    else
+      convection_loc = velocity_loc;
+
+    // Stabilization parameters of the cell, from the largest convection
+    // velocity on its quadrature nodes and its size h (per degree):
+    //   tau_M = ((2 a_0)^2 + (2 |u| / h)^2 + (4 nu / h^2)^2)^(-1/2),
+    //   tau_C = h |u| / 2,
+    // a_0 being the BDF coefficient of the new solution.
+    double tau_momentum = 0.0;
+    double tau_continuity = 0.0;
+    if (stabilization)
+    {
+      fe_values[pressure].get_function_gradients(solution,
+                                                 pressure_gradient_loc);
+
+      double convection_norm = 0.0;
+      for (unsigned int q = 0; q < n_q; ++q)
+        convection_norm = std::max(convection_norm, convection_loc[q].norm());
+
+      const double h = cell->diameter() / degree_velocity;
+      tau_momentum =
+          1.0 / std::sqrt(std::pow(2.0 * bdf_coefficients[0], 2) +
+                          std::pow(2.0 * convection_norm / h, 2) +
+                          std::pow(4.0 * nu / (h * h), 2));
+      tau_continuity = 0.5 * h * convection_norm;
+    }
+
+    for (unsigned int q = 0; q < n_q; ++q)
+    {
+      const double JxW = fe_values.JxW(q);
+
+      for (unsigned int k = 0; k < dofs_per_cell; ++k)
+      {
+        phi_u[k] = fe_values[velocity].value(k, q);
+        grad_phi_u[k] = fe_values[velocity].gradient(k, q);
+        div_phi_u[k] = fe_values[velocity].divergence(k, q);
+        phi_p[k] = fe_values[pressure].value(k, q);
+      }
+
+      if (stabilization)
+        for (unsigned int k = 0; k < dofs_per_cell; ++k)
+        {
+          grad_phi_p[k] = fe_values[pressure].gradient(k, q);
+          stabilization_test_phi[k] =
+              tau_momentum *
+              (grad_phi_u[k] * convection_loc[q] + grad_phi_p[k]);
+        }
+
+      // BDF approximation of du/dt
+      const Tensor<1, dim> time_derivative =
+          bdf_coefficients[0] * velocity_loc[q] + velocity_history_loc[q];
+
+      if (first_iter)
+      {
+        for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        {
+          // time dependent term (mass matrix)
+          const double time_derivative_i = time_derivative * phi_u[i];
+
+          for (unsigned int j = 0; j < dofs_per_cell; ++j)
+          {
+            // Viscosity term, pressure terms in the momentum and continuity
+            // equations and time dependent term.
+            cell_matrix[i * dofs_per_cell + j] +=
+                (nu * scalar_product(grad_phi_u[i], grad_phi_u[j]) -
+                 div_phi_u[i] * phi_p[j] + time_derivative_i -
+                 div_phi_u[j] * phi_p[i]) *
+                JxW;
+
+            // Pressure mass matrix.
+            cell_pressure_mass_matrix[i * dofs_per_cell + j] +=
+                phi_p[i] * phi_p[j] / nu * JxW;
+          }
+        }
+
+        // PSPG pressure Laplacian, with the sign of the continuity equation
+        // of this symmetric system, and LSIC term.
+        if (stabilization)
+          for (unsigned int i = 0; i < dofs_per_cell; ++i)
+            for (unsigned int j = 0; j < dofs_per_cell; ++j)
+              cell_matrix[i * dofs_per_cell + j] +=
+                  (-tau_momentum * grad_phi_p[i] * grad_phi_p[j] +
+                   tau_continuity * div_phi_u[i] * div_phi_u[j]) *
+                  JxW;
+
+        continue;
+      }
+
+      // compute both terms yielded by the Frechet derivative of the
+      // convective term for each shape function: (u_old . nabla) phi_j, and
+      // (phi_j . nabla) u_old, absent from the Oseen operator of the
+      // semi-implicit mode
+      for (unsigned int j = 0; j < dofs_per_cell; ++j)
+      {
+        convection_phi_u[j] = grad_phi_u[j] * convection_loc[q];
+        if (!semi_implicit)
+          convection_phi_u[j] += velocity_gradient_loc[q] * phi_u[j];
+      }
+
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        for (unsigned int j = 0; j < dofs_per_cell; ++j)
+        {
+          // linearized convective term (u . nabla) uv, time dependent term
+          // a_0 * delta_h * v_h (a_0 being the BDF coefficient of the new
+          // solution, 1 / delta_t for backward Euler), viscosity and the
+          // pressure terms in the momentum and continuity equations
+          cell_matrix[i * dofs_per_cell + j] +=
+              (convection_phi_u[j] * phi_u[i] +
+               bdf_coefficients[0] * phi_u[j] * phi_u[i] +
+               nu * scalar_product(grad_phi_u[j], grad_phi_u[i]) -
+               phi_p[j] * div_phi_u[i] + phi_p[i] * div_phi_u[j]) *
+              JxW;
+
+          // Pressure mass matrix
+          cell_pressure_mass_matrix[i * dofs_per_cell + j] +=
+              phi_p[i] * phi_p[j] / nu * JxW;
+        }
+      }
+
+      //-R(u,v)
+      // (u_old . nabla) u_old, or (u_extrapolated . nabla) u_old
+      const Tensor<1, dim> nonlinear_term =
+          velocity_gradient_loc[q] * convection_loc[q];
+      const double velocity_divergence_loc = trace(velocity_gradient_loc[q]);
+
+      // SUPG, PSPG and LSIC terms: the strong residual of the momentum
+      // equation, du/dt + (u . nabla) u + nabla p (the viscous term vanishes
+      // on linear elements and is neglected on the others), tested with
+      // tau_M ((u . nabla) v + nabla q), and tau_C (div u, div v). The
+      // parameters and the test function are frozen in the Jacobian.
+      if (stabilization)
+      {
+        const Tensor<1, dim> momentum_residual =
+            time_derivative + nonlinear_term + pressure_gradient_loc[q];
+
+        for (unsigned int j = 0; j < dofs_per_cell; ++j)
+          residual_phi[j] = bdf_coefficients[0] * phi_u[j] +
+                            convection_phi_u[j] + grad_phi_p[j];
+
+        for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        {
+          for (unsigned int j = 0; j < dofs_per_cell; ++j)
+            cell_matrix[i * dofs_per_cell + j] +=
+                (stabilization_test_phi[i] * residual_phi[j] +
+                 tau_continuity * div_phi_u[i] * div_phi_u[j]) *
+                JxW;
+
+          cell_rhs[i] -=
+              (stabilization_test_phi[i] * momentum_residual +
+               tau_continuity * div_phi_u[i] * velocity_divergence_loc) *
+              JxW;
+        }
+      }
+
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        // time dependent term, a(u,v), nonlinear convective term, b(v,p) and
+        // b(u,q), the latter with the sign of the corresponding Jacobian term
+        cell_rhs[i] -=
+            (time_derivative * phi_u[i] +
+             nu * scalar_product(velocity_gradient_loc[q], grad_phi_u[i]) +
+             nonlinear_term * phi_u[i] - pressure_loc[q] * div_phi_u[i] +
+             velocity_divergence_loc * phi_p[i]) *
+            JxW;
+      }
+    }
+
+    cell->get_dof_indices(dof_indices);
+
+    if (owner_computes_assembly)
+    {
+      // Only write the rows owned by this process, the other ones are
+      // assembled by their owners.
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        if (!locally_owned_dofs.is_element(dof_indices[i]))
+          continue;
 
-    MatrixTools::apply_boundary_values(
-        boundary_values, jacobian_matrix, delta_owned, residual_vector, false);
+        jacobian_matrix.add(dof_indices[i],
+                            dofs_per_cell,
+                            dof_indices.data(),
+                            &cell_matrix[i * dofs_per_cell]);
+        residual_vector(dof_indices[i]) += cell_rhs[i];
+        pressure_mass.add(dof_indices[i],
+                          dofs_per_cell,
+                          dof_indices.data(),
+                          &cell_pressure_mass_matrix[i * dofs_per_cell]);
+      }
+    }
+    else
+    {
+      cell_matrix_full.fill(cell_matrix.data());
+      cell_pressure_mass_matrix_full.fill(cell_pressure_mass_matrix.data());
+      std::copy(cell_rhs.begin(), cell_rhs.end(), cell_rhs_full.begin());
+
+#ifdef NS_USE_TPETRA
+      jacobian_matrix.add(dof_indices, cell_matrix_full);
+      residual_vector.add(dof_indices, cell_rhs_full);
+      pressure_mass.add(dof_indices, cell_pressure_mass_matrix_full);
+#else
+      // The constraints only act on the hanging nodes of an adaptive mesh.
+      hanging_node_constraints.distribute_local_to_global(cell_matrix_full,
+                                                          cell_rhs_full,
+                                                          dof_indices,
+                                                          jacobian_matrix,
+                                                          residual_vector);
+      hanging_node_constraints.distribute_local_to_global(
+          cell_pressure_mass_matrix_full, dof_indices, pressure_mass);
+#endif
+    }
   }
 }
 
-int NSSolver::solve_system()
+template <int dim>
+int NSSolver<dim>::solve_system()
 {
     SolverControl solver_control(100000, tolerance);
 
+    // Vectors allocated by the preconditioner while applying it, expected to
+    // be zero since its workspace is sized at initialization.
+    unsigned int n_allocations = 0;
+
     // Choose the correct preconditioner
     if (preconditioner_type == 0) {
         PreconditionBlockDiagonal preconditioner;
         preconditioner.initialize(jacobian_matrix.block(0, 0),
-                                      pressure_mass.block(1, 1));
+                                      pressure_mass.block(1, 1),
+                                      solution_owned);
 
         if (solver_type == 0) {
-            SolverGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverGMRES<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
         else if (solver_type == 1) {
-            SolverFGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverFGMRES<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
         else if (solver_type == 2) {
-            SolverBicgstab<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverBicgstab<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
+        n_allocations = preconditioner.n_allocations();
     }
     else if (preconditioner_type == 1) {
         PreconditionBlockTriangular preconditioner;
         preconditioner.initialize(jacobian_matrix.block(0, 0),
                                       pressure_mass.block(1, 1),
-                                      jacobian_matrix.block(1, 0));
+                                      jacobian_matrix.block(1, 0),
+                                      solution_owned);
 
         if (solver_type == 0) {
-            SolverGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverGMRES<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
         else if (solver_type == 1) {
-            SolverFGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverFGMRES<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
         else if (solver_type == 2) {
-            SolverBicgstab<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverBicgstab<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
+        n_allocations = preconditioner.n_allocations();
     }
     else if (preconditioner_type == 2) {
+#ifdef NS_USE_TPETRA
+        throw std::invalid_argument("The aSIMPLE preconditioner is not available with the Tpetra backend.");
+#else
         double alpha = 0.5;
         PreconditionaSIMPLE preconditioner;
         preconditioner.initialize(jacobian_matrix.block(0, 0),
@@ -636,114 +1492,470 @@ int NSSolver::solve_system()
                                       alpha);
 
         if (solver_type == 0) {
-            SolverGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverGMRES<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
         else if (solver_type == 1) {
-            SolverFGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverFGMRES<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
         else if (solver_type == 2) {
-            SolverBicgstab<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+            SolverBicgstab<LA::MPI::BlockVector> solver(solver_control);
             solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
         }
+        n_allocations = preconditioner.n_allocations();
+#endif
     }
     else {
         throw std::invalid_argument("Invalid preconditioner type. Use 0: blockDiagonal, 1: blockTriangular, 2: aSIMPLE.");
     }
     
-    pcout << "   " << solver_control.last_step() << " iterations" << std::endl;
+#ifndef NS_USE_TPETRA
+    // Values of the hanging nodes, from those of their neighbours.
+    hanging_node_constraints.distribute(delta_owned);
+#endif
+
+    pcout << "   " << solver_control.last_step() << " iterations, "
+          << Utilities::MPI::max(n_allocations, mpi_comm)
+          << " preconditioner allocations" << std::endl;
     return solver_control.last_step();
 }
 
-void NSSolver::solve_newton()
+template <int dim>
+void NSSolver<dim>::benchmark_dof_ordering(const unsigned int &n_applications)
 {
   pcout << "===============================================" << std::endl;
+  pcout << "Benchmarking the DoF ordering: "
+        << dof_ordering_to_string(dof_ordering) << std::endl;
+
+  // The ordering matters most for a Jacobian with convection, so the first
+  // system is solved and the tangent system is assembled at its solution.
+  assemble_system(true);
+  solve_system();
+  solution_owned.add(1.0, delta_owned);
+  solution = solution_owned;
+
+  // Warm-up assembly, not timed.
+  assemble_system(false);
+
+  Timer timer;
+  assemble_system(false);
+  timer.stop();
+  const double time_assembly = Utilities::MPI::max(timer.wall_time(), mpi_comm);
+
+  LA::MPI::BlockVector dst(residual_vector);
+  jacobian_matrix.vmult(dst, residual_vector);
+
+  timer.restart();
+  for (unsigned int n = 0; n < n_applications; ++n)
+    jacobian_matrix.vmult(dst, residual_vector);
+  timer.stop();
+  const double time_vmult =
+      Utilities::MPI::max(timer.wall_time(), mpi_comm) / n_applications;
+
+  delta_owned = 0.0;
+  timer.restart();
+  const int n_iterations = solve_system();
+  timer.stop();
+  const double time_solve = Utilities::MPI::max(timer.wall_time(), mpi_comm);
+
+  const double n_nonzero = jacobian_matrix.n_nonzero_elements();
+
+  pcout << "  Nonzero entries            = " << n_nonzero << std::endl;
+  pcout << "  Assembly time              = " << std::scientific
+        << std::setprecision(3) << time_assembly << " s" << std::endl;
+  pcout << "  Time per vmult             = " << time_vmult << " s, "
+        << 2.0 * n_nonzero / time_vmult / 1e9 << " GFlop/s" << std::endl;
+  pcout << "  Linear solve               = " << n_iterations
+        << " iterations, " << time_solve << " s" << std::endl;
+  pcout << "===============================================" << std::endl;
 
-  const unsigned int n_max_iters = 10;
-  const double residual_tolerance = 1e-9;
-  double target_Re = 1/nu;
-  bool first_iter = true;
-  pcout << "Target viscosity: " << nu << std::endl;
+  if (mpi_rank == 0)
+  {
+    std::ofstream file("dof_ordering.csv", std::ios::app);
+    if (file.tellp() == 0)
+      file << "n_processes,ordering,preconditioner,n_dofs,n_nonzero,"
+              "assembly_time,vmult_time,iterations,solve_time\n";
+    file << mpi_size << "," << dof_ordering_to_string(dof_ordering) << ","
+         << preconditioner_type << "," << dof_handler.n_dofs() << ","
+         << n_nonzero << "," << time_assembly << "," << time_vmult << ","
+         << n_iterations << "," << time_solve << "\n";
+  }
+}
+
+template <int dim>
+void NSSolver<dim>::benchmark_preconditioner(const unsigned int &n_applications)
+{
+  pcout << "===============================================" << std::endl;
+  pcout << "Benchmarking the aSIMPLE preconditioner" << std::endl;
+
+#ifdef NS_USE_TPETRA
+  (void)n_applications;
+  throw std::invalid_argument("The aSIMPLE preconditioner is not available with the Tpetra backend.");
+#else
+
+  // The first iteration system is enough to get representative matrices.
+  assemble_system(true);
+
+  const double alpha = 0.5;
+  PreconditionaSIMPLE preconditioner;
+  preconditioner.initialize(jacobian_matrix.block(0, 0),
+                            jacobian_matrix.block(1, 0),
+                            jacobian_matrix.block(0, 1),
+                            solution_owned,
+                            alpha);
+
+  // Warm-up application, not timed.
+  preconditioner.vmult(delta_owned, residual_vector);
+
+  Timer timer;
+  for (unsigned int n = 0; n < n_applications; ++n)
+    preconditioner.vmult(delta_owned, residual_vector);
+  timer.stop();
+
+  const double time_vmult =
+      Utilities::MPI::max(timer.wall_time(), mpi_comm) / n_applications;
+  const double bytes_vmult = preconditioner.memory_traffic();
+
+  pcout << "  Time per vmult             = " << std::scientific
+        << std::setprecision(3) << time_vmult << " s" << std::endl;
+  pcout << "  Memory traffic per vmult   = " << bytes_vmult / 1e6 << " MB"
+        << std::endl;
+  pcout << "  Achieved bandwidth         = " << bytes_vmult / time_vmult / 1e9
+        << " GB/s (" << bytes_vmult / time_vmult / 1e9 / mpi_size
+        << " GB/s per process)" << std::endl;
+
+  // Compare the fused element-wise kernels with the sequence of separate
+  // vector operations they replace. The scaling factor alpha < 1 does not
+  // affect the timings, and keeps the repeatedly updated values bounded.
+  LA::MPI::Vector D_vector(block_owned_dofs[0], mpi_comm);
+  LA::MPI::Vector D_inv_vector(block_owned_dofs[0], mpi_comm);
+  for (unsigned int i : D_vector.locally_owned_elements())
+  {
+    D_vector[i] = jacobian_matrix.block(0, 0).diag_element(i);
+    D_inv_vector[i] = 1.0 / D_vector[i];
+  }
+  LA::MPI::BlockVector x(solution_owned);
+  LA::MPI::BlockVector y(residual_vector);
+
+  timer.restart();
+  for (unsigned int n = 0; n < n_applications; ++n)
+  {
+    // pressure block: copy, add and scale
+    x.block(1) = residual_vector.block(1);
+    x.block(1) += y.block(1);
+    x.block(1) *= alpha;
+
+    // velocity block: scale by D, subtract and scale by D^{-1}
+    x.block(0).scale(D_vector);
+    x.block(0) -= y.block(0);
+    x.block(0).scale(D_inv_vector);
+  }
+  timer.stop();
+  const double time_unfused =
+      Utilities::MPI::max(timer.wall_time(), mpi_comm) / n_applications;
+
+  timer.restart();
+  for (unsigned int n = 0; n < n_applications; ++n)
+  {
+    fused_add_and_scale(x.block(1), y.block(1), alpha);
+    fused_subtract_diagonal_scaled(x.block(0), D_inv_vector, y.block(0));
+  }
+  timer.stop();
+  const double time_fused =
+      Utilities::MPI::max(timer.wall_time(), mpi_comm) / n_applications;
+
+  // bytes moved: the separate operations stream 7 pressure vectors (copy 2,
+  // add 3, scale 2) and 9 velocity vectors (scale 3, subtract 3, scale 3),
+  // the fused kernels 3 and 4
+  const double n_u = x.block(0).size();
+  const double n_p = x.block(1).size();
+  const double bytes_unfused = sizeof(double) * (9.0 * n_u + 7.0 * n_p);
+  const double bytes_fused = sizeof(double) * (4.0 * n_u + 3.0 * n_p);
+
+  pcout << "  Separate vector updates    = " << time_unfused << " s, "
+        << bytes_unfused / time_unfused / 1e9 << " GB/s" << std::endl;
+  pcout << "  Fused vector kernels       = " << time_fused << " s, "
+        << bytes_fused / time_fused / 1e9 << " GB/s" << std::endl;
+  pcout << "  Speedup of fused kernels   = " << std::fixed
+        << std::setprecision(2) << time_unfused / time_fused << std::endl;
+  pcout << "===============================================" << std::endl;
+#endif
+}
+
+template <int dim>
+bool NSSolver<dim>::solve_newton()
+{
+  pcout << "===============================================" << std::endl;
 
-  for (double current_Re = 1.0; current_Re <= target_Re; current_Re += 10.0)
+  const double target_Re = 1.0 / target_nu;
+  bool first_iter = true;
+  pcout << "Target viscosity: " << target_nu << std::endl;
+
+  // Continuation in the Reynolds number, whose last level is the target one.
+  // If Newton's method fails for a Reynolds number, the solution of the last
+  // converged one is restored and the continuation step is halved. nu is the
+  // viscosity of the current level, and is reset to the target one on exit,
+  // so that a failed step does not change the problem of the next ones.
+  double Re_step = 10.0;
+  double last_converged_Re = 0.0;
+  LA::MPI::BlockVector converged_solution(solution_owned);
+  converged_solution = solution;
+
+  double current_Re = std::min(1.0, target_Re);
+  while (true)
   {
     pcout << "===============================================" << std::endl;
     nu = 1.0 / current_Re;
     pcout << "Solving for Re = " << get_reynolds() << std::endl;
 
-    unsigned int n_iter = 0;
-    double residual_norm = residual_tolerance + 1;
-    double prev_residual;
-    int GMRES_iter = 0;
+    const NewtonStatus status = solve_newton_iterations(first_iter);
 
-    while (n_iter < n_max_iters && residual_norm > residual_tolerance)
+    if (status == NewtonStatus::converged)
     {
-      if (first_iter)
-      {
-        first_iter = false;
-        assemble_system(n_iter == 0 ? true : false);
-      }
-      else
-      {
-        assemble_system(false);
-      }
+      last_converged_Re = current_Re;
+      converged_solution = solution;
+      if (current_Re >= target_Re)
+        break;
+      current_Re = std::min(current_Re + Re_step, target_Re);
+      continue;
+    }
 
-      residual_norm = residual_vector.l2_norm();
+    pcout << "Newton's method failed: " << newton_status_to_string(status)
+          << std::endl;
+    ++n_newton_failures;
 
-      prev_residual = n_iter == 0 ? residual_norm + 1 : prev_residual;
+    // Nothing to go back to, or the continuation step cannot be reduced
+    // further: let the caller handle the failure.
+    if (last_converged_Re == 0.0 || Re_step <= 1.0)
+    {
+      nu = target_nu;
+      return false;
+    }
 
-      pcout << "Newton iteration " << n_iter << "/" << n_max_iters
-            << " - ||r|| = " << std::scientific << std::setprecision(6)
-            << residual_norm << std::flush;
+    solution_owned = converged_solution;
+    solution = solution_owned;
+    Re_step = std::max(1.0, 0.5 * Re_step);
+    current_Re = std::min(last_converged_Re + Re_step, target_Re);
+    pcout << "Retrying with continuation step " << Re_step << std::endl;
+  }
 
-      // We actually solve the system only if the residual is larger than the
-      // tolerance.
-      if (residual_norm > residual_tolerance)
-      {
-        GMRES_iter = solve_system();
+  nu = target_nu;
+  pcout << "===============================================" << std::endl;
+  return true;
+}
 
-        if (GMRES_iter == 0)
-          break;
+template <int dim>
+typename NSSolver<dim>::NewtonStatus NSSolver<dim>::solve_newton_iterations(bool &first_iter)
+{
+  const unsigned int n_max_iters = 10;
+  const double residual_tolerance = 1e-9;
 
-        evaluation_point = solution;
+  // Newton's method is considered diverging if the residual grows by this
+  // factor with respect to the first one, and stagnating if it is reduced by
+  // less than stagnation_ratio in n_stagnation_iters consecutive iterations.
+  const double divergence_factor = 1e4;
+  const double stagnation_ratio = 0.95;
+  const unsigned int n_stagnation_iters = 3;
+
+  unsigned int n_iter = 0;
+  double residual_norm = residual_tolerance + 1;
+  double initial_residual = 0.0;
+  double prev_residual;
+  unsigned int n_stagnating = 0;
+  int GMRES_iter = 0;
+
+  while (n_iter < n_max_iters && residual_norm > residual_tolerance)
+  {
+    if (first_iter)
+    {
+      first_iter = false;
+      assemble_system(n_iter == 0 ? true : false);
+    }
+    else
+    {
+      assemble_system(false);
+    }
 
-        // Update the solution
-        for (double alpha = 1; alpha > 1e-12; alpha *= 0.1)
-        {
-          solution_owned = evaluation_point;
-          solution_owned.add(alpha, delta_owned);
-          solution = solution_owned;
+    residual_norm = residual_vector.l2_norm();
 
-          assemble_system(false);
-          residual_norm = residual_vector.l2_norm();
+    if (!std::isfinite(residual_norm))
+      return NewtonStatus::divergence;
 
-          pcout << "  Evaluating alpha=" << alpha << ", ||r||=" << residual_norm << std::endl;
+    prev_residual = n_iter == 0 ? residual_norm + 1 : prev_residual;
+    if (n_iter == 0)
+      initial_residual = residual_norm;
 
-          if (residual_norm <= prev_residual)
-            break;
-        }
+    pcout << "Newton iteration " << n_iter << "/" << n_max_iters
+          << " - ||r|| = " << std::scientific << std::setprecision(6)
+          << residual_norm << std::flush;
 
-        prev_residual = residual_norm;
+    // We actually solve the system only if the residual is larger than the
+    // tolerance.
+    if (residual_norm > residual_tolerance)
+    {
+      try
+      {
+        GMRES_iter = solve_system();
       }
-      else
+      catch (const SolverControl::NoConvergence &)
       {
-        pcout << " < tolerance" << std::endl;
+        pcout << std::endl;
+        return NewtonStatus::linear_solver_failure;
+      }
+
+      if (GMRES_iter == 0)
         break;
+
+      evaluation_point = solution;
+
+      // Update the solution
+      bool decreased = false;
+      for (double alpha = 1; alpha > 1e-12; alpha *= 0.1)
+      {
+        solution_owned = evaluation_point;
+        solution_owned.add(alpha, delta_owned);
+        solution = solution_owned;
+
+        assemble_system(false);
+        residual_norm = residual_vector.l2_norm();
+
+        pcout << "  Evaluating alpha=" << alpha << ", ||r||=" << residual_norm << std::endl;
+
+        if (residual_norm <= prev_residual)
+        {
+          decreased = true;
+          break;
+        }
       }
-      ++n_iter;
+
+      if (!std::isfinite(residual_norm) ||
+          residual_norm > divergence_factor * initial_residual)
+        return NewtonStatus::divergence;
+      if (!decreased)
+        return NewtonStatus::line_search_failure;
+
+      n_stagnating = residual_norm > stagnation_ratio * prev_residual ?
+                         n_stagnating + 1 :
+                         0;
+      if (n_stagnating >= n_stagnation_iters &&
+          residual_norm > residual_tolerance)
+        return NewtonStatus::stagnation;
+
+      prev_residual = residual_norm;
+    }
+    else
+    {
+      pcout << " < tolerance" << std::endl;
+      break;
     }
+    ++n_iter;
+  }
+
+  if (residual_norm > residual_tolerance && n_iter >= n_max_iters)
+    return NewtonStatus::max_iterations;
+
+  return NewtonStatus::converged;
+}
+
+template <int dim>
+std::string NSSolver<dim>::newton_status_to_string(const NewtonStatus &status)
+{
+  switch (status)
+  {
+    case NewtonStatus::converged:
+      return "converged";
+    case NewtonStatus::max_iterations:
+      return "maximum number of iterations reached";
+    case NewtonStatus::stagnation:
+      return "residual stagnating";
+    case NewtonStatus::divergence:
+      return "residual diverging";
+    case NewtonStatus::line_search_failure:
+      return "line search could not reduce the residual";
+    case NewtonStatus::linear_solver_failure:
+      return "linear solver did not converge";
   }
+  return "unknown";
+}
+
+template <int dim>
+void NSSolver<dim>::print_assembly_statistics() const
+{
+  if (n_assemblies == 0)
+    return;
+
+  const double n_cells_total =
+      Utilities::MPI::sum(static_cast<double>(n_cells_assembled), mpi_comm) /
+      n_assemblies;
+  const double n_cells_min =
+      Utilities::MPI::min(static_cast<double>(n_cells_assembled), mpi_comm) /
+      n_assemblies;
+  const double n_cells_max =
+      Utilities::MPI::max(static_cast<double>(n_cells_assembled), mpi_comm) /
+      n_assemblies;
 
   pcout << "===============================================" << std::endl;
+  pcout << "Assembly statistics ("
+        << (owner_computes_assembly ? "owner-computes" : "owned cells")
+        << ")" << std::endl;
+  pcout << "  Number of assemblies       = " << n_assemblies << std::endl;
+  if (n_accepted_steps + n_rejected_steps > 0)
+    pcout << "  Assemblies per time step   = " << std::fixed
+          << std::setprecision(2)
+          << static_cast<double>(n_assemblies) /
+                 (n_accepted_steps + n_rejected_steps)
+          << std::endl;
+  pcout << "  Cells per process          = " << n_cells_min << " min, "
+        << n_cells_max << " max" << std::endl;
+  pcout << "  Duplicated cell work       = " << std::fixed
+        << std::setprecision(2)
+        << 100.0 * (n_cells_total / triangulation().n_global_active_cells() - 1.0)
+        << " %" << std::endl;
+  pcout << "  Cell loop time (max)       = " << std::scientific
+        << std::setprecision(3)
+        << Utilities::MPI::max(time_assembly_cells, mpi_comm) /
+               n_assemblies
+        << " s per assembly" << std::endl;
+  pcout << "  Compress time (max)        = "
+        << Utilities::MPI::max(time_assembly_compress, mpi_comm) /
+               n_assemblies
+        << " s per assembly" << std::endl;
+
+  // Cost of an outlet and of a cylinder face over the whole run, relative to
+  // the one of a cell, to be used as partition weights.
+  const double time_cells =
+      Utilities::MPI::sum(time_assembly_cells - time_assembly_faces, mpi_comm);
+  const double cell_cost =
+      time_cells /
+      Utilities::MPI::sum(static_cast<double>(n_cells_assembled), mpi_comm);
+  const double n_faces =
+      Utilities::MPI::sum(static_cast<double>(n_faces_assembled), mpi_comm);
+  const double n_cylinder_faces =
+      Utilities::MPI::sum(static_cast<double>(n_lift_drag_faces), mpi_comm);
+  const double outlet_cost =
+      n_faces > 0 ? Utilities::MPI::sum(time_assembly_faces, mpi_comm) /
+                        n_faces / cell_cost
+                  : 0.0;
+  const double cylinder_cost =
+      n_cylinder_faces > 0
+          ? Utilities::MPI::sum(time_lift_drag, mpi_comm) / n_cylinder_faces *
+                n_lift_drag_evaluations / (cell_cost * n_assemblies)
+          : 0.0;
+  pcout << "  Face / cell cost           = " << std::fixed
+        << std::setprecision(4) << outlet_cost << " outlet, " << cylinder_cost
+        << " cylinder (partition weights for -W)" << std::endl;
+  pcout << "===============================================" << std::endl;
 }
 
-double NSSolver::get_reynolds() const
+template <int dim>
+double NSSolver<dim>::get_reynolds() const
 {
-  return get_avg_inlet_velocity() * 0.1 / nu;
+  return get_avg_inlet_velocity() * cylinder_diameter / nu;
 }
 
-void NSSolver::output(const unsigned int &time_step) const
+template <int dim>
+void NSSolver<dim>::output(const unsigned int &time_step) const
 {
   pcout << "===============================================" << std::endl;
 
@@ -754,74 +1966,475 @@ void NSSolver::output(const unsigned int &time_step) const
           dim, DataComponentInterpretation::component_is_part_of_vector);
   data_component_interpretation.push_back(
       DataComponentInterpretation::component_is_scalar);
-  std::vector<std::string> names = {"velocity",
-                                    "velocity",
-                                    "pressure"};
+  std::vector<std::string> names(dim, "velocity");
+  names.push_back("pressure");
 
   data_out.add_data_vector(dof_handler,
                            solution,
                            names,
                            data_component_interpretation);
 
-  std::vector<unsigned int> partition_int(mesh.n_active_cells());
-  GridTools::get_subdomain_association(mesh, partition_int);
+  std::vector<unsigned int> partition_int(triangulation().n_active_cells());
+  GridTools::get_subdomain_association(triangulation(), partition_int);
   const Vector<double> partitioning(partition_int.begin(), partition_int.end());
   data_out.add_data_vector(partitioning, "partitioning");
 
-  data_out.build_patches();
+  data_out.build_patches(*mapping);
 
   const std::string output_file_name = "output-stokes";
   data_out.write_vtu_with_pvtu_record("./",
                                       "output",
                                       time_step,
-                                      MPI_COMM_WORLD,
+                                      mpi_comm,
                                       3);
 
   pcout << "Output written to " << output_file_name << std::endl;
   pcout << "===============================================" << std::endl;
 }
 
-void NSSolver::solve()
+template <int dim>
+void NSSolver<dim>::solve()
 {
   pcout << "===============================================" << std::endl;
 
-  time = 0.0;
+  if (!restart_file_name.empty())
+  {
+    // Resume from the state stored in the checkpoint.
+    load_checkpoint(restart_file_name);
+  }
+  else
+  {
+    time = 0.0;
+    time_step_number = 0;
+
+    // Apply the initial condition.
+    {
+      if (!initial_condition_file_name.empty())
+        load_initial_condition();
+
+      // Output the initial solution.
+      output(0);
+      pcout << "-----------------------------------------------" << std::endl;
+    }
+
+    // Store the initial solution, so that it is available for assembly.
+    solution_old = solution;
+    solution_history.clear();
+    delta_t_history.clear();
+  }
 
-  // Apply the initial condition.
+  time_loop(true);
+
+  if (adaptive_time_stepping)
   {
-    // Output the initial solution.
-    output(0);
-    pcout << "-----------------------------------------------" << std::endl;
+    pcout << "===============================================" << std::endl;
+    pcout << "Time stepping statistics" << std::endl;
+    pcout << "  Accepted steps = " << n_accepted_steps << std::endl;
+    pcout << "  Rejected steps = " << n_rejected_steps << std::endl;
   }
 
-  unsigned int time_step = 0;
+  if (n_newton_failures > 0)
+    pcout << "Newton failures: " << n_newton_failures << std::endl;
+
+  print_assembly_statistics();
+}
+
+template <int dim>
+void NSSolver<dim>::advance(const double &t_start, const double &t_end)
+{
+  time = t_start;
+  T = t_end;
+  time_step_number = 0;
+
+  solution_old = solution;
+  solution_history.clear();
+  delta_t_history.clear();
+
+  time_loop(false);
+}
+
+template <int dim>
+void NSSolver<dim>::set_solution(const LA::MPI::BlockVector &solution_,
+                            const bool &apply_inlet)
+{
+  solution_owned = solution_;
+  solution = solution_owned;
+  apply_first = apply_inlet;
+}
 
-  while (time < T - 0.5 * delta_t)
+template <int dim>
+void NSSolver<dim>::time_loop(const bool &postprocess)
+{
+  while (adaptive_time_stepping ? time < T * (1.0 - 1e-10)
+                                : time < T - 0.5 * delta_t)
   {
-    time += delta_t;
-    ++time_step;
+    // With a variable time step, make sure the final time is hit exactly.
+    if (adaptive_time_stepping && time + delta_t > T)
+      delta_t = T - time;
 
-    // Store the old solution, so that it is available for assembly.
-    solution_old = solution;
+    time += delta_t;
+    ++time_step_number;
+    update_time_derivative();
 
-    pcout << "n = " << std::setw(3) << time_step << ", t = " << std::setw(5)
-          << std::fixed << time << std::endl;
+    pcout << "n = " << std::setw(3) << time_step_number << ", t = " << std::setw(5)
+          << std::fixed << time << ", dt = " << std::scientific
+          << std::setprecision(3) << delta_t << ", BDF"
+          << current_bdf_order << std::endl;
 
     // At every time step, we invoke Newton's method to solve the non-linear
-    // problem.
-    solve_newton();
+    // problem, or a single linearized solve in the semi-implicit mode.
+    bool converged = true;
+    if (projection_scheme)
+      solve_projection_step();
+    else if (semi_implicit)
+      solve_semi_implicit();
+    else
+      converged = solve_newton();
+
+    // If Newton's method failed, go back to the last converged solution and
+    // retry with a smaller time step, instead of continuing from an
+    // unconverged state.
+    if (!converged)
+    {
+      ++n_failed_steps;
+      time -= delta_t;
+      --time_step_number;
+      solution = solution_old;
+      solution_owned = solution_old;
+
+      AssertThrow(n_failed_steps <= n_max_failed_steps &&
+                      0.5 * delta_t >= delta_t_min_failure,
+                  ExcMessage("Newton's method failed to converge even after "
+                             "reducing the time step, giving up."));
+
+      delta_t *= 0.5;
+      pcout << "Step failed, retrying with dt = " << std::scientific
+            << std::setprecision(3) << delta_t << std::endl
+            << std::endl;
+      continue;
+    }
+    n_failed_steps = 0;
     apply_first = false;
 
-    output(time_step);
-    compute_lift_drag();
-    print_lift_coeff();
-    print_drag_coeff();
+    // Estimate the local error of the step, as soon as enough previous
+    // solutions are available for the predictor.
+    double time_error = 0.0;
+    if (adaptive_time_stepping &&
+        solution_history.size() >= current_bdf_order)
+    {
+      time_error = estimate_time_error();
+      pcout << "Time error estimate: " << std::scientific
+            << std::setprecision(3) << time_error << std::endl;
+
+      if (time_error > time_step_tolerance && delta_t > delta_t_min)
+      {
+        // Reject the step: go back to the previous solution and retry with
+        // a smaller time step.
+        ++n_rejected_steps;
+        time -= delta_t;
+        --time_step_number;
+        solution = solution_old;
+        solution_owned = solution_old;
+
+        delta_t = compute_rejected_time_step(time_error);
+        pcout << "Step rejected, retrying with dt = " << delta_t << std::endl
+              << std::endl;
+        continue;
+      }
+    }
+    ++n_accepted_steps;
+
+    if (postprocess)
+    {
+      output(time_step_number);
+      compute_lift_drag();
+      print_lift_coeff();
+      print_drag_coeff();
+      print_time_step(time_step_number, time_error);
+    }
+
+    // Check whether the shedding has become periodic, each time a cycle of
+    // the lift coefficient is completed.
+    bool stop = false;
+    if (postprocess && detect_periodicity &&
+        periodicity_monitor.add_sample(time, lift_coeff, drag_coeff))
+    {
+      pcout << "Shedding cycle " << periodicity_monitor.n_completed_cycles()
+            << " completed" << std::endl;
+      if (!periodic && periodicity_monitor.is_periodic())
+      {
+        periodic = true;
+        print_periodicity();
+        stop = stop_when_periodic;
+      }
+    }
+
+    // Shift the solution history, keeping the solutions needed by the BDF
+    // formula and, with adaptive time stepping, by the error predictor.
+    const unsigned int n_history =
+        std::max(adaptive_time_stepping ? bdf_order : bdf_order - 1,
+                 (semi_implicit || projection_scheme) ? 1u : 0u);
+    if (n_history > 0)
+    {
+      solution_history.push_front(solution_old);
+      delta_t_history.push_front(delta_t);
+      if (solution_history.size() > n_history)
+      {
+        solution_history.pop_back();
+        delta_t_history.pop_back();
+      }
+    }
+    solution_old = solution;
+
+    // Choose the next time step.
+    if (adaptive_time_stepping && time_error > 0.0)
+    {
+      delta_t = compute_next_time_step(time_error);
+      time_error_old = time_error;
+    }
+    // Without adaptivity, recover the requested time step after a failure.
+    else if (!adaptive_time_stepping && delta_t < delta_t_requested)
+    {
+      delta_t = std::min(2.0 * delta_t, delta_t_requested);
+    }
+
+    // Adapt the mesh to the current solution, every refinement_interval
+    // time steps.
+    if (adaptive_refinement && time_step_number % refinement_interval == 0)
+      refine_mesh();
+
+    // Periodic checkpoint of the state, to restart the run.
+    if (postprocess && checkpoint_interval > 0 &&
+        time_step_number % checkpoint_interval == 0)
+      save_checkpoint("checkpoint.bin");
 
     pcout << std::endl;
+
+    if (stop)
+    {
+      pcout << "Periodic regime reached at t = " << std::fixed << time
+            << ", stopping the run" << std::endl;
+      break;
+    }
+  }
+}
+
+template <int dim>
+void NSSolver<dim>::print_periodicity() const
+{
+  const PeriodicityMonitor::Cycle average = periodicity_monitor.get_average();
+
+  // St = f D / U_avg, D = 0.1 being the diameter of the cylinder
+  const double strouhal =
+      cylinder_diameter / (average.period * get_avg_inlet_velocity());
+
+  pcout << "===============================================" << std::endl;
+  pcout << "Periodic regime reached at t = " << std::fixed
+        << std::setprecision(5) << time << std::endl;
+  pcout << "  Period         = " << average.period << std::endl;
+  pcout << "  Strouhal       = " << strouhal << std::endl;
+  pcout << "  Lift max / min = " << average.lift_max << " / "
+        << average.lift_min << std::endl;
+  pcout << "  Drag max / min = " << average.drag_max << " / "
+        << average.drag_min << std::endl;
+  pcout << "  Drag mean      = " << average.drag_mean << std::endl;
+  pcout << "===============================================" << std::endl;
+
+  // only the rank 0 process writes to the file
+  if (mpi_rank != 0)
+    return;
+  std::ofstream file("periodicity.csv", std::ios::app);
+  // Write the header only if the file is empty
+  if (file.tellp() == 0) {
+      file << "time,period,strouhal,lift_max,lift_min,drag_max,drag_min,drag_mean\n";
+  }
+  file << time << "," << average.period << "," << strouhal << ","
+       << average.lift_max << "," << average.lift_min << ","
+       << average.drag_max << "," << average.drag_min << ","
+       << average.drag_mean << "\n";
+  file.close();
+}
+
+template <int dim>
+void NSSolver<dim>::update_time_derivative()
+{
+  // Use the highest order allowed by the available solutions, so that the
+  // first steps are taken with backward Euler and BDF2.
+  current_bdf_order =
+      std::min<unsigned int>(bdf_order, 1 + solution_history.size());
+
+  // The coefficients are the derivatives at t_{n+1} of the Lagrange basis on
+  // the nodes t_{n+1}, t_n, ..., t_{n+1-p}, which also holds for a variable
+  // time step. tau[k] = t_{n+1-k} - t_{n+1}.
+  const unsigned int p = current_bdf_order;
+  std::vector<double> tau(p + 1, 0.0);
+  tau[1] = -delta_t;
+  for (unsigned int k = 2; k <= p; ++k)
+    tau[k] = tau[k - 1] - delta_t_history[k - 2];
+
+  bdf_coefficients.assign(p + 1, 0.0);
+  for (unsigned int k = 1; k <= p; ++k)
+  {
+    bdf_coefficients[0] -= 1.0 / tau[k];
+
+    double c = 1.0 / tau[k];
+    for (unsigned int m = 1; m <= p; ++m)
+      if (m != k)
+        c *= -tau[m] / (tau[k] - tau[m]);
+    bdf_coefficients[k] = c;
+  }
+
+  // bdf_history_term = sum_{k>=1} a_k * u_{n+1-k}
+  LA::MPI::BlockVector history_term(block_owned_dofs, mpi_comm);
+  LA::MPI::BlockVector tmp(block_owned_dofs, mpi_comm);
+  tmp = solution_old;
+  history_term.add(bdf_coefficients[1], tmp);
+  for (unsigned int k = 2; k <= p; ++k)
+  {
+    tmp = solution_history[k - 2];
+    history_term.add(bdf_coefficients[k], tmp);
+  }
+  bdf_history_term = history_term;
+
+  // Convection field of the semi-implicit mode and of the pressure-correction
+  // scheme, the linear extrapolation u_n + dt_n / dt_{n-1} * (u_n - u_{n-1})
+  // of the last two solutions (the last solution alone in the first step).
+  if (semi_implicit || projection_scheme)
+  {
+    LA::MPI::BlockVector extrapolation(block_owned_dofs, mpi_comm);
+    extrapolation = solution_old;
+    if (!solution_history.empty())
+    {
+      const double ratio = delta_t / delta_t_history.front();
+      tmp = solution_history.front();
+      extrapolation.sadd(1.0 + ratio, -ratio, tmp);
+    }
+    convection_velocity = extrapolation;
+  }
+}
+
+template <int dim>
+void NSSolver<dim>::solve_semi_implicit()
+{
+  pcout << "===============================================" << std::endl;
+
+  // The Oseen problem is linear: a single update, starting from the last
+  // solution, solves it exactly.
+  assemble_system(false);
+
+  pcout << "Semi-implicit step - ||r|| = " << std::scientific
+        << std::setprecision(6) << residual_vector.l2_norm() << std::flush;
+
+  solve_system();
+
+  solution_owned = solution;
+  solution_owned.add(1.0, delta_owned);
+  solution = solution_owned;
+
+  pcout << "===============================================" << std::endl;
+}
+
+template <int dim>
+double NSSolver<dim>::estimate_time_error() const
+{
+  // The solution of the BDF step of order p is compared with the polynomial
+  // extrapolation of the previous p + 1 solutions, which has a local error of
+  // the same order. Milne's device then estimates the local error of the step
+  // as C / (1 + C) times their difference, C being the error constant of the
+  // BDF formula. Only the velocity is considered, since the pressure is not a
+  // differential variable.
+  const unsigned int p = current_bdf_order;
+  const std::array<double, 3> error_constants = {{1.0 / 2.0, 2.0 / 9.0, 3.0 / 22.0}};
+  const double C = error_constants[p - 1];
+
+  // extrapolation weights at t_{n+1} on the nodes t_n, ..., t_{n-p}
+  std::vector<double> tau(p + 2, 0.0);
+  tau[1] = -delta_t;
+  for (unsigned int k = 2; k <= p + 1; ++k)
+    tau[k] = tau[k - 1] - delta_t_history[k - 2];
+
+  std::vector<double> weights(p + 2, 1.0);
+  for (unsigned int k = 1; k <= p + 1; ++k)
+    for (unsigned int m = 1; m <= p + 1; ++m)
+      if (m != k)
+        weights[k] *= -tau[m] / (tau[k] - tau[m]);
+
+  LA::MPI::Vector velocity(block_owned_dofs[0], mpi_comm);
+  LA::MPI::Vector error(block_owned_dofs[0], mpi_comm);
+  LA::MPI::Vector velocity_older(block_owned_dofs[0], mpi_comm);
+  velocity = solution.block(0);
+
+  // error = -u_pred
+  error = solution_old.block(0);
+  error *= -weights[1];
+  for (unsigned int k = 2; k <= p + 1; ++k)
+  {
+    velocity_older = solution_history[k - 2].block(0);
+    error.add(-weights[k], velocity_older);
+  }
+
+  // error = C / (1 + C) * (velocity - u_pred)
+  error += velocity;
+  error *= C / (1.0 + C);
+
+  // relative to the size of the solution
+  return error.l2_norm() / std::max(velocity.l2_norm(), 1e-12);
+}
+
+template <int dim>
+double NSSolver<dim>::compute_next_time_step(const double &time_error) const
+{
+  // PI controller: the integral part drives the error towards the
+  // tolerance, the proportional part damps the oscillations of the step size.
+  // The exponents are scaled by the order of the error estimate, p + 1 for a
+  // BDF scheme of order p.
+  const double k = current_bdf_order + 1.0;
+  const double safety = 0.9;
+  const double error = std::max(time_error, 1e-14);
+
+  double factor = safety * std::pow(time_step_tolerance / error, 0.3 / k);
+  if (time_error_old > 0.0)
+    factor *= std::pow(time_error_old / error, 0.4 / k);
+
+  // limit the growth and the reduction of the time step
+  factor = std::clamp(factor, 0.2, 5.0);
+
+  return std::clamp(delta_t * factor, delta_t_min, delta_t_max);
+}
+
+template <int dim>
+double NSSolver<dim>::compute_rejected_time_step(const double &time_error) const
+{
+  const double k = current_bdf_order + 1.0;
+  const double safety = 0.9;
+  const double factor =
+      std::max(0.2, safety * std::pow(time_step_tolerance / time_error, 1.0 / k));
+
+  return std::max(delta_t * factor, delta_t_min);
+}
+
+template <int dim>
+void NSSolver<dim>::print_time_step(const unsigned int &time_step,
+                               const double &time_error) const
+{
+  if (!adaptive_time_stepping)
+    return;
+  // only the rank 0 process writes to the file
+  if (mpi_rank != 0)
+    return;
+  // open the file in append mode
+  std::ofstream file("time_steps.csv", std::ios::app);
+  // Write the header only if the file is empty
+  if (file.tellp() == 0) {
+      file << "index,time,dt,error,rejected\n";
   }
+  file << time_step << "," << time << "," << delta_t << "," << time_error
+       << "," << n_rejected_steps << "\n";
+  file.close();
 }
 
-void NSSolver::compute_lift_drag()
+template <int dim>
+void NSSolver<dim>::compute_lift_drag()
 {
   pcout << "===============================================" << std::endl;
   pcout << "Computing lift and drag forces" << std::endl;
@@ -833,162 +2446,164 @@ void NSSolver::compute_lift_drag()
   const unsigned int dofs_per_cell = fe->dofs_per_cell;
   const unsigned int n_q_face = quadrature_face->size();
 
-  // need to iterate over all the cells corresponding to the cylindrical obstacle in order to compute the forces
-  FEFaceValues<dim> fe_face_values(*fe,
-                                   *quadrature_face,
-                                   update_values | update_quadrature_points | update_gradients | update_normal_vectors |
-                                       update_JxW_values);
-
-  FEValuesExtractors::Vector velocity(0);
-  FEValuesExtractors::Scalar pressure(dim);
-
-  std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+  // values of the solution on the DoFs of the current cell
+  std::vector<double> solution_loc(dofs_per_cell);
 
-  // We use the following vectors to store the old solution (i.e. at previous Newton
-  // iteration) and its gradient on quadrature nodes of the current cell.
-  std::vector<Tensor<1, dim>> velocity_loc(n_q_face);
-  std::vector<Tensor<2, dim>> velocity_gradient_loc(n_q_face);
-  std::vector<double> pressure_loc(n_q_face);
+  // velocity gradient and pressure on the current quadrature node
+  Tensor<2, dim> velocity_gradient_loc;
+  double pressure_loc;
 
   // declare viscous stress tensor and force tensor
   Tensor<2, dim> viscous_stress;
   Tensor<1, dim> force;
 
+  ++n_lift_drag_evaluations;
+  Timer timer;
 
-  for (const auto &cell : dof_handler.active_cell_iterators())
+  // iterate over the faces of the cylindrical obstacle, cached in setup(),
+  // in order to compute the forces
+  for (const auto &face : boundary_faces[cylinder_boundary_id])
   {
-    if (!cell->is_locally_owned())
+    if (!face.locally_owned)
       continue;
 
-    for (unsigned int f = 0; f < cell->n_faces(); ++f)
-    {
-      if (cell->face(f)->at_boundary() &&
-          cell->face(f)->boundary_id() == 10)
-      {
-        pcout << "Debug " << std::endl;
-        fe_face_values.reinit(cell, f);
+    ++n_lift_drag_faces;
 
-        fe_face_values[velocity].get_function_values(solution, velocity_loc);
+    solution.extract_subvector_to(face.dof_indices.begin(),
+                                  face.dof_indices.end(),
+                                  solution_loc.begin());
 
-        fe_face_values[velocity].get_function_gradients(solution, velocity_gradient_loc);
+    for (unsigned int q = 0; q < n_q_face; ++q)
+    {
+      velocity_gradient_loc = 0.0;
+      pressure_loc = 0.0;
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        velocity_gradient_loc +=
+            solution_loc[i] * face.velocity_gradients[q * dofs_per_cell + i];
+        pressure_loc +=
+            solution_loc[i] * face.pressure_values[q * dofs_per_cell + i];
+      }
 
-        fe_face_values[pressure].get_function_values(solution, pressure_loc);
+      // Get the normal vector to the cylinder surface
+      // note that the normal vector is pointing in the opposite direction with
+      // respect to the one in the provided formulae
+      const Tensor<1, dim> &negative_normal_vector = face.normals[q];
 
-        for (unsigned int q = 0; q < n_q_face; ++q)
+      // Calculate the viscous stress tensor (which is coplanar with the cylinder cross section)
+      // it is the component of the force vector parallel to the cylinder cross section
+      // viscous stress = nu * (grad u + grad u^T) - p * I
+      viscous_stress = velocity_gradient_loc;
+      for (unsigned int i = 0; i < dim; i++)
+      {
+        for (unsigned int j = 0; j < dim; j++)
         {
-          // Get the normal vector to the cylinder surface
-          // note that the normal vector is pointing in the opposite direction with
-          // respect to the one in the provided formulae
-          const Tensor<1, dim> &negative_normal_vector = fe_face_values.normal_vector(q);
-
-          // Calculate the viscous stress tensor (which is coplanar with the cylinder cross section)
-          // it is the component of the force vector parallel to the cylinder cross section
-          // viscous stress = nu * (grad u + grad u^T) - p * I
-          viscous_stress = velocity_gradient_loc[q];
-          for (unsigned int i = 0; i < dim; i++)
-          {
-            for (unsigned int j = 0; j < dim; j++)
-            {
-              // sum the transpose of the velocity gradient tensor
-              viscous_stress[i][j] += velocity_gradient_loc[q][j][i];
-            }
-          }
-          viscous_stress *= nu;
-          for (unsigned int i = 0; i < dim; i++)
-          {
-            viscous_stress[i][i] -= pressure_loc[q];
-          }
-
-          // compute the force vector acting on the cylinder along both spatial directions
-          // also invert the sign of the normal vector
-          force = -viscous_stress * negative_normal_vector *
-                  fe_face_values.JxW(q);
-
-          // Update drag and lift forces
-          // drag force is the component of the force vector parallel to the flow direction
-          local_drag_force += force[0];
-          // lift force is the component of the force vector perpendicular to the flow direction
-          local_lift_force += force[1];
+          // sum the transpose of the velocity gradient tensor
+          viscous_stress[i][j] += velocity_gradient_loc[j][i];
         }
       }
+      viscous_stress *= nu;
+      for (unsigned int i = 0; i < dim; i++)
+      {
+        viscous_stress[i][i] -= pressure_loc;
+      }
+
+      // compute the force vector acting on the cylinder along both spatial directions
+      // also invert the sign of the normal vector
+      force = -viscous_stress * negative_normal_vector * face.JxW[q];
+
+      // Update drag and lift forces
+      // drag force is the component of the force vector parallel to the flow direction
+      local_drag_force += force[0];
+      // lift force is the component of the force vector perpendicular to the flow direction
+      local_lift_force += force[1];
     }
   }
 
+  timer.stop();
+  time_lift_drag += timer.wall_time();
+
   // Sum all the forces contributions that have been computed by each process in parallel
-  lift_force = Utilities::MPI::sum(local_lift_force, MPI_COMM_WORLD);
-  drag_force = Utilities::MPI::sum(local_drag_force, MPI_COMM_WORLD);
+  lift_force = Utilities::MPI::sum(local_lift_force, mpi_comm);
+  drag_force = Utilities::MPI::sum(local_drag_force, mpi_comm);
 
   pcout << "Lift force: " << lift_force << std::endl;
   pcout << "Drag force: " << drag_force << std::endl;
 }
 
-double NSSolver::get_avg_inlet_velocity() const
+template <int dim>
+double NSSolver<dim>::get_avg_inlet_velocity() const
 {
-  // U_avg = 2 * U(0, H/2) / 3
-  return 2 * inlet_velocity.value(Point<dim>(0, 0.41 / 2.0)) / 3;
+  // U_avg = 2 * U(0, H/2) / 3 in 2D, 4 * U(0, H/2, H/2) / 9 in 3D
+  Point<dim> center_of_inlet;
+  for (unsigned int d = 1; d < dim; ++d)
+    center_of_inlet[d] = inlet_velocity.H / 2.0;
+  return (dim == 2 ? 2.0 / 3.0 : 4.0 / 9.0) *
+         inlet_velocity.value(center_of_inlet);
 }
 
-void NSSolver::compute_lift_coeff()
+template <int dim>
+void NSSolver<dim>::compute_lift_coeff()
 {
   const double U_avg = get_avg_inlet_velocity();
-  // lift coefficient = 2 * lift_force / (U_avg * U_avg * D)
-  // where D is the diameter of the cylinder
-  lift_coeff = 2 * lift_force / (U_avg * U_avg * 0.1);
+  // lift coefficient = 2 * lift_force / (U_avg * U_avg * D), where D is the
+  // diameter of the cylinder (times the height of the channel in 3D)
+  lift_coeff = 2 * lift_force / (U_avg * U_avg * reference_area);
 }
 
-void NSSolver::compute_drag_coeff()
+template <int dim>
+void NSSolver<dim>::compute_drag_coeff()
 {
   const double U_avg = get_avg_inlet_velocity();
-  // drag coefficient = 2 * drag_force / (U_avg * U_avg * D)
-  // where D is the diameter of the cylinder
-  drag_coeff = 2 * drag_force / (U_avg * U_avg * 0.1);
+  // drag coefficient = 2 * drag_force / (U_avg * U_avg * D), where D is the
+  // diameter of the cylinder (times the height of the channel in 3D)
+  drag_coeff = 2 * drag_force / (U_avg * U_avg * reference_area);
 }
 
-void NSSolver::print_lift_coeff()
+template <int dim>
+void NSSolver<dim>::print_lift_coeff()
 {
   pcout << "===============================================" << std::endl;
   compute_lift_coeff();
   pcout << "Lift coefficient: " << lift_coeff << std::endl;
   // only the rank 0 process writes to the file
-  if (Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) != 0)
+  if (mpi_rank != 0)
     return;
-  // Persistent index across function calls
-  static int index = 1; 
   // open the file in append mode
   std::ofstream file("lift_coefficients.csv", std::ios::app);
   // Write the header only if the file is empty
   if (file.tellp() == 0) {
       file << "index,lift\n";
   }
-  file << index << "," << lift_coeff << "\n";
+  file << lift_index << "," << lift_coeff << "\n";
   // Increment index for the next time step
-  index++;
+  lift_index++;
   file.close();
 }
 
-void NSSolver::print_drag_coeff()
+template <int dim>
+void NSSolver<dim>::print_drag_coeff()
 {
   pcout << "===============================================" << std::endl;
   compute_drag_coeff();
   pcout << "Drag coefficient: " << drag_coeff << std::endl;
   // only the rank 0 process writes to the file
-  if (Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) != 0)
+  if (mpi_rank != 0)
     return;
-  // Persistent index across function calls
-  static int index_drag = 1;
   // Open the file in append mode
   std::ofstream file("drag_coefficients.csv", std::ios::app);
   // Write the header only if the file is empty
   if (file.tellp() == 0) {
       file << "index,drag\n";
   }
-  file << index_drag << "," << drag_coeff << "\n";
+  file << drag_index << "," << drag_coeff << "\n";
   // Increment index for the next time step
-  index_drag++;
+  drag_index++;
   file.close();
 }
 
-void NSSolver::write_lift_drag_to_file() const
+template <int dim>
+void NSSolver<dim>::write_lift_drag_to_file() const
 {
   // get Reynolds number, which is part of the file name
   double reynolds_number = get_reynolds();
@@ -1030,4 +2645,7 @@ void NSSolver::write_lift_drag_to_file() const
   {
     std::cerr << "Failed to open the file: " << lift_filename << std::endl;
   }
-}
\ No newline at end of file
+}
+
+template class NSSolver<2>;
+template class NSSolver<3>;
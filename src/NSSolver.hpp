@@ -3,8 +3,11 @@
 
 #include <deal.II/base/conditional_ostream.h>
 #include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/base/utilities.h>
 
 #include <deal.II/distributed/fully_distributed_tria.h>
+#include <deal.II/distributed/tria.h>
 
 #include <deal.II/dofs/dof_handler.h>
 #include <deal.II/dofs/dof_renumbering.h>
@@ -16,6 +19,7 @@
 #include <deal.II/fe/fe_values.h>
 #include <deal.II/fe/fe_values_extractors.h>
 #include <deal.II/fe/mapping_fe.h>
+#include <deal.II/fe/mapping_q.h>
 
 #include <deal.II/grid/grid_in.h>
 #include <deal.II/grid/grid_out.h>
@@ -24,32 +28,83 @@
 #include <deal.II/grid/grid_refinement.h>
 #include <deal.II/numerics/data_out.h>
 
+#include <deal.II/lac/affine_constraints.h>
 #include <deal.II/lac/petsc_solver.h>
 #include <deal.II/lac/solver_cg.h>
 #include <deal.II/lac/solver_gmres.h>
 #include <deal.II/lac/solver_bicgstab.h>
-#include <deal.II/lac/trilinos_block_sparse_matrix.h>
-#include <deal.II/lac/trilinos_parallel_block_vector.h>
-#include <deal.II/lac/trilinos_precondition.h>
-#include <deal.II/lac/trilinos_sparse_matrix.h>
 
 #include <deal.II/numerics/data_out.h>
 #include <deal.II/numerics/matrix_tools.h>
 #include <deal.II/numerics/vector_tools.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <type_traits>
+
+#include "CylinderMesh.hpp"
+#include "LinearAlgebra.hpp"
+#include "PeriodicityMonitor.hpp"
+#include "PooledVectorMemory.hpp"
+#include "VectorKernels.hpp"
 
 using namespace dealii;
 
-// Class representing the non-linear diffusion problem.
+// Ordering of the DoFs within the velocity and pressure blocks:
+//   - none: the order of distribute_dofs;
+//   - cuthill_mckee: reverse Cuthill-McKee on the couplings of the DoFs,
+//     which reduces the bandwidth of the matrix;
+//   - hilbert: along a Hilbert curve through the support points, which
+//     keeps the DoFs of neighbouring cells close in memory;
+//   - downstream: along the flow direction, so that an ILU factorization
+//     of a convection-dominated block is close to a Gauss-Seidel sweep
+//     following the flow.
+enum class DoFOrdering
+{
+  none,
+  cuthill_mckee,
+  hilbert,
+  downstream
+};
+
+DoFOrdering
+dof_ordering_from_string(const std::string &name);
+
+std::string
+dof_ordering_to_string(const DoFOrdering &ordering);
+
+// Use of the mesh cache in the setup:
+//   - none: the cache is disabled;
+//   - cold: the mesh and the DoFs are built and written to the cache;
+//   - warm: they are read from the cache.
+enum class MeshCacheStatus
+{
+  none,
+  cold,
+  warm
+};
+
+std::string
+mesh_cache_status_to_string(const MeshCacheStatus &status);
+
+// Class representing the non-linear diffusion problem, in 2D (the 2D-2
+// benchmark) or 3D (the 3D-2Z benchmark, in a channel of square section).
+// It is explicitly instantiated for dim = 2 and 3 in NSSolver.cpp, and the
+// member functions defined in the other NSSolver*.cpp files are explicitly
+// instantiated in each of them; see dispatch_dimension() to select the
+// dimension at run time.
+template <int dim>
 class NSSolver
 {
 public:
-  // Physical dimension (1D, 2D, 3D)
-  static constexpr unsigned int dim = 2;
-
-  // Function for inlet velocity. This actually returns an object with three
+  // Function for inlet velocity. This actually returns an object with dim + 1
   // components (one for each velocity component, and one for the pressure), but
   // then only the first one is really used (we have an inlent only along the x
   // axis). If we only return one component, however, we may get an error
@@ -67,9 +122,8 @@ public:
     vector_value(const Point<dim> &p,
                  Vector<double> &values) const override
     {
-      // in flow condition is: 4 * U_m * (H - y) / H^2
-      values[0] = 4 * U_m * p[1] * (H - p[1]) / (H * H);
-      // values[0] = 4 * U_m * p[1] * (H - p[1]) * sin(M_PI * get_time() / 8) / (H * H);
+      values[0] = profile(p);
+      // values[0] = profile(p) * sin(M_PI * get_time() / 8);
 
       for (unsigned int i = 1; i < dim + 1; ++i)
         values[i] = 0.0;
@@ -80,11 +134,23 @@ public:
           const unsigned int component = 0) const override
     {
       if (component == 0)
-        return 4 * U_m * p[1] * (H - p[1]) / (H * H);
-      // return 4 * U_m * p[1] * (H - p[1]) * sin(M_PI * get_time() / 8) / (H * H);
+        return profile(p);
+      // return profile(p) * sin(M_PI * get_time() / 8);
       else
         return 0.0;
     }
+
+    // in flow condition is: 4 * U_m * y * (H - y) / H^2 in 2D, and
+    // 16 * U_m * y * z * (H - y) * (H - z) / H^4 in 3D
+    double
+    profile(const Point<dim> &p) const
+    {
+      double value = U_m;
+      for (unsigned int d = 1; d < dim; ++d)
+        value *= 4 * p[d] * (H - p[d]) / (H * H);
+      return value;
+    }
+
     const double U_m = 0.3;
     const double H = 0.41;
   };
@@ -133,72 +199,153 @@ public:
     }
   };
 
+  // Small vortex added to an initial condition read from file, to break the
+  // symmetry of the flow and trigger the vortex shedding sooner. It is
+  // centered just behind the cylinder, slightly above the axis of the
+  // channel, and is divergence free, being derived from the stream function
+  // psi = amplitude * sigma * exp(-r^2 / (2 sigma^2)).
+  class InitialPerturbation : public Function<dim>
+  {
+  public:
+    InitialPerturbation(const double &amplitude_)
+        : Function<dim>(dim + 1), amplitude(amplitude_)
+    {
+    }
+
+    virtual double
+    value(const Point<dim> &p,
+          const unsigned int component = 0) const override
+    {
+      const Tensor<1, dim> r = p - center;
+      const double factor =
+          amplitude / sigma * std::exp(-r.norm_square() / (2 * sigma * sigma));
+
+      if (component == 0)
+        return -factor * r[1];
+      else if (component == 1)
+        return factor * r[0];
+      else
+        return 0.0;
+    }
+
+  protected:
+    // Just behind the cylinder, slightly above the axis of the channel (and
+    // in the middle of the channel in z).
+    static Point<dim>
+    default_center()
+    {
+      Point<dim> center;
+      center[0] = CylinderMesh::Geometry<dim>::cylinder_x + 0.15;
+      center[1] = 0.215;
+      for (unsigned int d = 2; d < dim; ++d)
+        center[d] = 0.5 * CylinderMesh::channel_height;
+      return center;
+    }
+
+    const double amplitude;
+    const Point<dim> center = default_center();
+    const double sigma = 0.03;
+  };
+
+  // Number of vectors used by the inner solvers of the preconditioners, so
+  // that their vector pools can be sized once at initialization. FGMRES needs
+  // two vectors per basis vector (default basis size is 30) plus a few
+  // auxiliary ones, CG needs three.
+  static constexpr unsigned int n_inner_fgmres_vectors = 2 * (30 + 2);
+  static constexpr unsigned int n_inner_cg_vectors = 4;
+
   // Preconditioner
   // Block-diagonal preconditioner.
   class PreconditionBlockDiagonal
   {
   public:
+    PreconditionBlockDiagonal()
+        : solver_control_velocity(1000, 1e-1), solver_control_pressure(1000, 1e-1), solver_gmres_velocity(solver_control_velocity, memory_velocity), solver_cg_pressure(solver_control_pressure, memory_pressure)
+    {
+    }
+
     // Initialize the preconditioner, given the velocity stiffness matrix, the
-    // pressure mass matrix.
+    // pressure mass matrix. The vector is only used to size the workspace.
     void
-    initialize(const TrilinosWrappers::SparseMatrix &velocity_stiffness_,
-               const TrilinosWrappers::SparseMatrix &pressure_mass_)
+    initialize(const LA::SparseMatrix &velocity_stiffness_,
+               const LA::SparseMatrix &pressure_mass_,
+               const LA::MPI::BlockVector &vector_)
     {
       velocity_stiffness = &velocity_stiffness_;
       pressure_mass = &pressure_mass_;
 
       preconditioner_velocity.initialize(velocity_stiffness_);
       preconditioner_pressure.initialize(pressure_mass_);
+
+      memory_velocity.reserve(n_inner_fgmres_vectors, vector_.block(0));
+      memory_pressure.reserve(n_inner_cg_vectors, vector_.block(1));
+      memory_velocity.reset_allocations();
+      memory_pressure.reset_allocations();
     }
 
     // Application of the preconditioner.
     void
-    vmult(TrilinosWrappers::MPI::BlockVector &dst,
-          const TrilinosWrappers::MPI::BlockVector &src) const
+    vmult(LA::MPI::BlockVector &dst,
+          const LA::MPI::BlockVector &src) const
     {
-      SolverControl solver_control_velocity(1000,
-                                            1e-1);
-      SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_gmres_velocity(
-          solver_control_velocity);
       solver_gmres_velocity.solve(*velocity_stiffness,
                                   dst.block(0),
                                   src.block(0),
                                   preconditioner_velocity);
 
-      SolverControl solver_control_pressure(1000,
-                                            1e-1);
-      SolverCG<TrilinosWrappers::MPI::Vector> solver_cg_pressure(
-          solver_control_pressure);
       solver_cg_pressure.solve(*pressure_mass,
                                dst.block(1),
                                src.block(1),
                                preconditioner_pressure);
     }
 
+    // Number of vectors allocated by the inner solvers since initialization.
+    unsigned int
+    n_allocations() const
+    {
+      return memory_velocity.n_allocations() + memory_pressure.n_allocations();
+    }
+
   protected:
     // Velocity stiffness matrix.
-    const TrilinosWrappers::SparseMatrix *velocity_stiffness;
+    const LA::SparseMatrix *velocity_stiffness;
 
     // Preconditioner used for the velocity block.
-    TrilinosWrappers::PreconditionILU preconditioner_velocity;
+    LA::PreconditionILU preconditioner_velocity;
 
     // Pressure mass matrix.
-    const TrilinosWrappers::SparseMatrix *pressure_mass;
+    const LA::SparseMatrix *pressure_mass;
 
     // Preconditioner used for the pressure block.
-    TrilinosWrappers::PreconditionILU preconditioner_pressure;
+    LA::PreconditionILU preconditioner_pressure;
+
+    // Workspace of the inner solvers, one pool for each block.
+    mutable PooledVectorMemory<LA::MPI::Vector> memory_velocity;
+    mutable PooledVectorMemory<LA::MPI::Vector> memory_pressure;
+
+    // Inner solvers, built once and reused at every application.
+    mutable SolverControl solver_control_velocity;
+    mutable SolverControl solver_control_pressure;
+    mutable SolverFGMRES<LA::MPI::Vector> solver_gmres_velocity;
+    mutable SolverCG<LA::MPI::Vector> solver_cg_pressure;
   };
 
   // Block-triangular preconditioner.
   class PreconditionBlockTriangular
   {
   public:
+    PreconditionBlockTriangular()
+        : solver_control_velocity(2000001, 1e-4), solver_control_pressure(2000000, 1e-5), solver_gmres_velocity(solver_control_velocity, memory_velocity), solver_cg_pressure(solver_control_pressure, memory_pressure)
+    {
+    }
+
     // Initialize the preconditioner, given the velocity stiffness matrix, the
-    // pressure mass matrix.
+    // pressure mass matrix. The vector is only used to size the workspace.
     void
-    initialize(const TrilinosWrappers::SparseMatrix &velocity_stiffness_,
-               const TrilinosWrappers::SparseMatrix &pressure_mass_,
-               const TrilinosWrappers::SparseMatrix &B_)
+    initialize(const LA::SparseMatrix &velocity_stiffness_,
+               const LA::SparseMatrix &pressure_mass_,
+               const LA::SparseMatrix &B_,
+               const LA::MPI::BlockVector &vector_)
     {
       velocity_stiffness = &velocity_stiffness_;
       pressure_mass = &pressure_mass_;
@@ -206,65 +353,89 @@ public:
 
       preconditioner_velocity.initialize(velocity_stiffness_);
       preconditioner_pressure.initialize(pressure_mass_);
+
+      tmp.reinit(vector_.block(1));
+      memory_velocity.reserve(n_inner_fgmres_vectors, vector_.block(0));
+      memory_pressure.reserve(n_inner_cg_vectors, vector_.block(1));
+      memory_velocity.reset_allocations();
+      memory_pressure.reset_allocations();
     }
 
     // Application of the preconditioner.
     void
-    vmult(TrilinosWrappers::MPI::BlockVector &dst,
-          const TrilinosWrappers::MPI::BlockVector &src) const
+    vmult(LA::MPI::BlockVector &dst,
+          const LA::MPI::BlockVector &src) const
     {
-      SolverControl solver_control_velocity(2000001,
-                                            1e-4 * src.block(0).l2_norm());
-      SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_gmres_velocity(
-          solver_control_velocity);
+      // norms of both blocks of src, used for the inner tolerances
+      const std::array<double, 2> src_norms = fused_block_l2_norms(src);
+
+      solver_control_velocity.set_tolerance(1e-4 * src_norms[0]);
       solver_gmres_velocity.solve(*velocity_stiffness,
                                   dst.block(0),
                                   src.block(0),
                                   preconditioner_velocity);
 
-      tmp.reinit(src.block(1));
+      // tmp = src.block(1) - B * dst.block(0), the update is a single sweep
       B->vmult(tmp, dst.block(0));
-      tmp.sadd(-1.0, src.block(1));
+      tmp.sadd(-1.0, 1.0, src.block(1));
 
-      SolverControl solver_control_pressure(2000000,
-                                            1e-5 * src.block(1).l2_norm());
-      SolverCG<TrilinosWrappers::MPI::Vector> solver_cg_pressure(
-          solver_control_pressure);
+      solver_control_pressure.set_tolerance(1e-5 * src_norms[1]);
       solver_cg_pressure.solve(*pressure_mass,
                                dst.block(1),
                                tmp,
                                preconditioner_pressure);
     }
 
+    // Number of vectors allocated by the inner solvers since initialization.
+    unsigned int
+    n_allocations() const
+    {
+      return memory_velocity.n_allocations() + memory_pressure.n_allocations();
+    }
+
   protected:
     // Velocity stiffness matrix.
-    const TrilinosWrappers::SparseMatrix *velocity_stiffness;
+    const LA::SparseMatrix *velocity_stiffness;
 
     // Preconditioner used for the velocity block.
-    TrilinosWrappers::PreconditionILU preconditioner_velocity;
+    LA::PreconditionILU preconditioner_velocity;
 
     // Pressure mass matrix.
-    const TrilinosWrappers::SparseMatrix *pressure_mass;
+    const LA::SparseMatrix *pressure_mass;
 
     // Preconditioner used for the pressure block.
-    TrilinosWrappers::PreconditionILU preconditioner_pressure;
+    LA::PreconditionILU preconditioner_pressure;
 
     // B matrix.
-    const TrilinosWrappers::SparseMatrix *B;
+    const LA::SparseMatrix *B;
 
-    // Temporary vector.
-    mutable TrilinosWrappers::MPI::Vector tmp;
+    // Temporary vector, sized once in initialize().
+    mutable LA::MPI::Vector tmp;
+
+    // Workspace of the inner solvers, one pool for each block.
+    mutable PooledVectorMemory<LA::MPI::Vector> memory_velocity;
+    mutable PooledVectorMemory<LA::MPI::Vector> memory_pressure;
+
+    // Inner solvers, built once and reused at every application.
+    mutable SolverControl solver_control_velocity;
+    mutable SolverControl solver_control_pressure;
+    mutable SolverFGMRES<LA::MPI::Vector> solver_gmres_velocity;
+    mutable SolverCG<LA::MPI::Vector> solver_cg_pressure;
   };
 
+#ifndef NS_USE_TPETRA
+  // aSIMPLE preconditioner. It needs the product B * D^{-1} * B^T of two
+  // sparse matrices, which the Tpetra wrappers do not provide: it is only
+  // available with the Epetra backend.
   class PreconditionaSIMPLE
   {
   public:
     // Initialize the preconditioner
     void
-    initialize(const TrilinosWrappers::SparseMatrix &F_,
-               const TrilinosWrappers::SparseMatrix &B_neg_,
-               const TrilinosWrappers::SparseMatrix &B_t_,
-               const TrilinosWrappers::MPI::BlockVector &vector_,
+    initialize(const LA::SparseMatrix &F_,
+               const LA::SparseMatrix &B_neg_,
+               const LA::SparseMatrix &B_t_,
+               const LA::MPI::BlockVector &vector_,
                const double &alpha_)
     {
       F_matrix = &F_;
@@ -272,15 +443,10 @@ public:
       B_t_matrix = &B_t_;
       alpha = alpha_;
 
-      D_vector.reinit(vector_.block(0));
       D_inv_vector.reinit(vector_.block(0));
-      // compute diag(F) and diag(F)^{-1} and save it to the respective vector
-      for (unsigned int i : D_vector.locally_owned_elements())
-      {
-        const double tmp = F_matrix->diag_element(i);
-        D_vector[i] = tmp;
-        D_inv_vector[i] = 1.0 / tmp;
-      }
+      // compute diag(F)^{-1} and save it to the respective vector
+      for (unsigned int i : D_inv_vector.locally_owned_elements())
+        D_inv_vector[i] = 1.0 / F_matrix->diag_element(i);
 
       // assemble approximate of Schur complement as S = B * D_inv_vector * B^T
       B_neg_matrix->mmult(S_neg_matrix, *B_t_matrix, D_inv_vector);
@@ -288,22 +454,22 @@ public:
       // initialize preconditioners with corresponding matrices
       preconditioner_F.initialize(F_);
       preconditioner_S.initialize(S_neg_matrix);
+
+      // size the temp vector once, so that vmult does not allocate
+      tmp.reinit(vector_);
     }
 
     // Application of the preconditioner.
     void
-    vmult(TrilinosWrappers::MPI::BlockVector &dst,
-          const TrilinosWrappers::MPI::BlockVector &src) const
+    vmult(LA::MPI::BlockVector &dst,
+          const LA::MPI::BlockVector &src) const
     {
-      // reinit temp vector to store intermediate results
-      tmp.reinit(src);
-
       // compute multiplication [F^{-1} 0; 0 I] * src
       // solve linear system associated with F^{-1} * src.block(0) and store result in dst.block(0)
 
       // SolverControl solver_control_F(10000001,
       //                                1e-1 * src.block(0).l2_norm());
-      // SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_F(
+      // SolverFGMRES<LA::MPI::Vector> solver_F(
       //     solver_control_F);
 
       // solver_F.solve(*F_matrix,
@@ -316,18 +482,18 @@ public:
       // // if do not want to use direct solver
       preconditioner_F.vmult(dst.block(0), src.block(0));
 
-      // store src.block(1) in tmp.block(1)
-      tmp.block(1) = src.block(1);
-
-      // compute multiplication by [I 0; -B I]
-      // compute -B * dst.block(0) + tmp.block(1) and store result in tmp.block(1)
-      B_neg_matrix->vmult_add(tmp.block(1), dst.block(0));
+      // compute multiplication by [I 0; -B I], followed by the scaling by
+      // 1/alpha of the pressure block: since S^{-1} is linear, scaling its
+      // argument is the same as scaling its result. This is done in a single
+      // sweep, tmp.block(1) = 1/alpha * (-B * dst.block(0) + src.block(1))
+      B_neg_matrix->vmult(tmp.block(1), dst.block(0));
+      fused_add_and_scale(tmp.block(1), src.block(1), 1.0 / alpha);
 
       // compute multiplication by [I 0; 0 -S^{-1}]
       // solve linear system associated with the approximate Schur complement
       // SolverControl solver_control_S(10000000,
       //                                1e-1 * tmp.block(1).l2_norm());
-      // SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_S(
+      // SolverFGMRES<LA::MPI::Vector> solver_S(
       //     solver_control_S);
       // solver_S.solve(S_neg_matrix,
       //                dst.block(1),
@@ -337,51 +503,71 @@ public:
       // // if do not want to use direct solver
       preconditioner_S.vmult(dst.block(1), tmp.block(1));
 
-      // compute multiplication by [D 0; 0 I*1/alpha]
-      dst.block(0).scale(D_vector);
-      dst.block(1) *= 1.0 / alpha;
-
-      // compute multiplication by [I -B^T; 0 I]
+      // compute multiplication by [D^{-1} 0; 0 I] * [I -B^T; 0 I] * [D 0; 0 I]
+      // the outer scalings cancel out on the velocity block, which becomes
+      // dst.block(0) - D^{-1} * B^T * dst.block(1), computed in a single sweep
       B_t_matrix->vmult(tmp.block(0), dst.block(1));
-      dst.block(0) -= tmp.block(0);
+      fused_subtract_diagonal_scaled(dst.block(0), D_inv_vector, tmp.block(0));
+    }
+
+    // Number of vectors allocated at application time. The inner systems are
+    // approximated by a single ILU sweep, so there is no inner solver
+    // workspace and the only temporary vector is sized in initialize().
+    unsigned int
+    n_allocations() const
+    {
+      return 0;
+    }
 
-      // compute multiplication by [D^{-1} 0; 0 I]
-      dst.block(0).scale(D_inv_vector);
+    // Estimate of the bytes moved to and from memory by one application: each
+    // matrix entry (value and column index) is read once, ILU(0) factors having
+    // the same number of entries as the factorized matrix, and each vector
+    // entry is read or written once per stream of the kernels.
+    double
+    memory_traffic() const
+    {
+      const double n_u = D_inv_vector.size();
+      const double n_p = tmp.block(1).size();
+      const double nnz = static_cast<double>(F_matrix->n_nonzero_elements()) +
+                         B_neg_matrix->n_nonzero_elements() +
+                         S_neg_matrix.n_nonzero_elements() +
+                         B_t_matrix->n_nonzero_elements();
+
+      return (sizeof(double) + sizeof(int)) * nnz +
+             sizeof(double) * (8.0 * n_u + 7.0 * n_p);
     }
 
   protected:
     // F = 1/delta_t * M + A + C, where M is the mass matrix, A is the stiffness matrix
     // and C is the matrix corresponding to the linearized convective term
-    const TrilinosWrappers::SparseMatrix *F_matrix;
-
-    // vector obtained from diag(F)
-    TrilinosWrappers::MPI::Vector D_vector;
+    const LA::SparseMatrix *F_matrix;
 
     // vector obtained from diag(F)^{-1}, thus inverse of the diag(F)
-    TrilinosWrappers::MPI::Vector D_inv_vector;
+    LA::MPI::Vector D_inv_vector;
 
     // approximation of the Schur complement -S=-BD^{-1}B^T
-    TrilinosWrappers::SparseMatrix S_neg_matrix;
+    LA::SparseMatrix S_neg_matrix;
 
     // damping parameter alpha in [0,1]
     double alpha;
 
     // Preconditioner used to approximate F^{-1}
-    TrilinosWrappers::PreconditionILU preconditioner_F;
+    LA::PreconditionILU preconditioner_F;
 
     // Preconditioner used to approximate S^{-1}
-    TrilinosWrappers::PreconditionILU preconditioner_S;
+    LA::PreconditionILU preconditioner_S;
 
     // B matrix.
-    const TrilinosWrappers::SparseMatrix *B_neg_matrix;
+    const LA::SparseMatrix *B_neg_matrix;
 
     // B transpose matrix, needed to compute S
-    const TrilinosWrappers::SparseMatrix *B_t_matrix;
+    const LA::SparseMatrix *B_t_matrix;
 
-    // Temporary vector for intermediate results
+    // Temporary vector for intermediate results, sized once in initialize()
     // mutable type is used for const-correctness 
-    mutable TrilinosWrappers::MPI::BlockVector tmp;
+    mutable LA::MPI::BlockVector tmp;
   };
+#endif
 
 public:
   bool apply_first = true;
@@ -398,8 +584,9 @@ public:
            const double &tolerance_,
            const unsigned int &preconditioner_type_,
            double nu_,
-           bool read_mesh_from_file_)
-      : mpi_size(Utilities::MPI::n_mpi_processes(MPI_COMM_WORLD)), mpi_rank(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD)), pcout(std::cout, mpi_rank == 0), mesh_file_name(mesh_file_name_), mesh(MPI_COMM_WORLD), degree_velocity(degree_velocity_), degree_pressure(degree_pressure_), T(T_), delta_t(delta_t_), solver_type(solver_type_), tolerance(tolerance_), preconditioner_type(preconditioner_type_), mesh_size_x(mesh_size_x_), mesh_size_y(mesh_size_y_), nu(nu_), read_mesh_from_file(read_mesh_from_file_)
+           bool read_mesh_from_file_,
+           const MPI_Comm &mpi_comm_ = MPI_COMM_WORLD)
+      : mpi_comm(mpi_comm_), mpi_size(Utilities::MPI::n_mpi_processes(mpi_comm_)), mpi_rank(Utilities::MPI::this_mpi_process(mpi_comm_)), pcout(std::cout, mpi_rank == 0), mesh_file_name(mesh_file_name_), mesh(mpi_comm_), mesh_adaptive(mpi_comm_, Triangulation<dim>::limit_level_difference_at_vertices), degree_velocity(degree_velocity_), degree_pressure(degree_pressure_), T(T_), delta_t(delta_t_), solver_type(solver_type_), tolerance(tolerance_), preconditioner_type(preconditioner_type_), mesh_size_x(mesh_size_x_), mesh_size_y(mesh_size_y_), nu(nu_), target_nu(nu_), read_mesh_from_file(read_mesh_from_file_), delta_t_requested(delta_t_)
   {
   }
 
@@ -407,8 +594,9 @@ public:
   void
   setup();
 
-  // Solve the problem using Newton's method.
-  void
+  // Solve the problem using Newton's method, with continuation in the
+  // Reynolds number. Returns false if it failed to converge.
+  bool
   solve_newton();
 
   // Output.
@@ -418,18 +606,540 @@ public:
   void
   solve();
 
+  // Advance the current solution from t_start to t_end, without output. Used
+  // by drivers that run the solver over a time interval, such as Parareal.
+  void
+  advance(const double &t_start, const double &t_end);
+
+  // Replace the current solution, e.g. with the initial value of a time
+  // interval. If apply_inlet is true the inlet velocity is imposed by the
+  // first update, as for the zero initial condition of solve().
+  void
+  set_solution(const LA::MPI::BlockVector &solution_, const bool &apply_inlet);
+
+  // Current solution (without ghost elements).
+  const LA::MPI::BlockVector &
+  get_solution() const
+  {
+    return solution_owned;
+  }
+
+  // Monitor the lift and drag coefficients and report when they have become
+  // periodic over n_cycles shedding cycles, within the relative tolerance. If
+  // stop is true, the run ends as soon as this happens.
+  void
+  set_periodicity_detection(const unsigned int &n_cycles,
+                            const double &periodicity_tolerance,
+                            const bool &stop)
+  {
+    detect_periodicity = true;
+    stop_when_periodic = stop;
+    periodicity_monitor = PeriodicityMonitor(n_cycles, periodicity_tolerance);
+  }
+
+  // Write a checkpoint every given number of time steps (0 to disable).
+  void
+  set_checkpoint_interval(const unsigned int &checkpoint_interval_)
+  {
+    checkpoint_interval = checkpoint_interval_;
+  }
+
+  // Resume the run from the given checkpoint, which is loaded by solve()
+  // instead of applying the initial condition.
+  void
+  set_restart_file(const std::string &restart_file_name_)
+  {
+    restart_file_name = restart_file_name_;
+  }
+
+  // Start the run from the solution written by the stationary solver to the
+  // given file, instead of the zero initial condition, perturbed with a
+  // vortex of the given amplitude (relative to the inlet velocity).
+  void
+  set_initial_condition_file(const std::string &initial_condition_file_name_,
+                             const double &perturbation_amplitude_)
+  {
+    initial_condition_file_name = initial_condition_file_name_;
+    perturbation_amplitude = perturbation_amplitude_;
+  }
+
+  // Write the state of the time stepping to the given file, see
+  // NSSolverCheckpoint.cpp for the format.
+  void
+  save_checkpoint(const std::string &file_name) const;
+
+  // Restore the state of the time stepping from the given file.
+  void
+  load_checkpoint(const std::string &file_name);
+
+  // Enable or disable the output on screen.
+  void
+  set_verbose(const bool &verbose)
+  {
+    pcout.set_condition(verbose && mpi_rank == 0);
+  }
+
+  // Time the application of the aSIMPLE preconditioner and of its fused
+  // vector kernels, and report the achieved memory bandwidth.
+  void
+  benchmark_preconditioner(const unsigned int &n_applications);
+
+  // Time the assembly, the matrix-vector product with the Jacobian and a
+  // linear solve with the current DoF ordering, and append the results to
+  // dof_ordering.csv.
+  void
+  benchmark_dof_ordering(const unsigned int &n_applications);
+
+  // Select the owner-computes assembly: every process loops over its locally
+  // owned and ghost cells and only writes the rows it owns, so that no matrix
+  // or vector entry has to be sent to other processes on compress(), at the
+  // price of assembling the ghost cells on more than one process.
+  void
+  set_owner_computes_assembly(const bool &owner_computes_assembly_)
+  {
+    owner_computes_assembly = owner_computes_assembly_;
+  }
+
+  // Enable the adaptive time step control: the time step is chosen so that
+  // the estimated local error, relative to the size of the solution, stays
+  // around the given tolerance.
+  void
+  set_adaptive_time_stepping(const double &time_step_tolerance_)
+  {
+    adaptive_time_stepping = true;
+    time_step_tolerance = time_step_tolerance_;
+    delta_t_min = 1e-3 * delta_t;
+    delta_t_max = 1e2 * delta_t;
+  }
+
+  // Select the order (1, 2 or 3) of the BDF scheme used for the time
+  // derivative. The first steps fall back to the highest order allowed by the
+  // number of solutions computed so far, starting from backward Euler.
+  void
+  set_bdf_order(const unsigned int &bdf_order_)
+  {
+    AssertThrow(bdf_order_ >= 1 && bdf_order_ <= 3,
+                ExcMessage("The BDF order must be 1, 2 or 3."));
+    bdf_order = bdf_order_;
+  }
+
+  // Select the semi-implicit time stepping: the convection field is
+  // extrapolated from the previous solutions, so that each time step requires
+  // a single linear (Oseen) solve instead of a Newton iteration with line
+  // search and continuation in the Reynolds number.
+  void
+  set_semi_implicit(const bool &semi_implicit_)
+  {
+    semi_implicit = semi_implicit_;
+  }
+
+  // Select the incremental pressure-correction scheme in rotational form as
+  // time stepping engine: each step solves an advection-diffusion problem for
+  // the velocity and a Poisson problem for the pressure, instead of the
+  // coupled saddle-point problem. It must be called before setup().
+  void
+  set_projection_scheme(const bool &projection_scheme_)
+  {
+    projection_scheme = projection_scheme_;
+  }
+
+  // Set the number of processes of the groups used to build the mesh: only
+  // the first process of each group builds the serial mesh. With 0 (the
+  // default) a group is made of the processes of a shared memory node. It
+  // must be called before setup().
+  void
+  set_mesh_group_size(const unsigned int &mesh_group_size_)
+  {
+    mesh_group_size = mesh_group_size_;
+  }
+
+  // Enable the adaptive refinement of the mesh: every refinement_interval
+  // time steps, the cells with the largest Kelly error indicator of the
+  // velocity are refined, up to max_level levels, and those with the smallest
+  // one coarsened, in the given fractions of the number of cells. The
+  // solutions are transferred to the new mesh, which is rebalanced among the
+  // processes. It must be called before setup(), and is only available on the
+  // generated mesh.
+  void
+  set_adaptive_refinement(const unsigned int &refinement_interval_,
+                          const unsigned int &max_refinement_level_,
+                          const double &refine_fraction_ = 0.3,
+                          const double &coarsen_fraction_ = 0.03)
+  {
+    adaptive_refinement = refinement_interval_ > 0;
+    refinement_interval = refinement_interval_;
+    max_refinement_level = max_refinement_level_;
+    refine_fraction = refine_fraction_;
+    coarsen_fraction = coarsen_fraction_;
+  }
+
+  // Store the description of the distributed mesh, the DoF numbering and
+  // the sparsity patterns in the given directory, keyed by the mesh options,
+  // the DoF ordering and the number of processes, so that later runs with the
+  // same mesh load them instead of building them. It must be called before
+  // setup().
+  void
+  set_mesh_cache_directory(const std::string &mesh_cache_directory_)
+  {
+    mesh_cache_directory = mesh_cache_directory_;
+  }
+
+  // Set the partitioning of the serial mesh. Each cell weighs 1 plus the given
+  // weight for each of its faces on the outlet and on the cylinder, where the
+  // assembly and the lift and drag computation integrate (the measured values
+  // are printed by print_assembly_statistics()). With minimize_communication
+  // the cells are partitioned on the graph of the cells sharing a vertex
+  // instead of a face, which accounts for all the DoFs exchanged with the
+  // neighbouring processes. It must be called before setup().
+  void
+  set_partitioning(const double &outlet_face_weight_,
+                   const double &cylinder_face_weight_,
+                   const bool &minimize_communication_)
+  {
+    outlet_face_weight = outlet_face_weight_;
+    cylinder_face_weight = cylinder_face_weight_;
+    partition_minimize_communication = minimize_communication_;
+  }
+
+  // Set the ordering of the DoFs within each block. It must be called before
+  // setup().
+  void
+  set_dof_ordering(const DoFOrdering &dof_ordering_)
+  {
+    dof_ordering = dof_ordering_;
+  }
+
+  // Generate a boundary-fitted mesh, with the given number of cells along the
+  // cylinder, the walls and the inlet (see CylinderMesh.hpp), instead of
+  // removing the cells inside the cylinder from a uniform mesh of the
+  // channel. The cells on the cylinder are curved by a mapping of the degree
+  // of the velocity. It must be called before setup().
+  void
+  set_cylinder_mesh(const CylinderMesh::Parameters &cylinder_mesh_parameters_)
+  {
+    cylinder_mesh = true;
+    cylinder_mesh_parameters = cylinder_mesh_parameters_;
+  }
+
+  // Print the time spent in the cell loop and in the compress() calls of the
+  // assembly, to compare the assembly modes.
+  void
+  print_assembly_statistics() const;
+
 protected:
+  // Build the serial mesh of the channel with the cylinder, with boundary ids.
+  void
+  create_serial_mesh(Triangulation<dim> &mesh_serial) const;
+
+  // Build the distributed mesh from the serial one created by the given
+  // function, which is only called by the first process of each group.
+  void
+  create_distributed_mesh(
+      const std::function<void(Triangulation<dim> &)> &serial_mesh_generator);
+
+  // Locally owned rows of a sparsity pattern, in compressed row format: the
+  // columns of the k-th locally owned row are columns[row_starts[k]] to
+  // columns[row_starts[k + 1]] (excluded).
+  struct CachedSparsityPattern
+  {
+    std::vector<std::uint64_t> row_starts;
+    std::vector<types::global_dof_index> columns;
+
+    template <class Archive>
+    void
+    serialize(Archive &ar, const unsigned int /*version*/)
+    {
+      ar &row_starts &columns;
+    }
+  };
+
+  // Record of this process in the mesh cache: the description of its part of
+  // the mesh, the final number of each DoF it owns and the locally owned rows
+  // of the sparsity patterns.
+  struct MeshCacheRecord
+  {
+    TriangulationDescription::Description<dim, dim> construction_data;
+
+    // Final numbers of the locally owned DoFs, after the DoF ordering and the
+    // renumbering by blocks, in the order given by distribute_dofs().
+    std::vector<types::global_dof_index> dof_numbers;
+
+    CachedSparsityPattern jacobian_sparsity;
+    CachedSparsityPattern pressure_mass_sparsity;
+
+    template <class Archive>
+    void
+    serialize(Archive &ar, const unsigned int /*version*/)
+    {
+      ar &construction_data &dof_numbers &jacobian_sparsity
+          &pressure_mass_sparsity;
+    }
+  };
+
+  // Key identifying the mesh in the cache: the dimension, its source, the
+  // finite element degrees, the partitioning options, the DoF ordering and
+  // the number of processes.
+  std::string
+  mesh_cache_key() const;
+
+  // Name of the cache file of the current mesh.
+  std::string
+  mesh_cache_file_name() const;
+
+  // Read the record of this process from the cache. Returns false if the
+  // file does not exist or does not match the key.
+  bool
+  read_mesh_cache(const std::string &file_name, MeshCacheRecord &record) const;
+
+  // Write the record of each process to the cache, see NSSolverMeshCache.cpp
+  // for the format.
+  void
+  write_mesh_cache(const std::string &file_name,
+                   const MeshCacheRecord &record) const;
+
+  // DoF indices of the locally owned cells, one after the other.
+  std::vector<types::global_dof_index>
+  locally_owned_cell_dof_indices() const;
+
+  // Store in the cache record the final number of each DoF owned by this
+  // process, given the owned DoFs and the DoF indices of the locally owned
+  // cells (see locally_owned_cell_dof_indices()) before the renumbering.
+  void
+  cache_dof_numbers(
+      const IndexSet &initial_owned_dofs,
+      const std::vector<types::global_dof_index> &initial_cell_dof_indices);
+
+  // Store in the given cached pattern the locally owned rows of the sparsity
+  // pattern with the given coupling, including the entries added by the
+  // cells of the other processes.
+  void
+  cache_sparsity_pattern(const Table<2, DoFTools::Coupling> &coupling,
+                         CachedSparsityPattern &cached) const;
+
+  // Add the entries of a cached pattern to the locally owned rows of the
+  // given sparsity pattern.
+  void
+  add_cached_sparsity_pattern(const CachedSparsityPattern &cached,
+                              LA::BlockSparsityPattern &sparsity) const;
+
+  // Partition the serial mesh among the given number of processes, with the
+  // weights and graph selected with set_partitioning().
+  void
+  partition_serial_mesh(Triangulation<dim> &mesh_serial,
+                        const unsigned int &n_partitions) const;
+
+  // Partition weight of a cell, in hundredths of the weight of a cell without
+  // boundary faces.
+  unsigned int
+  partition_weight(
+      const typename Triangulation<dim>::active_cell_iterator &cell) const;
+
+  // Print the cells, DoFs, ghost DoFs and faces shared with other processes
+  // (edge cut) of each process with the imbalance ratios, and append them to
+  // partition.csv.
+  void
+  print_partition_statistics() const;
+
+  // Number of processes of the shared memory nodes (the smallest one, if they
+  // differ).
+  unsigned int
+  n_processes_per_node() const;
+
+  // Print the setup time and the peak memory over the processes, and append
+  // the values of each process to setup.csv.
+  void
+  print_setup_statistics() const;
+
+  // Outcome of Newton's method for a given Reynolds number.
+  enum class NewtonStatus
+  {
+    converged,
+    max_iterations,
+    stagnation,
+    divergence,
+    line_search_failure,
+    linear_solver_failure
+  };
+
+  // Newton iterations with line search for the current Reynolds number. The
+  // residual history is checked at every iteration, so that stagnation and
+  // divergence are detected early.
+  NewtonStatus
+  solve_newton_iterations(bool &first_iter);
+
+  static std::string
+  newton_status_to_string(const NewtonStatus &status);
+
+  // Distribute the DoFs on the current mesh and initialize the constraints,
+  // the matrices and the vectors.
+  void
+  setup_dofs();
+
+  // Renumber the locally owned DoFs in the selected ordering. The block-wise
+  // renumbering that follows keeps their relative order within each block.
+  void
+  renumber_dofs();
+
+  // Refine and coarsen the adaptive mesh, transferring the solutions.
+  void
+  refine_mesh();
+
+  // Mesh in use, adaptive or fully distributed.
+  parallel::TriangulationBase<dim> &
+  triangulation()
+  {
+    if (adaptive_refinement)
+      return mesh_adaptive;
+    return mesh;
+  }
+
+  const parallel::TriangulationBase<dim> &
+  triangulation() const
+  {
+    if (adaptive_refinement)
+      return mesh_adaptive;
+    return mesh;
+  }
+
   // Assemble the tangent problem.
   void
   assemble_system(bool first_iter);
 
+  // Number of DoFs per cell of the velocity-pressure element with the given
+  // degrees, on hypercubes or on simplices, 0 for degree_velocity_ = 0.
+  static constexpr unsigned int
+  n_dofs_per_cell(const unsigned int degree_velocity_,
+                  const unsigned int degree_pressure_,
+                  const bool simplex)
+  {
+    if (degree_velocity_ == 0)
+      return 0;
+
+    // (k + dim)! / (k! dim!) nodes on simplices, (k + 1)^dim on hypercubes
+    unsigned int n_velocity = 1;
+    unsigned int n_pressure = 1;
+    for (unsigned int d = 1; d <= dim; ++d)
+    {
+      n_velocity = simplex ? n_velocity * (degree_velocity_ + d) / d :
+                             n_velocity * (degree_velocity_ + 1);
+      n_pressure = simplex ? n_pressure * (degree_pressure_ + d) / d :
+                             n_pressure * (degree_pressure_ + 1);
+    }
+    return dim * n_velocity + n_pressure;
+  }
+
+  // Whether the velocity and the pressure have the same degree. Equal-order
+  // pairs (e.g. Q1-Q1, P1-P1) do not satisfy the inf-sup condition, and are
+  // stabilized with SUPG, PSPG and LSIC terms in assemble_cells(), which
+  // also couple the pressure DoFs with each other.
+  bool
+  stabilized() const
+  {
+    return degree_velocity == degree_pressure;
+  }
+
+  // Cell loop of assemble_system() for the given degrees and reference cell.
+  // The number of DoFs per cell is then a compile-time constant, so that the
+  // local matrices are arrays on the stack and the loops over the DoFs have
+  // constant bounds; with degree_velocity_ = 0 the sizes are taken from the
+  // finite element at run time.
+  template <unsigned int degree_velocity_,
+            unsigned int degree_pressure_,
+            bool simplex>
+  void
+  assemble_cells(const bool &first_iter);
+
   // Solve the tangent problem.
   int solve_system();
 
+  // Advance the solution by one semi-implicit step.
+  void
+  solve_semi_implicit();
+
+  // Pressure-correction engine, see NSSolverProjection.cpp. //////////////////
+
+  // Assemble the matrices that do not change in time: velocity mass, pressure
+  // mass and pressure Laplacian.
+  void
+  assemble_projection_matrices();
+
+  // Assemble the advection-diffusion problem of the velocity.
+  void
+  assemble_projection_velocity();
+
+  // Assemble (div u_tilde, q) into the pressure block of the residual vector.
+  void
+  assemble_projection_divergence();
+
+  // Assemble (u_tilde - 1 / a_0 * grad(phi), v) into the velocity block of
+  // the residual vector.
+  void
+  assemble_projection_update();
+
+  // Advance the solution by one pressure-correction step.
+  void
+  solve_projection_step();
+
+  // Build the index of the boundary faces where boundary integrals are
+  // computed, caching their geometric and shape function data.
+  void
+  build_boundary_face_index();
+
   double get_reynolds() const;
 
+  // Diameter of the cylinder, the reference length of the Reynolds and
+  // Strouhal numbers.
+  static constexpr double cylinder_diameter = 2 * CylinderMesh::cylinder_radius;
+
+  // Reference area of the lift and drag coefficients: the diameter of the
+  // cylinder, times the height of the channel in 3D.
+  static constexpr double reference_area =
+      dim == 2 ? cylinder_diameter :
+                 cylinder_diameter * CylinderMesh::channel_height;
+
+  // Compute the BDF coefficients of the current time step and the part of
+  // the time derivative that depends on the previous solutions, and the
+  // extrapolated convection field of the semi-implicit mode.
+  void
+  update_time_derivative();
+
+  // Read the initial condition from initial_condition_file_name, rescaling it
+  // to the inlet velocity of this problem, and add the perturbation.
+  void
+  load_initial_condition();
+
+  // Time stepping loop from the current time to T. If postprocess is true,
+  // the solution, lift and drag are written at every accepted step.
+  void
+  time_loop(const bool &postprocess);
+
+  // Estimate the local error of the last time step.
+  double
+  estimate_time_error() const;
+
+  // Time step for the next step, given the error estimate of the accepted one.
+  double
+  compute_next_time_step(const double &time_error) const;
+
+  // Time step for the retry of a rejected step.
+  double
+  compute_rejected_time_step(const double &time_error) const;
+
+  // Report the statistics of the periodic regime: Strouhal number, extrema
+  // of the lift and drag coefficients and mean drag.
+  void
+  print_periodicity() const;
+
+  // Append the time step and its error estimate to time_steps.csv.
+  void
+  print_time_step(const unsigned int &time_step,
+                  const double &time_error) const;
+
   // MPI parallel. /////////////////////////////////////////////////////////////
 
+  // Communicator of the processes sharing the mesh.
+  const MPI_Comm mpi_comm;
+
   // Number of MPI processes.
   const unsigned int mpi_size;
 
@@ -460,6 +1170,48 @@ protected:
   const std::string &mesh_file_name;
   parallel::fullydistributed::Triangulation<dim> mesh;
 
+  // Mesh used with adaptive refinement, instead of the fully distributed one.
+  parallel::distributed::Triangulation<dim> mesh_adaptive;
+
+  // Adaptive refinement: whether it is enabled, the number of time steps
+  // between two adaptations, the maximum refinement level and the fractions
+  // of cells refined and coarsened.
+  bool adaptive_refinement = false;
+  unsigned int refinement_interval = 0;
+  unsigned int max_refinement_level = 0;
+  double refine_fraction = 0.3;
+  double coarsen_fraction = 0.03;
+
+  // Size of the groups of processes building the mesh, 0 for one group per
+  // node.
+  unsigned int mesh_group_size = 0;
+
+  // Directory of the mesh cache, empty to disable it, and how it is used.
+  std::string mesh_cache_directory;
+  MeshCacheStatus mesh_cache_status = MeshCacheStatus::none;
+
+  // Record of this process in the mesh cache, read from it on a warm run or
+  // filled to be written on a cold one; it only exists during setup().
+  std::unique_ptr<MeshCacheRecord> mesh_cache_record;
+
+  // Partitioning of the serial mesh: weights of the outlet and cylinder faces
+  // relative to a cell, and whether the vertex connectivity graph is used.
+  double outlet_face_weight = 0.0;
+  double cylinder_face_weight = 0.0;
+  bool partition_minimize_communication = false;
+
+  // Ordering of the DoFs within the velocity and pressure blocks.
+  DoFOrdering dof_ordering = DoFOrdering::none;
+
+  // Boundary-fitted mesh of the cylinder, instead of the uniform one.
+  bool cylinder_mesh = false;
+  CylinderMesh::Parameters cylinder_mesh_parameters = CylinderMesh::medium;
+
+  // Wall time spent by this process building the mesh and in the whole
+  // setup().
+  double time_mesh_setup = 0.0;
+  double time_setup = 0.0;
+
   // Polynomial degrees.
   const unsigned int degree_velocity;
   const unsigned int degree_pressure;
@@ -467,23 +1219,31 @@ protected:
   // current time
   double time;
 
+  // Index of the current time step.
+  unsigned int time_step_number = 0;
+
   // Solver parameters. ////////////////////////////////////////////////////////
   // final time
   double T;
-  // Time step.
-  const double delta_t;
+  // Time step, variable with adaptive time stepping.
+  double delta_t;
   const unsigned int solver_type;
   const double tolerance;
   const unsigned int preconditioner_type;
   const unsigned int mesh_size_x;
   const unsigned int mesh_size_y;
-  // Kinematic viscosity [m2/s]
+  // Kinematic viscosity [m2/s] of the current level of the continuation in
+  // the Reynolds number, and of the problem.
   double nu;
+  double target_nu;
   const bool read_mesh_from_file;
 
   // Finite element space.
   std::unique_ptr<FESystem<dim>> fe;
 
+  // Mapping from the reference cell, curved on the boundary-fitted mesh.
+  std::unique_ptr<Mapping<dim>> mapping;
+
   // Quadrature formula.
   std::unique_ptr<Quadrature<dim>> quadrature;
 
@@ -505,30 +1265,203 @@ protected:
   // DoFs relevant to current process in the velocity and pressure blocks.
   std::vector<IndexSet> block_relevant_dofs;
 
+  // Constraints of the hanging nodes, empty without adaptive refinement.
+  AffineConstraints<double> hanging_node_constraints;
+
   // Jacobian matrix.
-  TrilinosWrappers::BlockSparseMatrix jacobian_matrix;
+  LA::BlockSparseMatrix jacobian_matrix;
 
   // Pressure mass matrix, needed for preconditioning. We use a block matrix for
   // convenience, but in practice we only look at the pressure-pressure block.
-  TrilinosWrappers::BlockSparseMatrix pressure_mass;
+  LA::BlockSparseMatrix pressure_mass;
 
   // Residual vector.
-  TrilinosWrappers::MPI::BlockVector residual_vector;
+  LA::MPI::BlockVector residual_vector;
 
   // Solution increment (without ghost elements).
-  TrilinosWrappers::MPI::BlockVector delta_owned;
+  LA::MPI::BlockVector delta_owned;
 
   // System solution (without ghost elements).
-  TrilinosWrappers::MPI::BlockVector solution_owned;
+  LA::MPI::BlockVector solution_owned;
 
   // System solution (including ghost elements).
-  TrilinosWrappers::MPI::BlockVector solution;
+  LA::MPI::BlockVector solution;
 
   // store the solution at the previous iteration
-  TrilinosWrappers::MPI::BlockVector solution_old;
+  LA::MPI::BlockVector solution_old;
+
+  // Solutions at the time steps before the previous one, most recent first,
+  // and the time steps that led from each of them to the following one.
+  std::deque<LA::MPI::BlockVector> solution_history;
+  std::deque<double> delta_t_history;
+
+  // Time discretization. /////////////////////////////////////////////////////
+
+  // Order of the BDF scheme, and order actually used in the current step.
+  unsigned int bdf_order = 1;
+  unsigned int current_bdf_order = 1;
+
+  // Coefficients of the BDF formula of the current step, so that the time
+  // derivative is sum_k bdf_coefficients[k] * u_{n+1-k}. They already
+  // include the division by the time steps.
+  std::vector<double> bdf_coefficients;
+
+  // sum_{k>=1} bdf_coefficients[k] * u_{n+1-k}, the part of the time
+  // derivative that only depends on the previous solutions (including ghost
+  // elements).
+  LA::MPI::BlockVector bdf_history_term;
+
+  // Whether the semi-implicit time stepping is used.
+  bool semi_implicit = false;
+
+  // Extrapolated velocity used as convection field in the semi-implicit mode
+  // and in the pressure-correction scheme (including ghost elements).
+  LA::MPI::BlockVector convection_velocity;
+
+  // Pressure-correction scheme. //////////////////////////////////////////////
+
+  // Whether the pressure-correction scheme is used.
+  bool projection_scheme = false;
+
+  // Velocity mass matrix (velocity-velocity block) and pressure Laplacian
+  // (pressure-pressure block), with the boundary conditions of the velocity
+  // update and of the pressure increment.
+  LA::BlockSparseMatrix velocity_mass;
+  LA::BlockSparseMatrix pressure_laplace;
+
+  // Pressure increment phi, in the pressure block (including ghost elements).
+  LA::MPI::BlockVector pressure_increment;
+
+#ifndef NS_USE_TPETRA
+  // Preconditioners of the pressure-correction scheme. Those of the constant
+  // matrices are built once in assemble_projection_matrices().
+  LA::PreconditionAMG preconditioner_projection_velocity;
+  LA::PreconditionAMG preconditioner_projection_pressure;
+  LA::PreconditionILU preconditioner_velocity_mass;
+  LA::PreconditionILU preconditioner_pressure_mass;
+#endif
 
   // Evaluation point, used to find an optimal update in the Newton iteration
-  TrilinosWrappers::MPI::BlockVector evaluation_point;
+  LA::MPI::BlockVector evaluation_point;
+
+  // Boundary faces. //////////////////////////////////////////////////////////
+
+  // Boundary ids of the outlet (Neumann condition) and of the cylinder (where
+  // lift and drag are computed).
+  static constexpr types::boundary_id outlet_boundary_id = 8;
+  static constexpr types::boundary_id cylinder_boundary_id = 10;
+
+  // Data of a boundary face, so that boundary integrals need neither to search
+  // the mesh for the face nor to reinit an FEFaceValues object on it. Shape
+  // function data is stored at index q * dofs_per_cell + i.
+  struct BoundaryFaceData
+  {
+    // Whether the face belongs to a locally owned cell (or to a ghost one).
+    bool locally_owned;
+
+    // DoF indices of the cell the face belongs to.
+    std::vector<types::global_dof_index> dof_indices;
+
+    // Normal vectors and JxW values on the quadrature nodes.
+    std::vector<Tensor<1, dim>> normals;
+    std::vector<double> JxW;
+
+    // Velocity and pressure shape functions on the quadrature nodes.
+    std::vector<Tensor<1, dim>> velocity_values;
+    std::vector<Tensor<2, dim>> velocity_gradients;
+    std::vector<double> pressure_values;
+  };
+
+  // Faces of the outlet and of the cylinder that belong to locally owned or
+  // ghost cells, for each boundary id.
+  std::map<types::boundary_id, std::vector<BoundaryFaceData>> boundary_faces;
+
+  // Assembly mode and statistics. ///////////////////////////////////////////
+
+  // Whether the owner-computes assembly is used.
+  bool owner_computes_assembly = false;
+
+  // Number of calls to assemble_system.
+  unsigned int n_assemblies = 0;
+
+  // Number of cells assembled by this process, over all the assemblies.
+  unsigned long n_cells_assembled = 0;
+
+  // Wall time spent by this process in the cell loop and in compress().
+  double time_assembly_cells = 0.0;
+  double time_assembly_compress = 0.0;
+
+  // Number of outlet faces integrated by this process over all the
+  // assemblies, and the time spent on them (included in the cell loop time).
+  unsigned long n_faces_assembled = 0;
+  double time_assembly_faces = 0.0;
+
+  // Number of calls to compute_lift_drag(), cylinder faces integrated by this
+  // process over all the calls, and the time spent on them.
+  unsigned int n_lift_drag_evaluations = 0;
+  unsigned long n_lift_drag_faces = 0;
+  double time_lift_drag = 0.0;
+
+  // Adaptive time stepping. //////////////////////////////////////////////////
+
+  // Whether the time step is adapted.
+  bool adaptive_time_stepping = false;
+
+  // Tolerance on the relative local error of a time step.
+  double time_step_tolerance = 1e-3;
+
+  // Bounds of the time step.
+  double delta_t_min = 0.0;
+  double delta_t_max = 0.0;
+
+  // Error estimate of the last accepted step.
+  double time_error_old = 0.0;
+
+  // Number of accepted and rejected time steps.
+  unsigned int n_accepted_steps = 0;
+  unsigned int n_rejected_steps = 0;
+
+  // Newton failures. //////////////////////////////////////////////////////////
+
+  // Time step given to the constructor, recovered after a failure when the
+  // time step is not adaptive.
+  const double delta_t_requested;
+
+  // Number of failures of Newton's method, over the whole run.
+  unsigned int n_newton_failures = 0;
+
+  // Consecutive failed attempts of the current time step, and their maximum.
+  unsigned int n_failed_steps = 0;
+  static constexpr unsigned int n_max_failed_steps = 6;
+
+  // Smallest time step tried after a failure.
+  static constexpr double delta_t_min_failure = 1e-8;
+
+  // Checkpointing. ////////////////////////////////////////////////////////////
+
+  // Number of time steps between two checkpoints (0 to disable).
+  unsigned int checkpoint_interval = 0;
+
+  // Checkpoint to restart from, empty to start from the initial condition.
+  std::string restart_file_name;
+
+  // Stationary solution used as initial condition, empty for the zero one,
+  // and amplitude of the perturbation added to it.
+  std::string initial_condition_file_name;
+  double perturbation_amplitude = 0.1;
+
+  // Periodicity detection. ///////////////////////////////////////////////////
+
+  // Whether the lift and drag coefficients are monitored, and whether the run
+  // stops once they are periodic.
+  bool detect_periodicity = false;
+  bool stop_when_periodic = false;
+
+  // Monitor of the lift and drag coefficients.
+  PeriodicityMonitor periodicity_monitor;
+
+  // Whether the periodic regime has been reached.
+  bool periodic = false;
 
   // Lift and Drag forces  ///////////////////////////////////////////////////////////
 public:
@@ -546,6 +1479,24 @@ protected:
   double drag_force = 0.0;
   double lift_coeff = 0.0;
   double drag_coeff = 0.0;
+
+  // Index of the next line of lift_coefficients.csv and drag_coefficients.csv.
+  unsigned int lift_index = 1;
+  unsigned int drag_index = 1;
 };
 
-#endif
\ No newline at end of file
+// Call f with std::integral_constant<int, dim>, so that a driver can run
+// NSSolver<decltype(f_dim)::value> in the dimension given at run time.
+template <typename Callable>
+void
+dispatch_dimension(const unsigned int &dim, const Callable &f)
+{
+  AssertThrow(dim == 2 || dim == 3,
+              ExcMessage("The dimension must be 2 or 3."));
+  if (dim == 2)
+    f(std::integral_constant<int, 2>());
+  else
+    f(std::integral_constant<int, 3>());
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include "NSSolver.hpp"
+
+#include "CellwiseVectorIO.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+// Checkpoints are cell-wise vector files (see CellwiseVectorIO.hpp), whose
+// metadata is the scalar state of the time stepping followed by the state of
+// the periodicity monitor, and whose vectors are solution, solution_old and
+// the solution history used by BDF and by the time step control.
+//
+// Since the records are stored by coarse cell id, a run can be restarted on a
+// different number of processes. The mesh is not stored, since it is rebuilt
+// by setup() from the same options: the header is used to check that it
+// matches.
+
+namespace
+{
+  struct CheckpointState
+  {
+    char magic[8];
+    std::uint32_t time_step_number;
+    std::uint32_t apply_first;
+    std::uint32_t n_accepted_steps;
+    std::uint32_t n_rejected_steps;
+    std::uint32_t lift_index;
+    std::uint32_t drag_index;
+    std::uint32_t periodic;
+    std::uint32_t n_monitor_values;
+    double time;
+    double delta_t;
+    double nu;
+    double time_error_old;
+    double delta_t_history[3];
+  };
+
+  constexpr char checkpoint_magic[8] = "NSCHKPT";
+}
+
+template <int dim>
+void NSSolver<dim>::save_checkpoint(const std::string &file_name) const
+{
+  Timer timer;
+
+  std::vector<const LA::MPI::BlockVector *> vectors = {&solution,
+                                                       &solution_old};
+  for (const auto &v : solution_history)
+    vectors.push_back(&v);
+
+  CheckpointState state;
+  std::memset(&state, 0, sizeof(state));
+  std::memcpy(state.magic, checkpoint_magic, sizeof(state.magic));
+  state.time_step_number = time_step_number;
+  state.apply_first = apply_first;
+  state.n_accepted_steps = n_accepted_steps;
+  state.n_rejected_steps = n_rejected_steps;
+  state.lift_index = lift_index;
+  state.drag_index = drag_index;
+  state.time = time;
+  state.delta_t = delta_t;
+  state.nu = target_nu;
+  state.time_error_old = time_error_old;
+  for (unsigned int k = 0; k < delta_t_history.size() && k < 3; ++k)
+    state.delta_t_history[k] = delta_t_history[k];
+
+  // The completed shedding cycles and the samples of the current one, so
+  // that the detection of the periodic regime resumes after a restart.
+  const std::vector<double> monitor_state = periodicity_monitor.save_state();
+  state.periodic = periodic;
+  state.n_monitor_values = monitor_state.size();
+
+  std::vector<char> metadata(sizeof(state) +
+                             monitor_state.size() * sizeof(double));
+  std::memcpy(metadata.data(), &state, sizeof(state));
+  std::memcpy(metadata.data() + sizeof(state),
+              monitor_state.data(),
+              monitor_state.size() * sizeof(double));
+
+  // The file replaces the previous checkpoint only once it is complete, so
+  // that a job killed while writing does not lose it.
+  CellwiseVectorIO::write(file_name,
+                          dof_handler,
+                          vectors,
+                          metadata.data(),
+                          metadata.size(),
+                          mpi_comm);
+
+  pcout << "Checkpoint written to " << file_name << " at t = " << std::fixed
+        << std::setprecision(5) << time << " in " << std::setprecision(2)
+        << Utilities::MPI::max(timer.wall_time(), mpi_comm) << " s"
+        << std::endl;
+}
+
+template <int dim>
+void NSSolver<dim>::load_checkpoint(const std::string &file_name)
+{
+  pcout << "===============================================" << std::endl;
+  pcout << "Restarting from " << file_name << std::endl;
+
+  std::vector<char> metadata;
+  const CellwiseVectorIO::FileHeader header =
+      CellwiseVectorIO::read_header(file_name, dof_handler, metadata, mpi_comm);
+
+  CheckpointState state;
+  AssertThrow(metadata.size() >= sizeof(state) && header.n_vectors >= 2 &&
+                  std::memcmp(metadata.data(), checkpoint_magic, sizeof(state.magic)) == 0,
+              ExcMessage(file_name + " is not a checkpoint of this solver."));
+  std::memcpy(&state, metadata.data(), sizeof(state));
+  AssertThrow(metadata.size() ==
+                  sizeof(state) + state.n_monitor_values * sizeof(double),
+              ExcMessage(file_name + " is not a checkpoint of this solver."));
+
+  std::vector<double> monitor_state(state.n_monitor_values);
+  std::memcpy(monitor_state.data(),
+              metadata.data() + sizeof(state),
+              monitor_state.size() * sizeof(double));
+  periodicity_monitor.load_state(monitor_state);
+  periodic = state.periodic;
+
+  // Rebuild the vectors from the records, the ghost entries are then
+  // imported.
+  std::vector<LA::MPI::BlockVector> owned(
+      header.n_vectors, LA::MPI::BlockVector(block_owned_dofs, mpi_comm));
+  std::vector<LA::MPI::BlockVector *> vectors;
+  for (auto &v : owned)
+    vectors.push_back(&v);
+  CellwiseVectorIO::read(file_name, dof_handler, vectors, mpi_comm);
+
+  solution_owned = owned[0];
+  solution = solution_owned;
+  solution_old = owned[1];
+
+  solution_history.clear();
+  delta_t_history.clear();
+  for (unsigned int v = 2; v < header.n_vectors; ++v)
+  {
+    LA::MPI::BlockVector ghosted(block_owned_dofs,
+                                 block_relevant_dofs,
+                                 mpi_comm);
+    ghosted = owned[v];
+    solution_history.push_back(ghosted);
+    delta_t_history.push_back(state.delta_t_history[v - 2]);
+  }
+
+  time = state.time;
+  delta_t = state.delta_t;
+  nu = target_nu = state.nu;
+  time_error_old = state.time_error_old;
+  time_step_number = state.time_step_number;
+  apply_first = state.apply_first;
+  n_accepted_steps = state.n_accepted_steps;
+  n_rejected_steps = state.n_rejected_steps;
+  lift_index = state.lift_index;
+  drag_index = state.drag_index;
+
+  pcout << "  Time step " << time_step_number << ", t = " << std::fixed
+        << std::setprecision(5) << time << ", dt = " << std::scientific
+        << std::setprecision(3) << delta_t << std::endl;
+  pcout << "  Shedding cycles completed = "
+        << periodicity_monitor.n_completed_cycles() << std::endl;
+  pcout << "===============================================" << std::endl;
+}
+
+template <int dim>
+void NSSolver<dim>::load_initial_condition()
+{
+  pcout << "Initial condition read from " << initial_condition_file_name
+        << std::endl;
+
+  std::vector<char> metadata;
+  CellwiseVectorIO::read_header(
+      initial_condition_file_name, dof_handler, metadata, mpi_comm);
+
+  CellwiseVectorIO::StationarySolutionState state;
+  AssertThrow(metadata.size() == sizeof(state) &&
+                  std::memcmp(metadata.data(),
+                              CellwiseVectorIO::stationary_solution_magic,
+                              sizeof(state.magic)) == 0,
+              ExcMessage(initial_condition_file_name +
+                         " is not a solution of the stationary solver."));
+  std::memcpy(&state, metadata.data(), sizeof(state));
+
+  LA::MPI::BlockVector owned(block_owned_dofs, mpi_comm);
+  CellwiseVectorIO::read(initial_condition_file_name,
+                         dof_handler,
+                         std::vector<LA::MPI::BlockVector *>{&owned},
+                         mpi_comm);
+
+  // The stationary solver may reach a different inlet velocity: scale the
+  // velocity so that it matches the inlet condition, which is then kept by
+  // the time stepping. The pressure is only an initial guess for the first
+  // step, so it is left as is.
+  if (state.inlet_velocity > 0.0)
+    owned.block(0) *= inlet_velocity.U_m / state.inlet_velocity;
+
+  if (std::abs(state.nu - target_nu) > 1e-12 * target_nu)
+    pcout << "  Warning: the file was computed with nu = " << state.nu
+          << ", this problem has nu = " << target_nu << std::endl;
+
+  // Add the perturbation, which is zero on the walls, on the inlet and on
+  // the cylinder so as not to alter the boundary conditions.
+  if (perturbation_amplitude != 0.0)
+  {
+    InitialPerturbation perturbation(perturbation_amplitude * inlet_velocity.U_m);
+    LA::MPI::BlockVector perturbation_owned(block_owned_dofs, mpi_comm);
+    VectorTools::interpolate(*mapping, dof_handler, perturbation, perturbation_owned);
+
+    std::map<types::global_dof_index, double> boundary_values;
+    Functions::ZeroFunction<dim> zero_function(dim + 1);
+    for (const types::boundary_id id : {6, 7, 10})
+      VectorTools::interpolate_boundary_values(*mapping,
+                                               dof_handler,
+                                               id,
+                                               zero_function,
+                                               boundary_values,
+                                               fe->component_mask(
+                                                   FEValuesExtractors::Vector(0)));
+    for (const auto &[dof, value] : boundary_values)
+      if (locally_owned_dofs.is_element(dof))
+        perturbation_owned(dof) = value;
+    perturbation_owned.compress(VectorOperation::insert);
+
+    owned += perturbation_owned;
+
+    pcout << "  Perturbation of amplitude " << perturbation_amplitude
+          << " U_m added" << std::endl;
+  }
+
+  solution_owned = owned;
+  solution = solution_owned;
+
+  // The inlet velocity is already imposed.
+  apply_first = false;
+}
+
+// The class is instantiated in NSSolver.cpp, only the member functions
+// defined here are instantiated in this file.
+template void NSSolver<2>::save_checkpoint(const std::string &) const;
+template void NSSolver<2>::load_checkpoint(const std::string &);
+template void NSSolver<2>::load_initial_condition();
+template void NSSolver<3>::save_checkpoint(const std::string &) const;
+template void NSSolver<3>::load_checkpoint(const std::string &);
+template void NSSolver<3>::load_initial_condition();
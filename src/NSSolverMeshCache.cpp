@@ -0,0 +1,371 @@
+#include "NSSolver.hpp"
+
+#include <deal.II/lac/dynamic_sparsity_pattern.h>
+#include <deal.II/lac/sparsity_tools.h>
+
+#include <boost/serialization/vector.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+// The mesh cache stores, for each process, the description of its part of
+// the distributed mesh (locally owned and ghost cells, with their vertices,
+// boundary and material ids), which is all that is needed to build the
+// fully distributed triangulation without generating or reading the serial
+// mesh and partitioning it again. It also stores the final numbering of the
+// DoFs owned by the process and the locally owned rows of the sparsity
+// patterns of the Jacobian and of the pressure mass matrix, so that a warm
+// run neither recomputes the DoF ordering nor loops over the cells to build
+// the patterns, which it only needs to exchange with the other processes.
+//
+// The DoFs distributed by the DoFHandler on the same mesh have the same
+// numbers on every run, so the final numbers are stored in that order and
+// applied with DoFHandler::renumber_dofs(). The record of each process is
+// written once the DoFs are set up, at the end of the cold setup.
+//
+// The file starts with a fixed-size header holding the key of the mesh (its
+// source, the finite element degrees and the number of processes), followed
+// by the size of the record of each process and by the records, in order of
+// rank. A cache with a different key is ignored and overwritten.
+
+namespace
+{
+  struct MeshCacheHeader
+  {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t n_processes;
+    char key[240];
+  };
+
+  constexpr char mesh_cache_magic[8] = "NSMESHC";
+  constexpr std::uint32_t mesh_cache_version = 2;
+}
+
+template <int dim>
+std::string NSSolver<dim>::mesh_cache_key() const
+{
+  // The same options give a different mesh in 2D and 3D. The key of a mesh
+  // read from file includes its size and modification
+  // time, so that the cache is rebuilt if the file changes. Only the first
+  // process looks at the file.
+  std::string source;
+  if (read_mesh_from_file)
+  {
+    if (mpi_rank == 0)
+    {
+      const std::filesystem::path path(mesh_file_name);
+      source = path.filename().string();
+      if (std::filesystem::exists(path))
+        source += "-" + std::to_string(std::filesystem::file_size(path)) + "-" +
+                  std::to_string(std::filesystem::last_write_time(path)
+                                     .time_since_epoch()
+                                     .count());
+    }
+    source = Utilities::MPI::broadcast(mpi_comm, source, 0);
+  }
+  else if (cylinder_mesh)
+    source = "cylinder-" + CylinderMesh::parameters_to_string(
+                               cylinder_mesh_parameters);
+  else
+    source = std::to_string(mesh_size_x) + "x" + std::to_string(mesh_size_y);
+
+  // The partitioning options change the cells owned by each process.
+  std::string partitioning;
+  if (outlet_face_weight > 0.0 || cylinder_face_weight > 0.0)
+    partitioning += "-w" + std::to_string(outlet_face_weight) + "," +
+                    std::to_string(cylinder_face_weight);
+  if (partition_minimize_communication)
+    partitioning += "-vertex";
+
+  // The DoF numbering also depends on the ordering.
+  return std::to_string(dim) + "d-" + source + "-q" +
+         std::to_string(degree_velocity) + "-" +
+         std::to_string(degree_pressure) + partitioning + "-" +
+         dof_ordering_to_string(dof_ordering) + "-np" +
+         std::to_string(mpi_size);
+}
+
+template <int dim>
+std::string NSSolver<dim>::mesh_cache_file_name() const
+{
+  std::string stem;
+  if (read_mesh_from_file)
+    stem = std::filesystem::path(mesh_file_name).stem().string();
+  else if (cylinder_mesh)
+    stem = "cylinder-" + std::to_string(cylinder_mesh_parameters.n_cylinder) +
+           "x" + std::to_string(cylinder_mesh_parameters.n_wall) + "x" +
+           std::to_string(cylinder_mesh_parameters.n_inlet);
+  else
+    stem = std::to_string(mesh_size_x) + "x" + std::to_string(mesh_size_y);
+
+  return (std::filesystem::path(mesh_cache_directory) /
+          ("mesh-" + std::to_string(dim) + "d-" + stem + "-np" +
+           std::to_string(mpi_size) + ".cache"))
+      .string();
+}
+
+template <int dim>
+bool NSSolver<dim>::read_mesh_cache(const std::string &file_name,
+                                    MeshCacheRecord &record) const
+{
+  MPI_File file;
+  int ierr = MPI_File_open(
+      mpi_comm, file_name.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+  if (ierr != MPI_SUCCESS)
+    return false;
+
+  // All the processes read the same header, so they all take the same
+  // decision.
+  MeshCacheHeader header;
+  ierr = MPI_File_read_at(
+      file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+  AssertThrowMPI(ierr);
+
+  const std::string key = mesh_cache_key();
+  header.key[sizeof(header.key) - 1] = '\0';
+  if (std::memcmp(header.magic, mesh_cache_magic, sizeof(header.magic)) != 0 ||
+      header.version != mesh_cache_version ||
+      header.n_processes != mpi_size || key != header.key)
+  {
+    MPI_File_close(&file);
+    pcout << "  Mesh cache " << file_name << " is out of date" << std::endl;
+    return false;
+  }
+
+  std::vector<std::uint64_t> record_sizes(mpi_size);
+  ierr = MPI_File_read_at(file,
+                          sizeof(header),
+                          record_sizes.data(),
+                          mpi_size * sizeof(std::uint64_t),
+                          MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+  AssertThrowMPI(ierr);
+
+  MPI_Offset offset = sizeof(header) + mpi_size * sizeof(std::uint64_t);
+  for (unsigned int p = 0; p < mpi_rank; ++p)
+    offset += record_sizes[p];
+
+  std::vector<char> buffer(record_sizes[mpi_rank]);
+  ierr = MPI_File_read_at_all(file,
+                              offset,
+                              buffer.data(),
+                              buffer.size(),
+                              MPI_BYTE,
+                              MPI_STATUS_IGNORE);
+  AssertThrowMPI(ierr);
+
+  ierr = MPI_File_close(&file);
+  AssertThrowMPI(ierr);
+
+  record = Utilities::unpack<MeshCacheRecord>(buffer);
+
+  return true;
+}
+
+template <int dim>
+void NSSolver<dim>::write_mesh_cache(const std::string &file_name,
+                                     const MeshCacheRecord &record) const
+{
+  if (mpi_rank == 0)
+    std::filesystem::create_directories(
+        std::filesystem::path(file_name).parent_path());
+  MPI_Barrier(mpi_comm);
+
+  const std::vector<char> buffer = Utilities::pack(record);
+
+  const std::uint64_t record_size = buffer.size();
+  std::vector<std::uint64_t> record_sizes(mpi_size);
+  int ierr = MPI_Allgather(&record_size,
+                           1,
+                           MPI_UINT64_T,
+                           record_sizes.data(),
+                           1,
+                           MPI_UINT64_T,
+                           mpi_comm);
+  AssertThrowMPI(ierr);
+
+  MeshCacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, mesh_cache_magic, sizeof(header.magic));
+  header.version = mesh_cache_version;
+  header.n_processes = mpi_size;
+  std::strncpy(header.key, mesh_cache_key().c_str(), sizeof(header.key) - 1);
+
+  // Write to a temporary file, so that an interrupted run does not leave a
+  // truncated cache behind.
+  const std::string tmp_file_name = file_name + ".tmp";
+
+  MPI_File file;
+  ierr = MPI_File_open(mpi_comm,
+                       tmp_file_name.c_str(),
+                       MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                       MPI_INFO_NULL,
+                       &file);
+  AssertThrow(ierr == MPI_SUCCESS,
+              ExcMessage("Could not open " + tmp_file_name + " for writing."));
+  ierr = MPI_File_set_size(file, 0);
+  AssertThrowMPI(ierr);
+
+  if (mpi_rank == 0)
+  {
+    ierr = MPI_File_write_at(
+        file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    AssertThrowMPI(ierr);
+    ierr = MPI_File_write_at(file,
+                             sizeof(header),
+                             record_sizes.data(),
+                             mpi_size * sizeof(std::uint64_t),
+                             MPI_BYTE,
+                             MPI_STATUS_IGNORE);
+    AssertThrowMPI(ierr);
+  }
+
+  MPI_Offset offset = sizeof(header) + mpi_size * sizeof(std::uint64_t);
+  for (unsigned int p = 0; p < mpi_rank; ++p)
+    offset += record_sizes[p];
+
+  ierr = MPI_File_write_at_all(file,
+                               offset,
+                               buffer.data(),
+                               buffer.size(),
+                               MPI_BYTE,
+                               MPI_STATUS_IGNORE);
+  AssertThrowMPI(ierr);
+
+  ierr = MPI_File_close(&file);
+  AssertThrowMPI(ierr);
+
+  if (mpi_rank == 0)
+    AssertThrow(std::rename(tmp_file_name.c_str(), file_name.c_str()) == 0,
+                ExcMessage("Could not write the mesh cache " + file_name));
+
+  pcout << "  Mesh cache written to " << file_name << std::endl;
+}
+
+template <int dim>
+std::vector<types::global_dof_index>
+NSSolver<dim>::locally_owned_cell_dof_indices() const
+{
+  std::vector<types::global_dof_index> cell_dof_indices;
+  std::vector<types::global_dof_index> dof_indices(fe->dofs_per_cell);
+  for (const auto &cell : dof_handler.active_cell_iterators())
+    if (cell->is_locally_owned())
+    {
+      cell->get_dof_indices(dof_indices);
+      cell_dof_indices.insert(cell_dof_indices.end(),
+                              dof_indices.begin(),
+                              dof_indices.end());
+    }
+  return cell_dof_indices;
+}
+
+template <int dim>
+void NSSolver<dim>::cache_dof_numbers(
+    const IndexSet &initial_owned_dofs,
+    const std::vector<types::global_dof_index> &initial_cell_dof_indices)
+{
+  // The renumbering does not change the owner of a DoF, and each owned DoF
+  // belongs to a locally owned cell: the cells give the new number of each
+  // old one.
+  const std::vector<types::global_dof_index> cell_dof_indices =
+      locally_owned_cell_dof_indices();
+  AssertDimension(cell_dof_indices.size(), initial_cell_dof_indices.size());
+
+  std::vector<types::global_dof_index> &dof_numbers =
+      mesh_cache_record->dof_numbers;
+  dof_numbers.assign(initial_owned_dofs.n_elements(),
+                     numbers::invalid_dof_index);
+  for (unsigned int k = 0; k < cell_dof_indices.size(); ++k)
+    if (initial_owned_dofs.is_element(initial_cell_dof_indices[k]))
+      dof_numbers[initial_owned_dofs.index_within_set(
+          initial_cell_dof_indices[k])] = cell_dof_indices[k];
+}
+
+template <int dim>
+void NSSolver<dim>::cache_sparsity_pattern(
+    const Table<2, DoFTools::Coupling> &coupling,
+    CachedSparsityPattern &cached) const
+{
+  // The rows of the ghost DoFs are sent to their owners, as the Trilinos
+  // pattern does when it is compressed.
+  DynamicSparsityPattern dsp(locally_relevant_dofs);
+  DoFTools::make_sparsity_pattern(
+      dof_handler, coupling, dsp, hanging_node_constraints, false);
+  SparsityTools::distribute_sparsity_pattern(dsp,
+                                             locally_owned_dofs,
+                                             mpi_comm,
+                                             locally_relevant_dofs);
+
+  cached.row_starts.assign(1, 0);
+  cached.columns.clear();
+  for (const auto row : locally_owned_dofs)
+  {
+    for (auto entry = dsp.begin(row); entry != dsp.end(row); ++entry)
+      cached.columns.push_back(entry->column());
+    cached.row_starts.push_back(cached.columns.size());
+  }
+}
+
+template <int dim>
+void NSSolver<dim>::add_cached_sparsity_pattern(
+    const CachedSparsityPattern &cached,
+    LA::BlockSparsityPattern &sparsity) const
+{
+  AssertThrow(cached.row_starts.size() == locally_owned_dofs.n_elements() + 1,
+              ExcMessage("The cached sparsity pattern does not match the "
+                         "DoFs of this process."));
+
+  unsigned int k = 0;
+  for (const auto row : locally_owned_dofs)
+  {
+    sparsity.add_entries(row,
+                         cached.columns.begin() + cached.row_starts[k],
+                         cached.columns.begin() + cached.row_starts[k + 1],
+                         true);
+    ++k;
+  }
+}
+
+// The class is instantiated in NSSolver.cpp, only the member functions
+// defined here are instantiated in this file.
+template std::string NSSolver<2>::mesh_cache_key() const;
+template std::string NSSolver<2>::mesh_cache_file_name() const;
+template bool NSSolver<2>::read_mesh_cache(
+    const std::string &,
+    NSSolver<2>::MeshCacheRecord &) const;
+template void NSSolver<2>::write_mesh_cache(
+    const std::string &,
+    const NSSolver<2>::MeshCacheRecord &) const;
+template std::vector<types::global_dof_index>
+NSSolver<2>::locally_owned_cell_dof_indices() const;
+template void NSSolver<2>::cache_dof_numbers(
+    const IndexSet &,
+    const std::vector<types::global_dof_index> &);
+template void NSSolver<2>::cache_sparsity_pattern(
+    const Table<2, DoFTools::Coupling> &,
+    NSSolver<2>::CachedSparsityPattern &) const;
+template void NSSolver<2>::add_cached_sparsity_pattern(
+    const NSSolver<2>::CachedSparsityPattern &,
+    LA::BlockSparsityPattern &) const;
+template std::string NSSolver<3>::mesh_cache_key() const;
+template std::string NSSolver<3>::mesh_cache_file_name() const;
+template bool NSSolver<3>::read_mesh_cache(
+    const std::string &,
+    NSSolver<3>::MeshCacheRecord &) const;
+template void NSSolver<3>::write_mesh_cache(
+    const std::string &,
+    const NSSolver<3>::MeshCacheRecord &) const;
+template std::vector<types::global_dof_index>
+NSSolver<3>::locally_owned_cell_dof_indices() const;
+template void NSSolver<3>::cache_dof_numbers(
+    const IndexSet &,
+    const std::vector<types::global_dof_index> &);
+template void NSSolver<3>::cache_sparsity_pattern(
+    const Table<2, DoFTools::Coupling> &,
+    NSSolver<3>::CachedSparsityPattern &) const;
+template void NSSolver<3>::add_cached_sparsity_pattern(
+    const NSSolver<3>::CachedSparsityPattern &,
+    LA::BlockSparsityPattern &) const;
@@ -0,0 +1,517 @@
+#include "NSSolver.hpp"
+
+// Incremental pressure-correction scheme in rotational form. Given the BDF
+// coefficients a_k of the step (see update_time_derivative()), the
+// extrapolated velocity u* and the last pressure p_n, each step solves
+//
+//   1. a_0 u_tilde + (u* . nabla) u_tilde - nu Delta u_tilde
+//        = - sum_{k>=1} a_k u_{n+1-k} - grad p_n,
+//      with the Dirichlet conditions of the velocity and the outlet pressure
+//      imposed weakly as in the coupled problem;
+//   2. - Delta phi = - a_0 div u_tilde, with phi = 0 on the outlet and
+//      homogeneous Neumann conditions elsewhere;
+//   3. u_{n+1} = u_tilde - 1 / a_0 grad phi, as an L2 projection;
+//   4. p_{n+1} = p_n + phi - nu div u_tilde, as an L2 projection.
+//
+// The velocity problem is non-symmetric but decoupled from the pressure, and
+// is solved with GMRES and AMG; the other three are symmetric positive
+// definite and are solved with CG. The solution is stored in the same
+// FESystem vectors as the coupled solver, so that the output and the lift and
+// drag computation are shared.
+
+template <int dim>
+void NSSolver<dim>::assemble_projection_matrices()
+{
+#ifdef NS_USE_TPETRA
+  throw std::invalid_argument("The pressure-correction scheme is not available with the Tpetra backend.");
+#else
+  pcout << "===============================================" << std::endl;
+  pcout << "Assembling the pressure-correction matrices" << std::endl;
+
+  const unsigned int dofs_per_cell = fe->dofs_per_cell;
+  const unsigned int n_q = quadrature->size();
+
+  FEValues<dim> fe_values(*mapping,
+                          *fe,
+                          *quadrature,
+                          update_values | update_gradients | update_JxW_values);
+
+  FullMatrix<double> cell_velocity_mass(dofs_per_cell, dofs_per_cell);
+  FullMatrix<double> cell_pressure_mass(dofs_per_cell, dofs_per_cell);
+  FullMatrix<double> cell_pressure_laplace(dofs_per_cell, dofs_per_cell);
+
+  std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+
+  FEValuesExtractors::Vector velocity(0);
+  FEValuesExtractors::Scalar pressure(dim);
+
+  velocity_mass = 0.0;
+  pressure_mass = 0.0;
+  pressure_laplace = 0.0;
+
+  for (const auto &cell : dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    fe_values.reinit(cell);
+
+    cell_velocity_mass = 0.0;
+    cell_pressure_mass = 0.0;
+    cell_pressure_laplace = 0.0;
+
+    for (unsigned int q = 0; q < n_q; ++q)
+    {
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        const bool velocity_i = fe->system_to_component_index(i).first < dim;
+
+        for (unsigned int j = 0; j < dofs_per_cell; ++j)
+        {
+          const bool velocity_j = fe->system_to_component_index(j).first < dim;
+
+          if (velocity_i && velocity_j)
+          {
+            cell_velocity_mass(i, j) += fe_values[velocity].value(j, q) *
+                                        fe_values[velocity].value(i, q) *
+                                        fe_values.JxW(q);
+          }
+          else if (!velocity_i && !velocity_j)
+          {
+            // scaled by 1 / nu as in the coupled solver, so that the
+            // projection of div u_tilde is multiplied by nu
+            cell_pressure_mass(i, j) += fe_values[pressure].value(j, q) *
+                                        fe_values[pressure].value(i, q) /
+                                        nu * fe_values.JxW(q);
+
+            cell_pressure_laplace(i, j) +=
+                fe_values[pressure].gradient(j, q) *
+                fe_values[pressure].gradient(i, q) * fe_values.JxW(q);
+          }
+        }
+      }
+    }
+
+    cell->get_dof_indices(dof_indices);
+    velocity_mass.add(dof_indices, cell_velocity_mass);
+    pressure_mass.add(dof_indices, cell_pressure_mass);
+    pressure_laplace.add(dof_indices, cell_pressure_laplace);
+  }
+
+  velocity_mass.compress(VectorOperation::add);
+  pressure_mass.compress(VectorOperation::add);
+  pressure_laplace.compress(VectorOperation::add);
+
+  // Boundary conditions. They only modify the rows of the constrained DoFs,
+  // so that applying them again at every step only sets the right-hand side.
+  {
+    Functions::ZeroFunction<dim> zero_function(dim + 1);
+    std::map<types::global_dof_index, double> boundary_values;
+    std::map<types::boundary_id, const Function<dim> *> boundary_functions;
+
+    boundary_functions[6] = &zero_function;
+    boundary_functions[7] = &inlet_velocity;
+    boundary_functions[10] = &zero_function;
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
+                                             boundary_functions,
+                                             boundary_values,
+                                             fe->component_mask(
+                                                 FEValuesExtractors::Vector(0)));
+    MatrixTools::apply_boundary_values(
+        boundary_values, velocity_mass, solution_owned, residual_vector, false);
+
+    boundary_values.clear();
+    boundary_functions.clear();
+    boundary_functions[outlet_boundary_id] = &zero_function;
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
+                                             boundary_functions,
+                                             boundary_values,
+                                             fe->component_mask(
+                                                 FEValuesExtractors::Scalar(dim)));
+    MatrixTools::apply_boundary_values(
+        boundary_values, pressure_laplace, delta_owned, residual_vector, false);
+  }
+
+  LA::PreconditionAMG::AdditionalData amg_data;
+  amg_data.elliptic = true;
+  amg_data.higher_order_elements = true;
+  preconditioner_projection_pressure.initialize(pressure_laplace.block(1, 1),
+                                                amg_data);
+
+  preconditioner_velocity_mass.initialize(velocity_mass.block(0, 0));
+  preconditioner_pressure_mass.initialize(pressure_mass.block(1, 1));
+
+  pcout << "===============================================" << std::endl;
+#endif
+}
+
+template <int dim>
+void NSSolver<dim>::assemble_projection_velocity()
+{
+  const unsigned int dofs_per_cell = fe->dofs_per_cell;
+  const unsigned int n_q = quadrature->size();
+  const unsigned int n_q_face = quadrature_face->size();
+
+  FEValues<dim> fe_values(*mapping,
+                          *fe,
+                          *quadrature,
+                          update_values | update_gradients | update_JxW_values);
+
+  FullMatrix<double> cell_matrix(dofs_per_cell, dofs_per_cell);
+  Vector<double> cell_rhs(dofs_per_cell);
+
+  std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+
+  FEValuesExtractors::Vector velocity(0);
+  FEValuesExtractors::Scalar pressure(dim);
+
+  std::vector<Tensor<1, dim>> velocity_history_loc(n_q);
+  std::vector<Tensor<1, dim>> convection_loc(n_q);
+  std::vector<double> pressure_loc(n_q);
+
+  jacobian_matrix = 0.0;
+  residual_vector = 0.0;
+
+  ++n_assemblies;
+  Timer timer;
+
+  for (const auto &cell : dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    ++n_cells_assembled;
+
+    fe_values.reinit(cell);
+
+    cell_matrix = 0.0;
+    cell_rhs = 0.0;
+
+    fe_values[velocity].get_function_values(bdf_history_term,
+                                            velocity_history_loc);
+    fe_values[velocity].get_function_values(convection_velocity,
+                                            convection_loc);
+    fe_values[pressure].get_function_values(solution, pressure_loc);
+
+    for (unsigned int q = 0; q < n_q; ++q)
+    {
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        if (fe->system_to_component_index(i).first >= dim)
+          continue;
+
+        for (unsigned int j = 0; j < dofs_per_cell; ++j)
+        {
+          if (fe->system_to_component_index(j).first >= dim)
+            continue;
+
+          // time dependent term
+          cell_matrix(i, j) += bdf_coefficients[0] *
+                               fe_values[velocity].value(j, q) *
+                               fe_values[velocity].value(i, q) *
+                               fe_values.JxW(q);
+
+          // viscosity
+          cell_matrix(i, j) +=
+              nu *
+              scalar_product(fe_values[velocity].gradient(j, q),
+                             fe_values[velocity].gradient(i, q)) *
+              fe_values.JxW(q);
+
+          // convection (u* . nabla) u_tilde
+          cell_matrix(i, j) += (fe_values[velocity].gradient(j, q) *
+                                convection_loc[q]) *
+                               fe_values[velocity].value(i, q) *
+                               fe_values.JxW(q);
+        }
+
+        // previous solutions in the BDF formula
+        cell_rhs(i) -= velocity_history_loc[q] *
+                       fe_values[velocity].value(i, q) * fe_values.JxW(q);
+
+        // pressure at the previous step, (p_n, div v)
+        cell_rhs(i) += pressure_loc[q] * fe_values[velocity].divergence(i, q) *
+                       fe_values.JxW(q);
+      }
+    }
+
+    cell->get_dof_indices(dof_indices);
+    jacobian_matrix.add(dof_indices, cell_matrix);
+    residual_vector.add(dof_indices, cell_rhs);
+  }
+
+  // Outlet pressure, as in the coupled problem.
+  for (const auto &face : boundary_faces[outlet_boundary_id])
+  {
+    if (!face.locally_owned)
+      continue;
+
+    cell_rhs = 0.0;
+    for (unsigned int q = 0; q < n_q_face; ++q)
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        cell_rhs(i) -=
+            p_out *
+            scalar_product(face.normals[q],
+                           face.velocity_values[q * dofs_per_cell + i]) *
+            face.JxW[q];
+
+    residual_vector.add(face.dof_indices, cell_rhs);
+  }
+
+  timer.stop();
+  time_assembly_cells += timer.wall_time();
+
+  timer.restart();
+  jacobian_matrix.compress(VectorOperation::add);
+  residual_vector.compress(VectorOperation::add);
+  timer.stop();
+  time_assembly_compress += timer.wall_time();
+
+  // Dirichlet boundary conditions on u_tilde.
+  {
+    Functions::ZeroFunction<dim> zero_function(dim + 1);
+    std::map<types::global_dof_index, double> boundary_values;
+    std::map<types::boundary_id, const Function<dim> *> boundary_functions;
+
+    boundary_functions[6] = &zero_function;
+    boundary_functions[7] = &inlet_velocity;
+    boundary_functions[10] = &zero_function;
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
+                                             boundary_functions,
+                                             boundary_values,
+                                             fe->component_mask(
+                                                 FEValuesExtractors::Vector(0)));
+
+#ifdef NS_USE_TPETRA
+    (void)boundary_values;
+#else
+    MatrixTools::apply_boundary_values(
+        boundary_values, jacobian_matrix, solution_owned, residual_vector, false);
+#endif
+  }
+}
+
+template <int dim>
+void NSSolver<dim>::assemble_projection_divergence()
+{
+  const unsigned int dofs_per_cell = fe->dofs_per_cell;
+  const unsigned int n_q = quadrature->size();
+
+  FEValues<dim> fe_values(*mapping,
+                          *fe,
+                          *quadrature,
+                          update_values | update_gradients | update_JxW_values);
+
+  Vector<double> cell_rhs(dofs_per_cell);
+  std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+
+  FEValuesExtractors::Vector velocity(0);
+  FEValuesExtractors::Scalar pressure(dim);
+
+  std::vector<double> divergence_loc(n_q);
+
+  residual_vector = 0.0;
+
+  for (const auto &cell : dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    fe_values.reinit(cell);
+    cell_rhs = 0.0;
+
+    fe_values[velocity].get_function_divergences(solution, divergence_loc);
+
+    for (unsigned int q = 0; q < n_q; ++q)
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        cell_rhs(i) += divergence_loc[q] * fe_values[pressure].value(i, q) *
+                       fe_values.JxW(q);
+
+    cell->get_dof_indices(dof_indices);
+    residual_vector.add(dof_indices, cell_rhs);
+  }
+
+  residual_vector.compress(VectorOperation::add);
+}
+
+template <int dim>
+void NSSolver<dim>::assemble_projection_update()
+{
+  const unsigned int dofs_per_cell = fe->dofs_per_cell;
+  const unsigned int n_q = quadrature->size();
+
+  FEValues<dim> fe_values(*mapping,
+                          *fe,
+                          *quadrature,
+                          update_values | update_gradients | update_JxW_values);
+
+  Vector<double> cell_rhs(dofs_per_cell);
+  std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+
+  FEValuesExtractors::Vector velocity(0);
+  FEValuesExtractors::Scalar pressure(dim);
+
+  std::vector<Tensor<1, dim>> velocity_loc(n_q);
+  std::vector<Tensor<1, dim>> phi_gradient_loc(n_q);
+
+  residual_vector = 0.0;
+
+  for (const auto &cell : dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    fe_values.reinit(cell);
+    cell_rhs = 0.0;
+
+    fe_values[velocity].get_function_values(solution, velocity_loc);
+    fe_values[pressure].get_function_gradients(pressure_increment,
+                                               phi_gradient_loc);
+
+    for (unsigned int q = 0; q < n_q; ++q)
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        cell_rhs(i) += (velocity_loc[q] -
+                        phi_gradient_loc[q] / bdf_coefficients[0]) *
+                       fe_values[velocity].value(i, q) * fe_values.JxW(q);
+
+    cell->get_dof_indices(dof_indices);
+    residual_vector.add(dof_indices, cell_rhs);
+  }
+
+  residual_vector.compress(VectorOperation::add);
+}
+
+template <int dim>
+void NSSolver<dim>::solve_projection_step()
+{
+#ifdef NS_USE_TPETRA
+  throw std::invalid_argument("The pressure-correction scheme is not available with the Tpetra backend.");
+#else
+  pcout << "===============================================" << std::endl;
+
+  // 1. Advection-diffusion problem for u_tilde, stored in the velocity block
+  // of the solution; the pressure block still holds p_n.
+  solution_owned = solution;
+  assemble_projection_velocity();
+  {
+    LA::PreconditionAMG::AdditionalData amg_data;
+    amg_data.elliptic = false;
+    amg_data.higher_order_elements = true;
+    amg_data.smoother_sweeps = 2;
+    preconditioner_projection_velocity.initialize(jacobian_matrix.block(0, 0),
+                                                  amg_data);
+
+    SolverControl solver_control(10000,
+                                 tolerance * residual_vector.block(0).l2_norm());
+    SolverGMRES<LA::MPI::Vector> solver(solver_control);
+    solver.solve(jacobian_matrix.block(0, 0),
+                 solution_owned.block(0),
+                 residual_vector.block(0),
+                 preconditioner_projection_velocity);
+    pcout << "  Velocity:        " << solver_control.last_step()
+          << " GMRES iterations" << std::endl;
+  }
+  solution = solution_owned;
+
+  // 2. Poisson problem for the pressure increment phi, with the right-hand
+  // side -a_0 (div u_tilde, q).
+  assemble_projection_divergence();
+  LA::MPI::Vector divergence(block_owned_dofs[1], mpi_comm);
+  divergence = residual_vector.block(1);
+  {
+    residual_vector.block(1) *= -bdf_coefficients[0];
+
+    // only sets the right-hand side on the outlet, the rows of the matrix
+    // have been modified in assemble_projection_matrices()
+    Functions::ZeroFunction<dim> zero_function(dim + 1);
+    std::map<types::global_dof_index, double> boundary_values;
+    std::map<types::boundary_id, const Function<dim> *> boundary_functions;
+    boundary_functions[outlet_boundary_id] = &zero_function;
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
+                                             boundary_functions,
+                                             boundary_values,
+                                             fe->component_mask(
+                                                 FEValuesExtractors::Scalar(dim)));
+    delta_owned = 0.0;
+    MatrixTools::apply_boundary_values(
+        boundary_values, pressure_laplace, delta_owned, residual_vector, false);
+
+    SolverControl solver_control(10000,
+                                 tolerance * residual_vector.block(1).l2_norm());
+    SolverCG<LA::MPI::Vector> solver(solver_control);
+    solver.solve(pressure_laplace.block(1, 1),
+                 delta_owned.block(1),
+                 residual_vector.block(1),
+                 preconditioner_projection_pressure);
+    pcout << "  Pressure:        " << solver_control.last_step()
+          << " CG iterations" << std::endl;
+  }
+  pressure_increment = delta_owned;
+
+  // 3. Velocity update, u_{n+1} = u_tilde - 1 / a_0 grad phi.
+  assemble_projection_update();
+  {
+    Functions::ZeroFunction<dim> zero_function(dim + 1);
+    std::map<types::global_dof_index, double> boundary_values;
+    std::map<types::boundary_id, const Function<dim> *> boundary_functions;
+    boundary_functions[6] = &zero_function;
+    boundary_functions[7] = &inlet_velocity;
+    boundary_functions[10] = &zero_function;
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
+                                             boundary_functions,
+                                             boundary_values,
+                                             fe->component_mask(
+                                                 FEValuesExtractors::Vector(0)));
+    MatrixTools::apply_boundary_values(
+        boundary_values, velocity_mass, solution_owned, residual_vector, false);
+
+    SolverControl solver_control(10000,
+                                 tolerance * residual_vector.block(0).l2_norm());
+    SolverCG<LA::MPI::Vector> solver(solver_control);
+    solver.solve(velocity_mass.block(0, 0),
+                 solution_owned.block(0),
+                 residual_vector.block(0),
+                 preconditioner_velocity_mass);
+    pcout << "  Velocity update: " << solver_control.last_step()
+          << " CG iterations" << std::endl;
+  }
+
+  // 4. Pressure update in rotational form, p_{n+1} = p_n + phi - nu div
+  // u_tilde. The pressure mass matrix is scaled by 1 / nu, so that solving
+  // it with (div u_tilde, q) directly gives nu times the projection.
+  {
+    LA::MPI::Vector rotational_term(block_owned_dofs[1], mpi_comm);
+    SolverControl solver_control(10000, tolerance * divergence.l2_norm());
+    SolverCG<LA::MPI::Vector> solver(solver_control);
+    solver.solve(pressure_mass.block(1, 1),
+                 rotational_term,
+                 divergence,
+                 preconditioner_pressure_mass);
+    pcout << "  Pressure update: " << solver_control.last_step()
+          << " CG iterations" << std::endl;
+
+    solution_owned.block(1).add(1.0, delta_owned.block(1), -1.0, rotational_term);
+  }
+  solution = solution_owned;
+
+  pcout << "===============================================" << std::endl;
+#endif
+}
+
+// The class is instantiated in NSSolver.cpp, only the member functions
+// defined here are instantiated in this file.
+template void NSSolver<2>::assemble_projection_matrices();
+template void NSSolver<2>::assemble_projection_velocity();
+template void NSSolver<2>::assemble_projection_divergence();
+template void NSSolver<2>::assemble_projection_update();
+template void NSSolver<2>::solve_projection_step();
+template void NSSolver<3>::assemble_projection_matrices();
+template void NSSolver<3>::assemble_projection_velocity();
+template void NSSolver<3>::assemble_projection_divergence();
+template void NSSolver<3>::assemble_projection_update();
+template void NSSolver<3>::solve_projection_step();
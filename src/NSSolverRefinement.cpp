@@ -0,0 +1,113 @@
+#include "NSSolver.hpp"
+
+#include <deal.II/distributed/grid_refinement.h>
+#include <deal.II/distributed/solution_transfer.h>
+
+#include <deal.II/numerics/error_estimator.h>
+
+// Adaptive refinement of the mesh during the time stepping. The Kelly
+// indicator of the velocity (the jump of its normal derivative across the
+// faces) concentrates the cells around the cylinder and in the wake, where
+// the drag and lift are determined. The mesh is a
+// parallel::distributed::Triangulation, which p4est rebalances among the
+// processes after each adaptation.
+
+template <int dim>
+void NSSolver<dim>::refine_mesh()
+{
+#ifdef NS_USE_TPETRA
+  AssertThrow(false,
+              ExcMessage("Adaptive refinement is not available with the "
+                         "Tpetra backend."));
+#else
+  Timer timer;
+
+  pcout << "===============================================" << std::endl;
+  pcout << "Adapting the mesh" << std::endl;
+
+  // Error indicators.
+  Vector<float> estimated_error_per_cell(mesh_adaptive.n_active_cells());
+  const FEValuesExtractors::Vector velocity(0);
+  KellyErrorEstimator<dim>::estimate(*mapping,
+                                     dof_handler,
+                                     QGauss<dim - 1>(fe->degree + 1),
+                                     {},
+                                     solution,
+                                     estimated_error_per_cell,
+                                     fe->component_mask(velocity),
+                                     nullptr,
+                                     0,
+                                     mesh_adaptive.locally_owned_subdomain());
+
+  parallel::distributed::GridRefinement::refine_and_coarsen_fixed_number(
+      mesh_adaptive, estimated_error_per_cell, refine_fraction, coarsen_fraction);
+
+  // Do not refine beyond the maximum level.
+  for (const auto &cell : mesh_adaptive.active_cell_iterators())
+    if (cell->is_locally_owned() &&
+        cell->level() >= static_cast<int>(max_refinement_level))
+      cell->clear_refine_flag();
+
+  // Solutions to transfer: the current one and the history used by BDF and
+  // by the time step control. They must have ghost entries.
+  std::vector<LA::MPI::BlockVector> old_vectors;
+  old_vectors.push_back(solution);
+  for (const auto &v : solution_history)
+  {
+    LA::MPI::BlockVector ghosted(block_owned_dofs,
+                                 block_relevant_dofs,
+                                 mpi_comm);
+    ghosted = v;
+    old_vectors.push_back(ghosted);
+  }
+  std::vector<const LA::MPI::BlockVector *> old_pointers;
+  for (const auto &v : old_vectors)
+    old_pointers.push_back(&v);
+
+  parallel::distributed::SolutionTransfer<dim, LA::MPI::BlockVector> transfer(
+      dof_handler);
+
+  mesh_adaptive.prepare_coarsening_and_refinement();
+  transfer.prepare_for_coarsening_and_refinement(old_pointers);
+  mesh_adaptive.execute_coarsening_and_refinement();
+
+  setup_dofs();
+
+  std::vector<LA::MPI::BlockVector> new_vectors(
+      old_vectors.size(), LA::MPI::BlockVector(block_owned_dofs, mpi_comm));
+  std::vector<LA::MPI::BlockVector *> new_pointers;
+  for (auto &v : new_vectors)
+    new_pointers.push_back(&v);
+  transfer.interpolate(new_pointers);
+
+  // The interpolated vectors must satisfy the hanging node constraints.
+  for (auto &v : new_vectors)
+    hanging_node_constraints.distribute(v);
+
+  solution_owned = new_vectors[0];
+  solution = solution_owned;
+  solution_old = solution;
+  for (unsigned int k = 0; k < solution_history.size(); ++k)
+  {
+    solution_history[k].reinit(block_owned_dofs,
+                               block_relevant_dofs,
+                               mpi_comm);
+    solution_history[k] = new_vectors[k + 1];
+  }
+
+  // The faces of the outlet and of the cylinder have changed.
+  build_boundary_face_index();
+
+  pcout << "  Number of elements = " << mesh_adaptive.n_global_active_cells()
+        << ", number of DoFs = " << dof_handler.n_dofs() << std::endl;
+  pcout << "  Adapted in " << std::fixed << std::setprecision(2)
+        << Utilities::MPI::max(timer.wall_time(), mpi_comm) << " s"
+        << std::endl;
+  pcout << "===============================================" << std::endl;
+#endif
+}
+
+// The class is instantiated in NSSolver.cpp, only the member functions
+// defined here are instantiated in this file.
+template void NSSolver<2>::refine_mesh();
+template void NSSolver<3>::refine_mesh();
@@ -1,113 +1,56 @@
 #include "NSSolverStationary.hpp"
 
+#include <cstring>
+
 void NSSolverStationary::setup()
 {
+  AssertThrow(!goal_oriented_refinement || !read_mesh_from_file,
+              ExcMessage("Goal-oriented refinement is only available on the "
+                         "generated (quadrilateral) mesh."));
+  AssertThrow(!mesh_sequencing || !read_mesh_from_file,
+              ExcMessage("Mesh sequencing is only available on the generated "
+                         "(quadrilateral) mesh."));
+  AssertThrow(!mesh_sequencing || !goal_oriented_refinement,
+              ExcMessage("Mesh sequencing cannot be combined with "
+                         "goal-oriented refinement."));
+  AssertThrow(!cylinder_mesh || !read_mesh_from_file,
+              ExcMessage("The boundary-fitted mesh is generated: it cannot be "
+                         "combined with a mesh file."));
+
   // Create the mesh
   if (!read_mesh_from_file) 
   {
     {
-      constexpr unsigned int dim = 2;
-
-      // First: Create a full rectangular mesh with quadrilaterals.
-      Triangulation<dim> full_tria;
-      const Point<dim> bottom_left(0.0, 0.0);
-      const Point<dim> top_right(2.2, 0.41);
-
-      // Use a subdivision that gives reasonable resolution.
-      std::vector<unsigned int> subdivisions{mesh_size_x, mesh_size_y};
-
-      GridGenerator::subdivided_hyper_rectangle(full_tria,
-                                                  subdivisions,
-                                                  bottom_left,
-                                                  top_right);
-
-      // Define the circle parameters.
-      const Point<dim> circle_center((bottom_left[0] + 0.2),
-                                    (bottom_left[1] + top_right[1]) / 2.0);
-      const double circle_radius = 0.05;
-
-      // Prepare vectors to store vertices and cell connectivity.
-      std::vector<Point<dim>> vertices;
-      std::vector<CellData<dim>> cells;
-      SubCellData subcell_data;
-
-      // Copy vertices from the full triangulation.
-      vertices.resize(full_tria.n_vertices());
-      for (unsigned int i = 0; i < full_tria.n_vertices(); ++i)
-        vertices[i] = full_tria.get_vertices()[i];
-
-      // For each cell not inside the circle, copy its vertex indices.
-      for (auto cell = full_tria.begin_active(); cell != full_tria.end(); ++cell)
-      {
-        // Skip the cell if its center lies inside the circle.
-        if ((cell->center() - circle_center).norm() < circle_radius)
-          continue;
-        
-        // Create a CellData object.
-        CellData<dim> cell_data;
-        cell_data.vertices.resize(GeometryInfo<dim>::vertices_per_cell);
-        for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
-          cell_data.vertices[v] = cell->vertex_index(v);
-        // get all the elements which have a distance with the circle center than is comprised between 0.05 +- element_size/2
-        // if the element is inside the circle, we assign it a material id of 10
-        if((cell->center() - circle_center).norm() < circle_radius + cell->diameter()/2 &&
-            (cell->center() - circle_center).norm() > circle_radius - cell->diameter()/2)
-        {
-          cell_data.material_id = 10;
-        }
-        else
-        {
-          cell_data.material_id = 0;
-        }
-        cells.push_back(cell_data);
-      }
-
-      // Remove vertices that are not used in any cell.
-      GridTools::delete_unused_vertices(vertices, cells, subcell_data);
+      pcout << "Initializing the mesh" << std::endl;
 
-      // Create a new triangulation using the filtered vertices and cells.
       Triangulation<dim> mesh_serial;
-      mesh_serial.create_triangulation(vertices, cells, subcell_data);
-
-      // Mark boundaries.
-      // Loop over all active cells and then over each face.
-      // - Left side (x = bottom_left[0]) -> boundary id 7 (inlet)
-      // - Right side (x = top_right[0]) -> boundary id 8 (outlet)
-      // - All other boundaries -> boundary id 6.
-      for (auto cell = mesh_serial.begin_active(); cell != mesh_serial.end(); ++cell)
+      create_serial_mesh(mesh_serial);
+
+      if (goal_oriented_refinement || mesh_sequencing)
       {
-        for (unsigned int face = 0; face < GeometryInfo<dim>::faces_per_cell; ++face)
-        {
-          if (cell->face(face)->at_boundary())
-          {
-            const Point<dim> face_center = cell->face(face)->center();
-            if (std::fabs(face_center[0] - bottom_left[0]) < 1e-12)
-              cell->face(face)->set_boundary_id(7); // inlet
-            else if (std::fabs(face_center[0] - top_right[0]) < 1e-12)
-              cell->face(face)->set_boundary_id(8); // outlet
-            // if the current cell has id 10, assign it boundary id 10
-            else if (cell->material_id() == 10)
-              cell->face(face)->set_boundary_id(10); // circle
-            else
-              cell->face(face)->set_boundary_id(6); // all other boundaries (top, bottom, circular)
-          }
-        }
+        // The adaptive mesh is refined by p4est, which needs the coarse mesh
+        // on every process.
+        mesh_adaptive.copy_triangulation(mesh_serial);
       }
-
+      else
       {
+        // The description of the distributed mesh only holds the manifold
+        // ids of the cells and faces.
+        if (cylinder_mesh)
+          CylinderMesh::attach_manifold(mesh);
         GridTools::partition_triangulation(mpi_size, mesh_serial);
         const auto construction_data = TriangulationDescription::Utilities::
             create_description_from_triangulation(mesh_serial, MPI_COMM_WORLD);
         mesh.create_triangulation(construction_data);
       }
 
-      pcout << "  Number of elements = " << mesh.n_global_active_cells()
+      pcout << "  Number of elements = " << triangulation().n_global_active_cells()
             << std::endl;
 
       // Output the mesh to a VTU file.
       GridOut grid_out;
       std::ofstream output_file("mesh.msh");
-      grid_out.write_msh(mesh, output_file);
+      grid_out.write_msh(triangulation(), output_file);
       pcout << "Mesh written to mesh.msh" << std::endl;
     }
 
@@ -130,6 +73,14 @@ void NSSolverStationary::setup()
       pcout << "  DoFs per cell              = " << fe->dofs_per_cell
             << std::endl;
 
+      // The cells on the cylinder of the boundary-fitted mesh are curved
+      // with the same degree as the velocity.
+      mapping = std::make_unique<MappingQ<dim>>(
+          cylinder_mesh ? degree_velocity : 1);
+
+      pcout << "  Mapping degree             = " << mapping->get_degree()
+            << std::endl;
+
       quadrature = std::make_unique<QGauss<dim>>(fe->degree + 1);
 
       pcout << "  Quadrature points per cell = " << quadrature->size()
@@ -196,6 +147,8 @@ void NSSolverStationary::setup()
       pcout << "  DoFs per cell              = " << fe->dofs_per_cell
             << std::endl;
 
+      mapping = std::make_unique<MappingFE<dim>>(FE_SimplexP<dim>(1));
+
       quadrature = std::make_unique<QGaussSimplex<dim>>(fe->degree + 1);
 
       pcout << "  Quadrature points per cell = " << quadrature->size()
@@ -209,12 +162,110 @@ void NSSolverStationary::setup()
   }
   pcout << "-----------------------------------------------" << std::endl;
 
+  dof_handler.reinit(triangulation());
+  setup_dofs();
+}
+
+void NSSolverStationary::create_serial_mesh(Triangulation<dim> &mesh_serial) const
+{
+  if (cylinder_mesh)
+  {
+    CylinderMesh::create(mesh_serial, cylinder_mesh_parameters);
+    return;
+  }
+
+  // First: Create a full rectangular mesh with quadrilaterals.
+  Triangulation<dim> full_tria;
+  const Point<dim> bottom_left(0.0, 0.0);
+  const Point<dim> top_right(2.2, 0.41);
+
+  // Use a subdivision that gives reasonable resolution.
+  std::vector<unsigned int> subdivisions{mesh_size_x, mesh_size_y};
+
+  GridGenerator::subdivided_hyper_rectangle(full_tria,
+                                            subdivisions,
+                                            bottom_left,
+                                            top_right);
+
+  // Define the circle parameters.
+  const Point<dim> circle_center((bottom_left[0] + 0.2),
+                                 (bottom_left[1] + top_right[1]) / 2.0);
+  const double circle_radius = 0.05;
+
+  // Prepare vectors to store vertices and cell connectivity.
+  std::vector<Point<dim>> vertices;
+  std::vector<CellData<dim>> cells;
+  SubCellData subcell_data;
+
+  // Copy vertices from the full triangulation.
+  vertices.resize(full_tria.n_vertices());
+  for (unsigned int i = 0; i < full_tria.n_vertices(); ++i)
+    vertices[i] = full_tria.get_vertices()[i];
+
+  // For each cell not inside the circle, copy its vertex indices.
+  for (auto cell = full_tria.begin_active(); cell != full_tria.end(); ++cell)
+  {
+    // Skip the cell if its center lies inside the circle.
+    if ((cell->center() - circle_center).norm() < circle_radius)
+      continue;
+    
+    // Create a CellData object.
+    CellData<dim> cell_data;
+    cell_data.vertices.resize(GeometryInfo<dim>::vertices_per_cell);
+    for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+      cell_data.vertices[v] = cell->vertex_index(v);
+    // get all the elements which have a distance with the circle center than is comprised between 0.05 +- element_size/2
+    // if the element is inside the circle, we assign it a material id of 10
+    if((cell->center() - circle_center).norm() < circle_radius + cell->diameter()/2 &&
+        (cell->center() - circle_center).norm() > circle_radius - cell->diameter()/2)
+    {
+      cell_data.material_id = 10;
+    }
+    else
+    {
+      cell_data.material_id = 0;
+    }
+    cells.push_back(cell_data);
+  }
+
+  // Remove vertices that are not used in any cell.
+  GridTools::delete_unused_vertices(vertices, cells, subcell_data);
+
+  // Create the triangulation using the filtered vertices and cells.
+  mesh_serial.create_triangulation(vertices, cells, subcell_data);
+
+  // Mark boundaries.
+  // Loop over all active cells and then over each face.
+  // - Left side (x = bottom_left[0]) -> boundary id 7 (inlet)
+  // - Right side (x = top_right[0]) -> boundary id 8 (outlet)
+  // - All other boundaries -> boundary id 6.
+  for (auto cell = mesh_serial.begin_active(); cell != mesh_serial.end(); ++cell)
+  {
+    for (unsigned int face = 0; face < GeometryInfo<dim>::faces_per_cell; ++face)
+    {
+      if (cell->face(face)->at_boundary())
+      {
+        const Point<dim> face_center = cell->face(face)->center();
+        if (std::fabs(face_center[0] - bottom_left[0]) < 1e-12)
+          cell->face(face)->set_boundary_id(7); // inlet
+        else if (std::fabs(face_center[0] - top_right[0]) < 1e-12)
+          cell->face(face)->set_boundary_id(8); // outlet
+        // if the current cell has id 10, assign it boundary id 10
+        else if (cell->material_id() == 10)
+          cell->face(face)->set_boundary_id(10); // circle
+        else
+          cell->face(face)->set_boundary_id(6); // all other boundaries (top, bottom, circular)
+      }
+    }
+  }
+}
+
+void NSSolverStationary::setup_dofs()
+{
   // Initialize the DoF handler.
   {
     pcout << "Initializing the DoF handler" << std::endl;
 
-    dof_handler.reinit(mesh);
-
     dof_handler.distribute_dofs(*fe);
 
     // We want to reorder DoFs so that all velocity DoFs come first, and then
@@ -226,6 +277,13 @@ void NSSolverStationary::setup()
     locally_owned_dofs = dof_handler.locally_owned_dofs();
     DoFTools::extract_locally_relevant_dofs(dof_handler, locally_relevant_dofs);
 
+    // Constraints of the hanging nodes of the adaptive mesh, empty otherwise.
+    hanging_node_constraints.clear();
+    hanging_node_constraints.reinit(locally_relevant_dofs);
+    DoFTools::make_hanging_node_constraints(dof_handler,
+                                            hanging_node_constraints);
+    hanging_node_constraints.close();
+
     // Besides the locally owned and locally relevant indices for the whole
     // system (velocity and pressure), we will also need those for the
     // individual velocity and pressure blocks.
@@ -275,7 +333,8 @@ void NSSolverStationary::setup()
 
     TrilinosWrappers::BlockSparsityPattern sparsity(block_owned_dofs,
                                                     MPI_COMM_WORLD);
-    DoFTools::make_sparsity_pattern(dof_handler, coupling, sparsity);
+    DoFTools::make_sparsity_pattern(
+        dof_handler, coupling, sparsity, hanging_node_constraints, false);
     sparsity.compress();
 
     TrilinosWrappers::BlockSparsityPattern sparsity_pressure_mass(
@@ -297,7 +356,9 @@ void NSSolverStationary::setup()
 
     DoFTools::make_sparsity_pattern(dof_handler,
                                     coupling,
-                                    sparsity_pressure_mass);
+                                    sparsity_pressure_mass,
+                                    hanging_node_constraints,
+                                    false);
     sparsity_pressure_mass.compress();
 
     pcout << "  Initializing the matrices" << std::endl;
@@ -320,11 +381,13 @@ void NSSolverStationary::assemble_system(bool global_first_iter, bool computing_
   const unsigned int n_q = quadrature->size();
   const unsigned int n_q_face = quadrature_face->size();
 
-  FEValues<dim> fe_values(*fe,
+  FEValues<dim> fe_values(*mapping,
+                          *fe,
                           *quadrature,
                           update_values | update_gradients |
                               update_quadrature_points | update_JxW_values);
-  FEFaceValues<dim> fe_face_values(*fe,
+  FEFaceValues<dim> fe_face_values(*mapping,
+                                   *fe,
                                    *quadrature_face,
                                    update_values | update_normal_vectors |
                                        update_JxW_values);
@@ -488,8 +551,9 @@ void NSSolverStationary::assemble_system(bool global_first_iter, bool computing_
 
         double velocity_divergence_loc = trace(velocity_gradient_loc[q]);
 
-        // b(u,q) - pressure contribution in the continuity equation
-        cell_rhs(i) += velocity_divergence_loc *
+        // b(u,q) - pressure contribution in the continuity equation, with
+        // the sign of the corresponding term of the Jacobian
+        cell_rhs(i) -= velocity_divergence_loc *
                        fe_values[pressure].value(i, q) * fe_values.JxW(q);
       }
     }
@@ -527,9 +591,11 @@ void NSSolverStationary::assemble_system(bool global_first_iter, bool computing_
 
     cell->get_dof_indices(dof_indices);
 
-    jacobian_matrix.add(dof_indices, cell_matrix);
-    residual_vector.add(dof_indices, cell_rhs);
-    pressure_mass.add(dof_indices, cell_pressure_mass_matrix);
+    // The constraints only act on the hanging nodes of an adaptive mesh.
+    hanging_node_constraints.distribute_local_to_global(
+        cell_matrix, cell_rhs, dof_indices, jacobian_matrix, residual_vector);
+    hanging_node_constraints.distribute_local_to_global(
+        cell_pressure_mass_matrix, dof_indices, pressure_mass);
   }
 
   jacobian_matrix.compress(VectorOperation::add);
@@ -557,7 +623,8 @@ void NSSolverStationary::assemble_system(bool global_first_iter, bool computing_
 
     // Dirichlet conditions are not applied to pressure degrees of freedom
     // for this purpose use a component mask
-    VectorTools::interpolate_boundary_values(dof_handler,
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
                                              boundary_functions,
                                              boundary_values,
                                              ComponentMask(
@@ -565,7 +632,8 @@ void NSSolverStationary::assemble_system(bool global_first_iter, bool computing_
 
     boundary_functions[6] = &zero_function;
     boundary_functions[10] = &zero_function;
-    VectorTools::interpolate_boundary_values(dof_handler,
+    VectorTools::interpolate_boundary_values(*mapping,
+                                             dof_handler,
                                              boundary_functions,
                                              boundary_values,
                                              ComponentMask(
@@ -578,11 +646,17 @@ void NSSolverStationary::assemble_system(bool global_first_iter, bool computing_
 
 int NSSolverStationary::solve_system() {
   SolverControl solver_control(200000, tolerance);
+
+  // Vectors allocated by the preconditioner while applying it, expected to be
+  // zero since its workspace is sized at initialization.
+  unsigned int n_allocations = 0;
+
   // Choose the correct preconditioner
   if (preconditioner_type == 0) {
       PreconditionBlockDiagonal preconditioner;
       preconditioner.initialize(jacobian_matrix.block(0, 0),
-                                    pressure_mass.block(1, 1));
+                                    pressure_mass.block(1, 1),
+                                    solution_owned);
 
       if (solver_type == 0) {
           SolverGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
@@ -596,12 +670,14 @@ int NSSolverStationary::solve_system() {
           SolverBicgstab<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
           solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
       }
+      n_allocations = preconditioner.n_allocations();
   }
   else if (preconditioner_type == 1) {
       PreconditionBlockTriangular preconditioner;
       preconditioner.initialize(jacobian_matrix.block(0, 0),
                                     pressure_mass.block(1, 1),
-                                    jacobian_matrix.block(1, 0));
+                                    jacobian_matrix.block(1, 0),
+                                    solution_owned);
 
       if (solver_type == 0) {
           SolverGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
@@ -615,6 +691,7 @@ int NSSolverStationary::solve_system() {
           SolverBicgstab<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
           solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
       }
+      n_allocations = preconditioner.n_allocations();
   }
   else if (preconditioner_type == 2) {
       double alpha = 0.5;
@@ -637,25 +714,31 @@ int NSSolverStationary::solve_system() {
           SolverBicgstab<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
           solver.solve(jacobian_matrix, delta_owned, residual_vector, preconditioner);
       }
+      n_allocations = preconditioner.n_allocations();
   }
   else {
       throw std::invalid_argument("Invalid preconditioner type. Use 0: blockDiagonal, 1: blockTriangular, 2: aSIMPLE.");
   }
+
+  hanging_node_constraints.distribute(delta_owned);
     
-  pcout << "   " << solver_control.last_step() << " solver iterations" << std::endl;
+  pcout << "   " << solver_control.last_step() << " solver iterations, "
+        << Utilities::MPI::max(n_allocations, MPI_COMM_WORLD)
+        << " preconditioner allocations" << std::endl;
   return solver_control.last_step();
 }
 
-void NSSolverStationary::solve_newton()
+unsigned int NSSolverStationary::solve_newton()
 {
   pcout << "===============================================" << std::endl;
 
   const unsigned int n_max_iters = 15;
-  const double residual_tolerance = 1e-9;
+  const double residual_tolerance = newton_residual_tolerance;
   double target_Re = 1/nu;
   bool global_first_iter = true;
   bool computing_stokes = true;
   bool inlet_reached = false;
+  unsigned int n_total_iters = 0;
   pcout << "Target viscosity = " << nu << std::endl;
 
   // First solve the Stokes problem, then becomes a NS with an ingreasingly more dominant convective term.
@@ -745,6 +828,7 @@ void NSSolverStationary::solve_newton()
           }
           output();
           ++n_iter;
+          ++n_total_iters;
         }
 
         // Increment inlet velocity
@@ -754,7 +838,9 @@ void NSSolverStationary::solve_newton()
       }
       output();
   }
+  pcout << "Total Newton iterations = " << n_total_iters << std::endl;
   pcout << "===============================================" << std::endl;
+  return n_total_iters;
 }
 
 double NSSolverStationary::get_reynolds() const
@@ -782,12 +868,17 @@ void NSSolverStationary::output() const
                            names,
                            data_component_interpretation);
 
-  std::vector<unsigned int> partition_int(mesh.n_active_cells());
-  GridTools::get_subdomain_association(mesh, partition_int);
+  std::vector<unsigned int> partition_int(triangulation().n_active_cells());
+  GridTools::get_subdomain_association(triangulation(), partition_int);
   const Vector<double> partitioning(partition_int.begin(), partition_int.end());
   data_out.add_data_vector(partitioning, "partitioning");
 
-  data_out.build_patches();
+  // Dual weighted residual indicators, once they have been computed on the
+  // current mesh.
+  if (error_indicators.size() == triangulation().n_active_cells())
+    data_out.add_data_vector(error_indicators, "error_indicator");
+
+  data_out.build_patches(*mapping);
 
   const std::string output_file_name = "output-stokes";
   data_out.write_vtu_with_pvtu_record("./",
@@ -799,6 +890,26 @@ void NSSolverStationary::output() const
   pcout << "===============================================" << std::endl;
 }
 
+void NSSolverStationary::write_solution(const std::string &file_name) const
+{
+  CellwiseVectorIO::StationarySolutionState state;
+  std::memset(&state, 0, sizeof(state));
+  std::memcpy(state.magic,
+              CellwiseVectorIO::stationary_solution_magic,
+              sizeof(state.magic));
+  state.nu = nu;
+  state.inlet_velocity = inlet_velocity.getVelocity();
+
+  CellwiseVectorIO::write(file_name,
+                          dof_handler,
+                          std::vector<const TrilinosWrappers::MPI::BlockVector *>{&solution},
+                          &state,
+                          sizeof(state),
+                          MPI_COMM_WORLD);
+
+  pcout << "Solution written to " << file_name << std::endl;
+}
+
 void NSSolverStationary::compute_lift_drag()
 {
   pcout << "===============================================" << std::endl;
@@ -812,7 +923,8 @@ void NSSolverStationary::compute_lift_drag()
   const unsigned int n_q_face = quadrature_face->size();
 
   // need to iterate over all the cells corresponding to the cylindrical obstacle in order to compute the forces
-  FEFaceValues<dim> fe_face_values(*fe,
+  FEFaceValues<dim> fe_face_values(*mapping,
+                                   *fe,
                                    *quadrature_face,
                                    update_values | update_quadrature_points | update_gradients | update_normal_vectors |
                                        update_JxW_values);
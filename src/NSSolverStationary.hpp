@@ -5,6 +5,7 @@
 #include <deal.II/base/quadrature_lib.h>
 
 #include <deal.II/distributed/fully_distributed_tria.h>
+#include <deal.II/distributed/tria.h>
 
 #include <deal.II/dofs/dof_handler.h>
 #include <deal.II/dofs/dof_renumbering.h>
@@ -16,6 +17,7 @@
 #include <deal.II/fe/fe_values.h>
 #include <deal.II/fe/fe_values_extractors.h>
 #include <deal.II/fe/mapping_fe.h>
+#include <deal.II/fe/mapping_q.h>
 
 #include <deal.II/grid/grid_in.h>
 #include <deal.II/grid/grid_out.h>
@@ -24,6 +26,7 @@
 #include <deal.II/grid/grid_refinement.h>
 #include <deal.II/numerics/data_out.h>
 
+#include <deal.II/lac/affine_constraints.h>
 #include <deal.II/lac/solver_cg.h>
 #include <deal.II/lac/solver_gmres.h>
 #include <deal.II/lac/solver_bicgstab.h>
@@ -41,6 +44,11 @@
 #include <vector>
 #include <cmath>
 
+#include "CellwiseVectorIO.hpp"
+#include "CylinderMesh.hpp"
+#include "PooledVectorMemory.hpp"
+#include "VectorKernels.hpp"
+
 
 using namespace dealii;
 
@@ -88,10 +96,15 @@ public:
         return 0.0;
     }
 
-    double getVelocity() {
+    double getVelocity() const {
       return u;
     }
 
+    // Restart the continuation from the initial inlet velocity.
+    void reset() {
+      u = 0.1;
+    }
+
     bool incrementVelocity(double re) {
       if (u == U_m)
         return true;
@@ -110,22 +123,40 @@ public:
     const double H = 0.41;
   };
 
+  // Number of vectors used by the inner solvers of the preconditioners, so
+  // that their vector pools can be sized once at initialization. FGMRES needs
+  // two vectors per basis vector (default basis size is 30) plus a few
+  // auxiliary ones, CG needs three.
+  static constexpr unsigned int n_inner_fgmres_vectors = 2 * (30 + 2);
+  static constexpr unsigned int n_inner_cg_vectors = 4;
+
   // Preconditioner
   // Block-diagonal preconditioner.
   class PreconditionBlockDiagonal
   {
   public:
+    PreconditionBlockDiagonal()
+        : solver_control_velocity(100001, 1e-1), solver_control_pressure(100000, 1e-1), solver_cg_velocity(solver_control_velocity, memory_velocity), solver_cg_pressure(solver_control_pressure, memory_pressure)
+    {
+    }
+
     // Initialize the preconditioner, given the velocity stiffness matrix, the
-    // pressure mass matrix.
+    // pressure mass matrix. The vector is only used to size the workspace.
     void
     initialize(const TrilinosWrappers::SparseMatrix &velocity_stiffness_,
-               const TrilinosWrappers::SparseMatrix &pressure_mass_)
+               const TrilinosWrappers::SparseMatrix &pressure_mass_,
+               const TrilinosWrappers::MPI::BlockVector &vector_)
     {
       velocity_stiffness = &velocity_stiffness_;
       pressure_mass = &pressure_mass_;
 
       preconditioner_velocity.initialize(velocity_stiffness_);
       preconditioner_pressure.initialize(pressure_mass_);
+
+      memory_velocity.reserve(n_inner_fgmres_vectors, vector_.block(0));
+      memory_pressure.reserve(n_inner_cg_vectors, vector_.block(1));
+      memory_velocity.reset_allocations();
+      memory_pressure.reset_allocations();
     }
 
     // Application of the preconditioner.
@@ -133,25 +164,26 @@ public:
     vmult(TrilinosWrappers::MPI::BlockVector &dst,
           const TrilinosWrappers::MPI::BlockVector &src) const
     {
-      SolverControl solver_control_velocity(100001,
-                                            1e-1 * src.block(0).l2_norm());
-      SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_cg_velocity(
-          solver_control_velocity);
+      solver_control_velocity.set_tolerance(1e-1 * src.block(0).l2_norm());
       solver_cg_velocity.solve(*velocity_stiffness,
                                dst.block(0),
                                src.block(0),
                                preconditioner_velocity);
 
-      SolverControl solver_control_pressure(100000,
-                                            1e-1 * src.block(1).l2_norm());
-      SolverCG<TrilinosWrappers::MPI::Vector> solver_cg_pressure(
-          solver_control_pressure);
+      solver_control_pressure.set_tolerance(1e-1 * src.block(1).l2_norm());
       solver_cg_pressure.solve(*pressure_mass,
                                dst.block(1),
                                src.block(1),
                                preconditioner_pressure);
     }
 
+    // Number of vectors allocated by the inner solvers since initialization.
+    unsigned int
+    n_allocations() const
+    {
+      return memory_velocity.n_allocations() + memory_pressure.n_allocations();
+    }
+
   protected:
     // Velocity stiffness matrix.
     const TrilinosWrappers::SparseMatrix *velocity_stiffness;
@@ -164,18 +196,34 @@ public:
 
     // Preconditioner used for the pressure block.
     TrilinosWrappers::PreconditionSSOR preconditioner_pressure;
+
+    // Workspace of the inner solvers, one pool for each block.
+    mutable PooledVectorMemory<TrilinosWrappers::MPI::Vector> memory_velocity;
+    mutable PooledVectorMemory<TrilinosWrappers::MPI::Vector> memory_pressure;
+
+    // Inner solvers, built once and reused at every application.
+    mutable SolverControl solver_control_velocity;
+    mutable SolverControl solver_control_pressure;
+    mutable SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_cg_velocity;
+    mutable SolverCG<TrilinosWrappers::MPI::Vector> solver_cg_pressure;
   };
 
   // Block-triangular preconditioner.
   class PreconditionBlockTriangular
   {
   public:
+    PreconditionBlockTriangular()
+        : solver_control_velocity(10000001, 1e-4), solver_control_pressure(100000, 1e-5), solver_gmres_velocity(solver_control_velocity, memory_velocity), solver_cg_pressure(solver_control_pressure, memory_pressure)
+    {
+    }
+
     // Initialize the preconditioner, given the velocity stiffness matrix, the
-    // pressure mass matrix.
+    // pressure mass matrix. The vector is only used to size the workspace.
     void
     initialize(const TrilinosWrappers::SparseMatrix &velocity_stiffness_,
                const TrilinosWrappers::SparseMatrix &pressure_mass_,
-               const TrilinosWrappers::SparseMatrix &B_)
+               const TrilinosWrappers::SparseMatrix &B_,
+               const TrilinosWrappers::MPI::BlockVector &vector_)
     {
       velocity_stiffness = &velocity_stiffness_;
       pressure_mass = &pressure_mass_;
@@ -183,6 +231,12 @@ public:
 
       preconditioner_velocity.initialize(velocity_stiffness_);
       preconditioner_pressure.initialize(pressure_mass_);
+
+      tmp.reinit(vector_.block(1));
+      memory_velocity.reserve(n_inner_fgmres_vectors, vector_.block(0));
+      memory_pressure.reserve(n_inner_cg_vectors, vector_.block(1));
+      memory_velocity.reset_allocations();
+      memory_pressure.reset_allocations();
     }
 
     // Application of the preconditioner.
@@ -190,11 +244,7 @@ public:
     vmult(TrilinosWrappers::MPI::BlockVector &dst,
           const TrilinosWrappers::MPI::BlockVector &src) const
     {
-      SolverControl solver_control_velocity(10000001,
-                                            1e-4 * src.block(0).l2_norm());
-
-      SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_gmres_velocity(
-          solver_control_velocity);
+      solver_control_velocity.set_tolerance(1e-4 * src.block(0).l2_norm());
       solver_gmres_velocity.solve(*velocity_stiffness,
                                   dst.block(0),
                                   src.block(0),
@@ -203,20 +253,23 @@ public:
       // UNCOMMENT if do not want to use direct solver
       // preconditioner_velocity.vmult(dst.block(0), tmp.block(0));
 
-      tmp.reinit(src.block(1));
       B->vmult(tmp, dst.block(0));
       tmp.sadd(-1.0, src.block(1));
 
-      SolverControl solver_control_pressure(100000,
-                                            1e-5 * src.block(1).l2_norm());
-      SolverCG<TrilinosWrappers::MPI::Vector> solver_cg_pressure(
-          solver_control_pressure);
+      solver_control_pressure.set_tolerance(1e-5 * src.block(1).l2_norm());
       solver_cg_pressure.solve(*pressure_mass,
                                dst.block(1),
                                tmp,
                                preconditioner_pressure);
     }
 
+    // Number of vectors allocated by the inner solvers since initialization.
+    unsigned int
+    n_allocations() const
+    {
+      return memory_velocity.n_allocations() + memory_pressure.n_allocations();
+    }
+
   protected:
     // Velocity stiffness matrix.
     const TrilinosWrappers::SparseMatrix *velocity_stiffness;
@@ -233,12 +286,27 @@ public:
     // B matrix.
     const TrilinosWrappers::SparseMatrix *B;
 
-    // Temporary vector.
+    // Temporary vector, sized once in initialize().
     mutable TrilinosWrappers::MPI::Vector tmp;
+
+    // Workspace of the inner solvers, one pool for each block.
+    mutable PooledVectorMemory<TrilinosWrappers::MPI::Vector> memory_velocity;
+    mutable PooledVectorMemory<TrilinosWrappers::MPI::Vector> memory_pressure;
+
+    // Inner solvers, built once and reused at every application.
+    mutable SolverControl solver_control_velocity;
+    mutable SolverControl solver_control_pressure;
+    mutable SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_gmres_velocity;
+    mutable SolverCG<TrilinosWrappers::MPI::Vector> solver_cg_pressure;
   };
 
   class PreconditionaSIMPLE {
   public:
+    PreconditionaSIMPLE()
+        : solver_control_F(100000, 1e-1), solver_control_S(100000, 1e-1), solver_F(solver_control_F, memory_F), solver_S(solver_control_S, memory_S)
+    {
+    }
+
     void initialize(const TrilinosWrappers::SparseMatrix &F_,
                 const TrilinosWrappers::SparseMatrix &B_,
                 const TrilinosWrappers::SparseMatrix &B_t_,
@@ -277,39 +345,47 @@ public:
         // Initialize preconditioners with ILU for robustness
         preconditioner_F.initialize(*F_matrix);
         preconditioner_S.initialize(S_matrix);
+
+        // Size the inner solvers workspace once
+        memory_F.reserve(n_inner_fgmres_vectors, vector_.block(0));
+        memory_S.reserve(n_inner_cg_vectors, vector_.block(1));
+        memory_F.reset_allocations();
+        memory_S.reset_allocations();
     }
 
     void vmult(TrilinosWrappers::MPI::BlockVector &dst,
               const TrilinosWrappers::MPI::BlockVector &src) const
     {
       // Step 1: Solve F * ũ = src_u (velocity predictor)
-      SolverControl solver_control_F(100000, 1e-1 * src.block(0).l2_norm());
-      SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_F(solver_control_F);
+      solver_control_F.set_tolerance(1e-1 * src.block(0).l2_norm());
       solver_F.solve(*F_matrix, dst.block(0), src.block(0), preconditioner_F);
 
       // Step 2: Compute pressure residual: tmp_p = src_p - B * ũ
-      tmp_p.reinit(src.block(1));
       B_matrix->vmult(tmp_p, dst.block(0));  // B * ũ
       tmp_p.sadd(-1.0, 1.0, src.block(1));   // tmp_p = src_p - B * ũ
 
       // Step 3: Solve S * δp = tmp_p (pressure correction)
-      SolverControl solver_control_S(100000, 1e-1 * tmp_p.l2_norm());
-      SolverCG<TrilinosWrappers::MPI::Vector> solver_S(solver_control_S);
+      solver_control_S.set_tolerance(1e-1 * tmp_p.l2_norm());
       solver_S.solve(S_matrix, delta_p, tmp_p, preconditioner_S);
 
       // Step 4: Apply under-relaxation: p = α * δp
       delta_p *= alpha;
 
       // Step 5: Correct velocity: u = ũ - D^{-1} * B^T * δp
-      tmp_u.reinit(dst.block(0));
       B_t_matrix->vmult(tmp_u, delta_p);     // B^T * δp
-      tmp_u.scale(D_inv_vector);             // D^{-1} * B^T * δp
-      dst.block(0) -= tmp_u;                 // u = ũ - D^{-1} B^T δp
+      fused_subtract_diagonal_scaled(dst.block(0), D_inv_vector, tmp_u); // u = ũ - D^{-1} B^T δp
 
       // Store pressure correction
       dst.block(1) = delta_p;
     }
 
+    // Number of vectors allocated by the inner solvers since initialization.
+    unsigned int
+    n_allocations() const
+    {
+      return memory_F.n_allocations() + memory_S.n_allocations();
+    }
+
   protected:
     // Matrices
     const TrilinosWrappers::SparseMatrix *F_matrix;
@@ -328,10 +404,20 @@ public:
     // Damping factor (α ∈ (0,1])
     double alpha;
 
-    // Temporary vectors
+    // Temporary vectors, sized once in initialize()
     mutable TrilinosWrappers::MPI::Vector tmp_p;
     mutable TrilinosWrappers::MPI::Vector delta_p;
     mutable TrilinosWrappers::MPI::Vector tmp_u;
+
+    // Inner solvers workspace
+    mutable PooledVectorMemory<TrilinosWrappers::MPI::Vector> memory_F;
+    mutable PooledVectorMemory<TrilinosWrappers::MPI::Vector> memory_S;
+
+    // Inner solvers, built once and reused at every application
+    mutable SolverControl solver_control_F;
+    mutable SolverControl solver_control_S;
+    mutable SolverFGMRES<TrilinosWrappers::MPI::Vector> solver_F;
+    mutable SolverCG<TrilinosWrappers::MPI::Vector> solver_S;
   };
 
 
@@ -346,7 +432,7 @@ public:
                      const unsigned int &preconditioner_type_,
                      double nu_,
                      bool read_mesh_from_file_)
-      : mpi_size(Utilities::MPI::n_mpi_processes(MPI_COMM_WORLD)), mpi_rank(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD)), pcout(std::cout, mpi_rank == 0), mesh_file_name(mesh_file_name_), mesh(MPI_COMM_WORLD), degree_velocity(degree_velocity_), degree_pressure(degree_pressure_), solver_type(solver_type_), tolerance(tolerance_), preconditioner_type(preconditioner_type_), mesh_size_x(mesh_size_x_), mesh_size_y(mesh_size_y_), nu(nu_), read_mesh_from_file(read_mesh_from_file_)
+      : mpi_size(Utilities::MPI::n_mpi_processes(MPI_COMM_WORLD)), mpi_rank(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD)), pcout(std::cout, mpi_rank == 0), mesh_file_name(mesh_file_name_), mesh(MPI_COMM_WORLD), mesh_adaptive(MPI_COMM_WORLD, Triangulation<dim>::limit_level_difference_at_vertices), degree_velocity(degree_velocity_), degree_pressure(degree_pressure_), solver_type(solver_type_), tolerance(tolerance_), preconditioner_type(preconditioner_type_), mesh_size_x(mesh_size_x_), mesh_size_y(mesh_size_y_), nu(nu_), read_mesh_from_file(read_mesh_from_file_)
   {
   }
 
@@ -356,15 +442,131 @@ public:
   void
   setup();
 
-  // Solve the problem using Newton's method.
-  void
+  // Solve the problem using Newton's method, with continuation in the
+  // Reynolds number and in the inlet velocity. Returns the total number of
+  // Newton iterations.
+  unsigned int
   solve_newton();
 
   // Output the results to a file.
   void
   output() const;
 
+  // Write the solution to the given binary file, which can be used as initial
+  // condition by NSSolver (see CellwiseVectorIO.hpp for the format).
+  void
+  write_solution(const std::string &file_name) const;
+
+  // Solve the problem n_cycles times with solve_goal_oriented(): after each
+  // solve the error of the drag and lift coefficients is estimated, and the
+  // cells with the largest dual weighted residual indicators are refined (in
+  // the given fraction of the number of cells), up to max_level levels. With
+  // one cycle the errors are only estimated. It must be called before
+  // setup(), and refinement is only available on the generated mesh.
+  void
+  set_goal_oriented_refinement(const unsigned int &n_cycles_,
+                               const unsigned int &max_refinement_level_,
+                               const double &refine_fraction_ = 0.3)
+  {
+    goal_oriented_refinement = n_cycles_ > 1;
+    n_refinement_cycles = n_cycles_;
+    max_refinement_level = max_refinement_level_;
+    refine_fraction = refine_fraction_;
+  }
+
+  // Solve the problem with solve_mesh_sequencing(): the continuation from the
+  // Stokes problem is only run on the mesh built by setup(), which is then
+  // refined globally n_levels_ - 1 times. On each finer mesh the solution is
+  // interpolated from the coarser one and used as initial guess of at most
+  // max_newton_steps_ Newton iterations. It must be called before setup(),
+  // and is only available on the generated mesh.
+  void
+  set_mesh_sequencing(const unsigned int &n_levels_,
+                      const unsigned int &max_newton_steps_ = 2)
+  {
+    mesh_sequencing = n_levels_ > 1;
+    n_sequencing_levels = n_levels_;
+    max_sequencing_newton_steps = max_newton_steps_;
+  }
+
+  // Generate a boundary-fitted mesh, with the given number of cells along the
+  // cylinder, the walls and the inlet (see CylinderMesh.hpp), instead of the
+  // uniform one. It must be called before setup().
+  void
+  set_cylinder_mesh(const CylinderMesh::Parameters &cylinder_mesh_parameters_)
+  {
+    cylinder_mesh = true;
+    cylinder_mesh_parameters = cylinder_mesh_parameters_;
+  }
+
+  // Solve the problem on the sequence of meshes adapted to the drag and lift
+  // coefficients, estimating their error on each of them.
+  void
+  solve_goal_oriented();
+
+  // Solve the problem on the sequence of globally refined meshes, starting
+  // each Newton solve from the solution on the coarser one.
+  void
+  solve_mesh_sequencing();
+
+  // Estimate the error of the drag and lift coefficients of the current
+  // solution with the dual weighted residual method, and compute the error
+  // indicator of each cell.
+  void
+  estimate_functional_errors();
+
+  // Print the drag and lift coefficients with their estimated errors.
+  void
+  print_functional_errors();
+
 protected:
+  // Build the serial mesh of the channel with the cylinder, with boundary ids.
+  void
+  create_serial_mesh(Triangulation<dim> &mesh_serial) const;
+
+  // Distribute the DoFs on the current mesh and initialize the constraints,
+  // the matrices and the vectors.
+  void
+  setup_dofs();
+
+  // Refine the adaptive mesh according to the error indicators.
+  void
+  refine_mesh();
+
+  // Refine the adaptive mesh globally, interpolating the solution on it.
+  void
+  refine_mesh_globally();
+
+  // Newton iterations on the Navier-Stokes problem at the current viscosity
+  // and inlet velocity, starting from the current solution, which must
+  // already satisfy the Dirichlet conditions. Return the number of
+  // iterations.
+  unsigned int
+  solve_newton_steps(const unsigned int &max_steps);
+
+  // Solve the adjoint problem J^T z = j for the given functional derivative,
+  // using the Jacobian assembled at the current solution.
+  void
+  solve_adjoint(const TrilinosWrappers::MPI::BlockVector &functional_derivative,
+                TrilinosWrappers::MPI::BlockVector &adjoint_owned);
+
+  // Mesh in use, adaptive or fully distributed.
+  parallel::TriangulationBase<dim> &
+  triangulation()
+  {
+    if (goal_oriented_refinement || mesh_sequencing)
+      return mesh_adaptive;
+    return mesh;
+  }
+
+  const parallel::TriangulationBase<dim> &
+  triangulation() const
+  {
+    if (goal_oriented_refinement || mesh_sequencing)
+      return mesh_adaptive;
+    return mesh;
+  }
+
   // Assemble the tangent problem.
   void
   assemble_system(bool first_iter, bool computing_stokes);
@@ -373,6 +575,9 @@ protected:
   int
   solve_system();
 
+  // Tolerance on the norm of the residual of the Newton iterations.
+  static constexpr double newton_residual_tolerance = 1e-9;
+
   double get_reynolds() const;
 
   // MPI parallel. /////////////////////////////////////////////////////////////
@@ -403,6 +608,27 @@ protected:
   // Mesh.
   parallel::fullydistributed::Triangulation<dim> mesh;
 
+  // Mesh used with goal-oriented refinement and mesh sequencing, instead of
+  // the fully distributed one.
+  parallel::distributed::Triangulation<dim> mesh_adaptive;
+
+  // Goal-oriented refinement: whether it is enabled, the number of solves,
+  // the maximum refinement level and the fraction of cells refined.
+  bool goal_oriented_refinement = false;
+  unsigned int n_refinement_cycles = 0;
+  unsigned int max_refinement_level = 0;
+  double refine_fraction = 0.3;
+
+  // Mesh sequencing: whether it is enabled, the number of meshes and the
+  // maximum number of Newton iterations on the finer ones.
+  bool mesh_sequencing = false;
+  unsigned int n_sequencing_levels = 0;
+  unsigned int max_sequencing_newton_steps = 2;
+
+  // Boundary-fitted mesh of the cylinder, instead of the uniform one.
+  bool cylinder_mesh = false;
+  CylinderMesh::Parameters cylinder_mesh_parameters = CylinderMesh::medium;
+
   // Polynomial degrees.
   const unsigned int degree_velocity;
   const unsigned int degree_pressure;
@@ -418,6 +644,9 @@ protected:
   // Finite element space.
   std::unique_ptr<FESystem<dim>> fe;
 
+  // Mapping from the reference cell, curved on the boundary-fitted mesh.
+  std::unique_ptr<Mapping<dim>> mapping;
+
   // Quadrature formula.
   std::unique_ptr<Quadrature<dim>> quadrature;
 
@@ -439,6 +668,9 @@ protected:
   // DoFs relevant to current process in the velocity and pressure blocks.
   std::vector<IndexSet> block_relevant_dofs;
 
+  // Constraints of the hanging nodes of the adaptive mesh, empty otherwise.
+  AffineConstraints<double> hanging_node_constraints;
+
   // Jacobian matrix.
   TrilinosWrappers::BlockSparseMatrix jacobian_matrix;
 
@@ -476,6 +708,13 @@ protected:
   double drag_force = 0.0;
   double lift_coeff = 0.0;
   double drag_coeff = 0.0;
+
+  // Dual weighted residual estimates of the error of the drag and lift
+  // coefficients (exact minus computed value), and the error indicator of
+  // each active cell, used to refine the mesh.
+  double drag_coeff_error = 0.0;
+  double lift_coeff_error = 0.0;
+  Vector<float> error_indicators;
 };
 
 #endif
\ No newline at end of file
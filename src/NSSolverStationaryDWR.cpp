@@ -0,0 +1,383 @@
+#include "NSSolverStationary.hpp"
+
+#include <deal.II/distributed/grid_refinement.h>
+
+#include <deal.II/fe/fe_dgq.h>
+#include <deal.II/fe/fe_tools.h>
+
+#include <array>
+
+// Goal-oriented error estimation for the drag and lift coefficients with the
+// dual weighted residual (DWR) method. For a functional J of the solution
+// u_h, the error is approximated by
+//   J(u) - J(u_h) ~ rho(u_h)(z - I_h z) = sum_K rho_K(u_h)(z - I_h z),
+// where rho(u_h)(v) = -R(u_h)(v) is the residual of the discrete solution
+// tested with v, and z solves the adjoint problem J'(u_h)^T z = J'(u_h) on
+// the Jacobian of the last Newton iteration. The weights z - I_h z are
+// approximated by the difference between z and its interpolation on
+// discontinuous elements of one degree less, computed cell by cell. The
+// absolute values of the cell contributions drive the refinement.
+
+namespace
+{
+  // Transpose of the Jacobian, as an operator for the Krylov solvers.
+  class TransposeJacobian
+  {
+  public:
+    TransposeJacobian(const TrilinosWrappers::BlockSparseMatrix &jacobian_)
+        : jacobian(jacobian_)
+    {
+    }
+
+    void
+    vmult(TrilinosWrappers::MPI::BlockVector &dst,
+          const TrilinosWrappers::MPI::BlockVector &src) const
+    {
+      jacobian.Tvmult(dst, src);
+    }
+
+  private:
+    const TrilinosWrappers::BlockSparseMatrix &jacobian;
+  };
+}
+
+void NSSolverStationary::solve_goal_oriented()
+{
+  // solve_newton() changes the viscosity and the inlet velocity along the
+  // continuation, which restarts from the beginning on each mesh.
+  const double target_nu = nu;
+
+  for (unsigned int cycle = 0; cycle < n_refinement_cycles; ++cycle)
+  {
+    if (cycle > 0)
+      refine_mesh();
+
+    pcout << "===============================================" << std::endl;
+    pcout << "Cycle " << cycle << ": "
+          << triangulation().n_global_active_cells() << " cells, "
+          << dof_handler.n_dofs() << " DoFs" << std::endl;
+
+    nu = target_nu;
+    inlet_velocity.reset();
+    solve_newton();
+
+    compute_lift_drag();
+    estimate_functional_errors();
+    print_functional_errors();
+
+    const double indicator_sum = Utilities::MPI::sum(
+        static_cast<double>(error_indicators.l1_norm()), MPI_COMM_WORLD);
+
+    if (mpi_rank == 0)
+    {
+      std::ofstream file("dwr.csv", std::ios::app);
+      if (file.tellp() == 0)
+        file << "cycle,n_cells,n_dofs,drag_coeff,drag_error,lift_coeff,"
+                "lift_error,indicator_sum\n";
+      file << cycle << "," << triangulation().n_global_active_cells() << ","
+           << dof_handler.n_dofs() << "," << drag_coeff << ","
+           << drag_coeff_error << "," << lift_coeff << ","
+           << lift_coeff_error << "," << indicator_sum << "\n";
+    }
+  }
+
+  output();
+}
+
+void NSSolverStationary::estimate_functional_errors()
+{
+  pcout << "===============================================" << std::endl;
+  pcout << "Estimating the error of the drag and lift coefficients" << std::endl;
+
+  // Jacobian and residual at the current solution.
+  assemble_system(false, false);
+
+  const unsigned int dofs_per_cell = fe->dofs_per_cell;
+  const unsigned int n_q = quadrature->size();
+  const unsigned int n_q_face = quadrature_face->size();
+
+  FEValues<dim> fe_values(*mapping,
+                          *fe,
+                          *quadrature,
+                          update_values | update_gradients | update_JxW_values);
+  FEFaceValues<dim> fe_face_values(*mapping,
+                                   *fe,
+                                   *quadrature_face,
+                                   update_values | update_gradients |
+                                       update_normal_vectors |
+                                       update_JxW_values);
+
+  FEValuesExtractors::Vector velocity(0);
+  FEValuesExtractors::Scalar pressure(dim);
+
+  std::vector<types::global_dof_index> dof_indices(dofs_per_cell);
+
+  // The coefficients are the forces on the cylinder scaled by
+  // 2 / (U_avg^2 D). They are linear in the solution,
+  //   C_c(u, p) = -2 / (U_avg^2 D) int_Gamma (sigma(u, p) n) . e_c,
+  // with n pointing out of the fluid, so that their derivative along a basis
+  // function is the same expression evaluated for it.
+  const double U_avg = get_avg_inlet_velocity();
+  const double scaling = 2.0 / (U_avg * U_avg * 0.1);
+
+  // Derivatives of the drag (0) and lift (1) coefficients.
+  std::array<TrilinosWrappers::MPI::BlockVector, dim> functional_derivatives;
+  for (auto &v : functional_derivatives)
+    v.reinit(block_owned_dofs, MPI_COMM_WORLD);
+
+  Vector<double> cell_derivative(dofs_per_cell);
+  Tensor<2, dim> stress;
+
+  for (const auto &cell : dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned() || !cell->at_boundary())
+      continue;
+
+    for (unsigned int f = 0; f < cell->n_faces(); ++f)
+    {
+      if (!cell->face(f)->at_boundary() || cell->face(f)->boundary_id() != 10)
+        continue;
+
+      fe_face_values.reinit(cell, f);
+      cell->get_dof_indices(dof_indices);
+
+      for (unsigned int c = 0; c < dim; ++c)
+      {
+        cell_derivative = 0.0;
+        for (unsigned int q = 0; q < n_q_face; ++q)
+        {
+          for (unsigned int i = 0; i < dofs_per_cell; ++i)
+          {
+            const Tensor<2, dim> gradient =
+                fe_face_values[velocity].gradient(i, q);
+            stress = nu * (gradient + transpose(gradient));
+            for (unsigned int d = 0; d < dim; ++d)
+              stress[d][d] -= fe_face_values[pressure].value(i, q);
+
+            cell_derivative(i) -= scaling *
+                                  (stress * fe_face_values.normal_vector(q))[c] *
+                                  fe_face_values.JxW(q);
+          }
+        }
+
+        hanging_node_constraints.distribute_local_to_global(
+            cell_derivative, dof_indices, functional_derivatives[c]);
+      }
+    }
+  }
+
+  for (auto &v : functional_derivatives)
+    v.compress(VectorOperation::add);
+
+  // Adjoint solutions, with ghost elements to evaluate them on each cell.
+  std::array<TrilinosWrappers::MPI::BlockVector, dim> adjoints;
+  {
+    TrilinosWrappers::MPI::BlockVector adjoint_owned(block_owned_dofs,
+                                                     MPI_COMM_WORLD);
+    for (unsigned int c = 0; c < dim; ++c)
+    {
+      pcout << "  Adjoint problem of the "
+            << (c == 0 ? "drag" : "lift") << " coefficient:";
+      solve_adjoint(functional_derivatives[c], adjoint_owned);
+
+      adjoints[c].reinit(block_owned_dofs, block_relevant_dofs, MPI_COMM_WORLD);
+      adjoints[c] = adjoint_owned;
+    }
+  }
+
+  // The weights are z - I_h z, with I_h the interpolation on discontinuous
+  // elements of one degree less. Simplex elements are only available from
+  // degree one, so the weight of a linear pressure vanishes there.
+  std::unique_ptr<FiniteElement<dim>> fe_low;
+  if (read_mesh_from_file)
+    fe_low = std::make_unique<FESystem<dim>>(
+        FE_SimplexDGP<dim>(std::max(degree_velocity, 2u) - 1),
+        dim,
+        FE_SimplexDGP<dim>(std::max(degree_pressure, 2u) - 1),
+        1);
+  else
+    fe_low = std::make_unique<FESystem<dim>>(FE_DGQ<dim>(degree_velocity - 1),
+                                             dim,
+                                             FE_DGQ<dim>(degree_pressure - 1),
+                                             1);
+
+  FullMatrix<double> interpolation_difference(dofs_per_cell, dofs_per_cell);
+  FETools::get_interpolation_difference_matrix(*fe,
+                                               *fe_low,
+                                               interpolation_difference);
+
+  // Residual of each cell, computed as in assemble_system(), tested with the
+  // weights of each functional.
+  std::vector<Tensor<1, dim>> velocity_loc(n_q);
+  std::vector<Tensor<2, dim>> velocity_gradient_loc(n_q);
+  std::vector<double> pressure_loc(n_q);
+  Tensor<1, dim> nonlinear_term;
+
+  Vector<double> cell_residual(dofs_per_cell);
+  Vector<double> adjoint_values(dofs_per_cell);
+  Vector<double> weights(dofs_per_cell);
+
+  error_indicators.reinit(triangulation().n_active_cells());
+  std::array<double, dim> local_errors{};
+
+  for (const auto &cell : dof_handler.active_cell_iterators())
+  {
+    if (!cell->is_locally_owned())
+      continue;
+
+    fe_values.reinit(cell);
+    cell_residual = 0.0;
+
+    fe_values[velocity].get_function_values(solution, velocity_loc);
+    fe_values[velocity].get_function_gradients(solution,
+                                               velocity_gradient_loc);
+    fe_values[pressure].get_function_values(solution, pressure_loc);
+
+    for (unsigned int q = 0; q < n_q; ++q)
+    {
+      // (u . nabla) u
+      for (unsigned int k = 0; k < dim; k++)
+      {
+        nonlinear_term[k] = 0.0;
+        for (unsigned int l = 0; l < dim; l++)
+          nonlinear_term[k] += velocity_loc[q][l] *
+                               velocity_gradient_loc[q][k][l];
+      }
+
+      const double velocity_divergence_loc = trace(velocity_gradient_loc[q]);
+
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+      {
+        cell_residual(i) -=
+            nu *
+            scalar_product(velocity_gradient_loc[q],
+                           fe_values[velocity].gradient(i, q)) *
+            fe_values.JxW(q);
+        cell_residual(i) -=
+            scalar_product(nonlinear_term, fe_values[velocity].value(i, q)) *
+            fe_values.JxW(q);
+        cell_residual(i) += pressure_loc[q] *
+                            fe_values[velocity].divergence(i, q) *
+                            fe_values.JxW(q);
+        cell_residual(i) -= velocity_divergence_loc *
+                            fe_values[pressure].value(i, q) * fe_values.JxW(q);
+      }
+    }
+
+    // Outlet pressure.
+    if (cell->at_boundary())
+    {
+      for (unsigned int f = 0; f < cell->n_faces(); ++f)
+      {
+        if (!cell->face(f)->at_boundary() || cell->face(f)->boundary_id() != 8)
+          continue;
+
+        fe_face_values.reinit(cell, f);
+        for (unsigned int q = 0; q < n_q_face; ++q)
+          for (unsigned int i = 0; i < dofs_per_cell; ++i)
+            cell_residual(i) -=
+                p_out *
+                scalar_product(fe_face_values.normal_vector(q),
+                               fe_face_values[velocity].value(i, q)) *
+                fe_face_values.JxW(q);
+      }
+    }
+
+    for (unsigned int c = 0; c < dim; ++c)
+    {
+      cell->get_dof_values(adjoints[c], adjoint_values);
+      interpolation_difference.vmult(weights, adjoint_values);
+
+      const double eta = cell_residual * weights;
+      local_errors[c] += eta;
+      error_indicators(cell->active_cell_index()) += std::fabs(eta);
+    }
+  }
+
+  drag_coeff_error = Utilities::MPI::sum(local_errors[0], MPI_COMM_WORLD);
+  lift_coeff_error = Utilities::MPI::sum(local_errors[1], MPI_COMM_WORLD);
+}
+
+void NSSolverStationary::solve_adjoint(
+    const TrilinosWrappers::MPI::BlockVector &functional_derivative,
+    TrilinosWrappers::MPI::BlockVector &adjoint_owned)
+{
+  SolverControl solver_control(200000, tolerance);
+
+  // The block-diagonal preconditioner of the Jacobian is used for its
+  // transpose as well: its velocity block is only approximately symmetric,
+  // which the flexible GMRES tolerates.
+  PreconditionBlockDiagonal preconditioner;
+  preconditioner.initialize(jacobian_matrix.block(0, 0),
+                            pressure_mass.block(1, 1),
+                            adjoint_owned);
+
+  const TransposeJacobian transpose_jacobian(jacobian_matrix);
+
+  adjoint_owned = 0.0;
+  SolverFGMRES<TrilinosWrappers::MPI::BlockVector> solver(solver_control);
+  solver.solve(transpose_jacobian,
+               adjoint_owned,
+               functional_derivative,
+               preconditioner);
+
+  pcout << " " << solver_control.last_step() << " solver iterations"
+        << std::endl;
+
+  // The rows of the Dirichlet and hanging node DoFs of the Jacobian only have
+  // a diagonal entry, so the other entries of the adjoint solution do not
+  // depend on these DoFs. The adjoint solution vanishes on the Dirichlet
+  // boundaries and satisfies the hanging node constraints.
+  const IndexSet dirichlet_dofs =
+      DoFTools::extract_boundary_dofs(dof_handler,
+                                      ComponentMask({true, true, false}),
+                                      {6, 7, 10});
+  for (const auto i : dirichlet_dofs)
+    if (locally_owned_dofs.is_element(i))
+      adjoint_owned(i) = 0.0;
+  adjoint_owned.compress(VectorOperation::insert);
+
+  hanging_node_constraints.distribute(adjoint_owned);
+}
+
+void NSSolverStationary::print_functional_errors()
+{
+  compute_drag_coeff();
+  compute_lift_coeff();
+
+  pcout << "===============================================" << std::endl;
+  pcout << "Drag coefficient: " << drag_coeff << " +/- "
+        << std::fabs(drag_coeff_error) << " (corrected: "
+        << drag_coeff + drag_coeff_error << ")" << std::endl;
+  pcout << "Lift coefficient: " << lift_coeff << " +/- "
+        << std::fabs(lift_coeff_error) << " (corrected: "
+        << lift_coeff + lift_coeff_error << ")" << std::endl;
+  pcout << "Sum of the error indicators: "
+        << Utilities::MPI::sum(static_cast<double>(error_indicators.l1_norm()),
+                               MPI_COMM_WORLD)
+        << std::endl;
+}
+
+void NSSolverStationary::refine_mesh()
+{
+  pcout << "===============================================" << std::endl;
+  pcout << "Refining the mesh" << std::endl;
+
+  parallel::distributed::GridRefinement::refine_and_coarsen_fixed_number(
+      mesh_adaptive, error_indicators, refine_fraction, 0.0);
+
+  // Do not refine beyond the maximum level.
+  for (const auto &cell : mesh_adaptive.active_cell_iterators())
+    if (cell->is_locally_owned() &&
+        cell->level() >= static_cast<int>(max_refinement_level))
+      cell->clear_refine_flag();
+
+  // The continuation restarts from the Stokes problem on the new mesh, so the
+  // solution is not transferred.
+  mesh_adaptive.execute_coarsening_and_refinement();
+  error_indicators.reinit(0);
+  setup_dofs();
+
+  pcout << "  Number of elements = " << mesh_adaptive.n_global_active_cells()
+        << ", number of DoFs = " << dof_handler.n_dofs() << std::endl;
+}
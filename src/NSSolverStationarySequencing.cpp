@@ -0,0 +1,147 @@
+#include "NSSolverStationary.hpp"
+
+#include <deal.II/base/timer.h>
+
+#include <deal.II/distributed/solution_transfer.h>
+
+// Mesh sequencing (nested iteration). The continuation from the Stokes
+// problem to the target Reynolds number, which takes tens of Newton
+// iterations, is only run on the coarsest mesh. The mesh is then refined
+// globally, and the converged solution interpolated on the finer mesh is
+// already within the region of quadratic convergence of Newton's method, so
+// that one or two iterations are enough on each level, the finest one
+// included.
+
+void NSSolverStationary::solve_mesh_sequencing()
+{
+  for (unsigned int level = 0; level < n_sequencing_levels; ++level)
+  {
+    Timer timer;
+    unsigned int n_newton_iters = 0;
+
+    if (level == 0)
+    {
+      pcout << "===============================================" << std::endl;
+      pcout << "Level 0: " << triangulation().n_global_active_cells()
+            << " cells, " << dof_handler.n_dofs() << " DoFs" << std::endl;
+
+      // solve_newton() leaves the viscosity and the inlet velocity at the
+      // end of the continuation, which the finer levels keep. Its iterations
+      // are those of the whole continuation.
+      n_newton_iters = solve_newton();
+    }
+    else
+    {
+      refine_mesh_globally();
+
+      pcout << "===============================================" << std::endl;
+      pcout << "Level " << level << ": "
+            << triangulation().n_global_active_cells() << " cells, "
+            << dof_handler.n_dofs() << " DoFs" << std::endl;
+
+      n_newton_iters = solve_newton_steps(max_sequencing_newton_steps);
+    }
+
+    const double wall_time = Utilities::MPI::max(timer.wall_time(), MPI_COMM_WORLD);
+
+    compute_lift_drag();
+    print_drag_coeff();
+    print_lift_coeff();
+    pcout << "  Solved in " << std::fixed << std::setprecision(2) << wall_time
+          << " s" << std::endl;
+
+    if (mpi_rank == 0)
+    {
+      std::ofstream file("mesh_sequencing.csv", std::ios::app);
+      if (file.tellp() == 0)
+        file << "level,n_cells,n_dofs,newton_iterations,residual,drag_coeff,"
+                "lift_coeff,wall_time\n";
+      file << level << "," << triangulation().n_global_active_cells() << ","
+           << dof_handler.n_dofs() << "," << n_newton_iters << ","
+           << residual_vector.l2_norm() << "," << drag_coeff << ","
+           << lift_coeff << "," << wall_time << "\n";
+    }
+  }
+
+  output();
+}
+
+void NSSolverStationary::refine_mesh_globally()
+{
+  pcout << "===============================================" << std::endl;
+  pcout << "Refining the mesh" << std::endl;
+
+  for (const auto &cell : mesh_adaptive.active_cell_iterators())
+    if (cell->is_locally_owned())
+      cell->set_refine_flag();
+
+  parallel::distributed::SolutionTransfer<dim,
+                                          TrilinosWrappers::MPI::BlockVector>
+      transfer(dof_handler);
+
+  mesh_adaptive.prepare_coarsening_and_refinement();
+  transfer.prepare_for_coarsening_and_refinement(solution);
+  mesh_adaptive.execute_coarsening_and_refinement();
+
+  setup_dofs();
+
+  // The finite element spaces are nested, so the interpolated solution is the
+  // coarse one and still satisfies its Dirichlet conditions: the increments
+  // keep homogeneous ones.
+  transfer.interpolate(solution_owned);
+  hanging_node_constraints.distribute(solution_owned);
+  solution = solution_owned;
+
+  pcout << "  Number of elements = " << mesh_adaptive.n_global_active_cells()
+        << ", number of DoFs = " << dof_handler.n_dofs() << std::endl;
+}
+
+unsigned int NSSolverStationary::solve_newton_steps(const unsigned int &max_steps)
+{
+  pcout << "Solving NS for nu = " << nu << ", Re = " << get_reynolds()
+        << ", at most " << max_steps << " Newton iterations" << std::endl;
+
+  assemble_system(false, false);
+  double residual_norm = residual_vector.l2_norm();
+  double prev_residual = residual_norm;
+
+  unsigned int n_iter = 0;
+  while (n_iter < max_steps && residual_norm > newton_residual_tolerance)
+  {
+    pcout << "Newton iteration " << n_iter << "/" << max_steps
+          << " - ||r|| = " << std::scientific << std::setprecision(6)
+          << residual_norm << std::endl;
+
+    if (solve_system() == 0)
+      break;
+
+    evaluation_point = solution;
+
+    // Same line search as in solve_newton().
+    for (double alpha = 1; alpha > 1e-12; alpha *= 0.1)
+    {
+      solution_owned = evaluation_point;
+      solution_owned.add(alpha, delta_owned);
+      solution = solution_owned;
+
+      assemble_system(false, false);
+      residual_norm = residual_vector.l2_norm();
+
+      pcout << "  Evaluating alpha=" << alpha << ", ||r||=" << residual_norm
+            << std::endl;
+
+      if (residual_norm < prev_residual)
+        break;
+    }
+
+    prev_residual = residual_norm;
+    ++n_iter;
+  }
+
+  pcout << "Final ||r|| = " << std::scientific << std::setprecision(6)
+        << residual_norm
+        << (residual_norm > newton_residual_tolerance ? " (not converged)" : "")
+        << std::endl;
+
+  return n_iter;
+}
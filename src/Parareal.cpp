@@ -0,0 +1,200 @@
+#include "Parareal.hpp"
+
+namespace
+{
+  // Split MPI_COMM_WORLD into the given number of groups of consecutive
+  // processes, returning the group of this process.
+  unsigned int
+  compute_slice(const unsigned int &n_slices)
+  {
+    const unsigned int n_processes =
+        Utilities::MPI::n_mpi_processes(MPI_COMM_WORLD);
+    AssertThrow(n_slices > 0 && n_processes % n_slices == 0,
+                ExcMessage("The number of MPI processes must be a multiple of "
+                           "the number of time slices."));
+
+    return Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) /
+           (n_processes / n_slices);
+  }
+}
+
+Parareal::Parareal(const unsigned int &n_slices_,
+                   const unsigned int &max_iterations_,
+                   const double &parareal_tolerance_,
+                   const std::string &mesh_file_name_,
+                   const unsigned int &degree_velocity_,
+                   const unsigned int &degree_pressure_,
+                   const double &T_,
+                   const double &delta_t_fine_,
+                   const double &delta_t_coarse_,
+                   const bool &coarse_semi_implicit_,
+                   const unsigned int &mesh_size_x_,
+                   const unsigned int &mesh_size_y_,
+                   const unsigned int &solver_type_,
+                   const double &tolerance_,
+                   const unsigned int &preconditioner_type_,
+                   double nu_,
+                   bool read_mesh_from_file_)
+    : n_slices(n_slices_), max_iterations(max_iterations_), parareal_tolerance(parareal_tolerance_), T(T_), slice(compute_slice(n_slices_)), pcout(std::cout, Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+{
+  const unsigned int world_rank = Utilities::MPI::this_mpi_process(MPI_COMM_WORLD);
+
+  MPI_Comm_split(MPI_COMM_WORLD, slice, world_rank, &slice_comm);
+  MPI_Comm_split(MPI_COMM_WORLD,
+                 Utilities::MPI::this_mpi_process(slice_comm),
+                 slice,
+                 &time_comm);
+
+  // Both propagators must end exactly on the slice boundaries.
+  const double slice_length = T / n_slices;
+  for (const double dt : {delta_t_fine_, delta_t_coarse_})
+  {
+    const double n_steps = slice_length / dt;
+    AssertThrow(std::abs(n_steps - std::round(n_steps)) < 1e-8 * n_steps,
+                ExcMessage("The time steps must divide the length of a time "
+                           "slice."));
+  }
+
+  fine = std::make_unique<NSSolver<2>>(mesh_file_name_, degree_velocity_, degree_pressure_, slice_length, delta_t_fine_, mesh_size_x_, mesh_size_y_, solver_type_, tolerance_, preconditioner_type_, nu_, read_mesh_from_file_, slice_comm);
+  coarse = std::make_unique<NSSolver<2>>(mesh_file_name_, degree_velocity_, degree_pressure_, slice_length, delta_t_coarse_, mesh_size_x_, mesh_size_y_, solver_type_, tolerance_, preconditioner_type_, nu_, read_mesh_from_file_, slice_comm);
+  coarse->set_semi_implicit(coarse_semi_implicit_);
+
+  // Only the driver writes on screen.
+  fine->set_verbose(false);
+  coarse->set_verbose(false);
+}
+
+Parareal::~Parareal()
+{
+  // The solvers hold the communicators, release them first.
+  fine.reset();
+  coarse.reset();
+  MPI_Comm_free(&time_comm);
+  MPI_Comm_free(&slice_comm);
+}
+
+void Parareal::setup()
+{
+  pcout << "===============================================" << std::endl;
+  pcout << "Parareal: " << n_slices << " time slices of "
+        << Utilities::MPI::n_mpi_processes(slice_comm) << " processes"
+        << std::endl;
+
+  fine->setup();
+  coarse->setup();
+
+  pcout << "===============================================" << std::endl;
+}
+
+void Parareal::send_state(const LA::MPI::BlockVector &state,
+                          const unsigned int &destination_slice) const
+{
+  for (unsigned int b = 0; b < state.n_blocks(); ++b)
+  {
+    const int ierr = MPI_Send(state.block(b).begin(),
+                              state.block(b).locally_owned_size(),
+                              MPI_DOUBLE,
+                              destination_slice,
+                              b,
+                              time_comm);
+    AssertThrowMPI(ierr);
+  }
+}
+
+void Parareal::receive_state(LA::MPI::BlockVector &state,
+                             const unsigned int &source_slice) const
+{
+  for (unsigned int b = 0; b < state.n_blocks(); ++b)
+  {
+    const int ierr = MPI_Recv(state.block(b).begin(),
+                              state.block(b).locally_owned_size(),
+                              MPI_DOUBLE,
+                              source_slice,
+                              b,
+                              time_comm,
+                              MPI_STATUS_IGNORE);
+    AssertThrowMPI(ierr);
+  }
+}
+
+void Parareal::run()
+{
+  const double slice_length = T / n_slices;
+  const double t_start = slice * slice_length;
+  const double t_end = t_start + slice_length;
+
+  // The first slice starts from the initial condition, on which the inlet
+  // velocity still has to be imposed.
+  const bool first_slice = (slice == 0);
+  const bool last_slice = (slice == n_slices - 1);
+
+  // Initial value and end value of this slice, and coarse propagation of the
+  // initial value at the previous iteration.
+  LA::MPI::BlockVector U_start(fine->get_solution());
+  LA::MPI::BlockVector U_end(fine->get_solution());
+  LA::MPI::BlockVector G_old(fine->get_solution());
+  LA::MPI::BlockVector F_end(fine->get_solution());
+  LA::MPI::BlockVector change(fine->get_solution());
+
+  Timer timer;
+
+  // Initial guess: sequential coarse propagation over all the slices.
+  if (!first_slice)
+    receive_state(U_start, slice - 1);
+  coarse->set_solution(U_start, first_slice);
+  coarse->advance(t_start, t_end);
+  G_old = coarse->get_solution();
+  U_end = G_old;
+  if (!last_slice)
+    send_state(U_end, slice + 1);
+
+  pcout << "Coarse propagation done in " << std::fixed << std::setprecision(2)
+        << Utilities::MPI::max(timer.wall_time(), MPI_COMM_WORLD) << " s"
+        << std::endl;
+
+  for (unsigned int k = 0; k < max_iterations; ++k)
+  {
+    // Fine propagation, concurrently on all the slices.
+    fine->set_solution(U_start, first_slice);
+    fine->advance(t_start, t_end);
+    F_end = fine->get_solution();
+
+    // Sequential correction with the coarse propagator.
+    if (!first_slice)
+      receive_state(U_start, slice - 1);
+    coarse->set_solution(U_start, first_slice);
+    coarse->advance(t_start, t_end);
+
+    // U_end = G_new + F_end - G_old
+    change = U_end;
+    U_end = coarse->get_solution();
+    U_end += F_end;
+    U_end -= G_old;
+    G_old = coarse->get_solution();
+
+    if (!last_slice)
+      send_state(U_end, slice + 1);
+
+    change -= U_end;
+    const double local_change =
+        change.l2_norm() / std::max(U_end.l2_norm(), 1e-12);
+    const double max_change = Utilities::MPI::max(local_change, MPI_COMM_WORLD);
+
+    pcout << "Parareal iteration " << k + 1 << " - max relative change = "
+          << std::scientific << std::setprecision(3) << max_change
+          << ", elapsed " << std::fixed << std::setprecision(2)
+          << Utilities::MPI::max(timer.wall_time(), MPI_COMM_WORLD) << " s"
+          << std::endl;
+
+    // After n_slices iterations the fine solution has been propagated
+    // through all the slices, so the iteration is exact.
+    if (max_change < parareal_tolerance || k + 1 == n_slices)
+      break;
+  }
+
+  // Write the solution at the end of each slice.
+  fine->set_solution(U_end, false);
+  fine->output(slice + 1);
+
+  pcout << "===============================================" << std::endl;
+}
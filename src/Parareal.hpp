@@ -0,0 +1,97 @@
+#ifndef PARAREAL_HPP
+#define PARAREAL_HPP
+
+#include "NSSolver.hpp"
+
+#include <memory>
+
+using namespace dealii;
+
+// Parareal driver around NSSolver. MPI_COMM_WORLD is split into n_slices
+// groups of processes, one for each time slice of [0, T]: each group holds
+// its own copy of the mesh, distributed over the processes of the group, and
+// two solvers on it, the fine propagator F (the time step and scheme of the
+// reference run) and the coarse propagator G (a larger time step, possibly
+// semi-implicit).
+//
+// At iteration k the fine propagators of all the slices run concurrently from
+// the current initial values U_n^k, then the initial values are corrected
+// sequentially from the first slice to the last,
+//   U_{n+1}^{k+1} = G(U_n^{k+1}) + F(U_n^k) - G(U_n^k),
+// which only requires the cheap coarse propagator. The values are exchanged
+// between the processes with the same rank in neighbouring groups: since all
+// the groups partition the mesh in the same way, each process only sends its
+// locally owned entries.
+class Parareal
+{
+public:
+  Parareal(const unsigned int &n_slices_,
+           const unsigned int &max_iterations_,
+           const double &parareal_tolerance_,
+           const std::string &mesh_file_name_,
+           const unsigned int &degree_velocity_,
+           const unsigned int &degree_pressure_,
+           const double &T_,
+           const double &delta_t_fine_,
+           const double &delta_t_coarse_,
+           const bool &coarse_semi_implicit_,
+           const unsigned int &mesh_size_x_,
+           const unsigned int &mesh_size_y_,
+           const unsigned int &solver_type_,
+           const double &tolerance_,
+           const unsigned int &preconditioner_type_,
+           double nu_,
+           bool read_mesh_from_file_);
+
+  ~Parareal();
+
+  // Set up the fine and coarse solvers of this time slice.
+  void
+  setup();
+
+  // Run the Parareal iterations and write the solution at the end of each
+  // time slice.
+  void
+  run();
+
+protected:
+  // Send the locally owned entries of a state to the given time slice.
+  void
+  send_state(const LA::MPI::BlockVector &state,
+             const unsigned int &destination_slice) const;
+
+  // Receive the locally owned entries of a state from the given time slice.
+  void
+  receive_state(LA::MPI::BlockVector &state,
+                const unsigned int &source_slice) const;
+
+  // Number of time slices, i.e. of process groups.
+  const unsigned int n_slices;
+
+  // Maximum number of Parareal iterations.
+  const unsigned int max_iterations;
+
+  // Tolerance on the relative change of the slice end values.
+  const double parareal_tolerance;
+
+  // Final time.
+  const double T;
+
+  // Time slice of this process.
+  const unsigned int slice;
+
+  // Processes of this time slice, sharing the mesh.
+  MPI_Comm slice_comm;
+
+  // Processes with the same rank in slice_comm, one for each time slice.
+  MPI_Comm time_comm;
+
+  // Parallel output stream, on the first process of MPI_COMM_WORLD.
+  ConditionalOStream pcout;
+
+  // Fine and coarse propagators, on the 2D problem.
+  std::unique_ptr<NSSolver<2>> fine;
+  std::unique_ptr<NSSolver<2>> coarse;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef PERIODICITYMONITOR_HPP
+#define PERIODICITYMONITOR_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Online monitor of the lift and drag coefficients of a transient run, which
+// detects when the flow has reached a periodic regime (e.g. vortex shedding).
+// Each cycle is delimited by two consecutive maxima of the lift coefficient,
+// located by a parabolic fit on the last three samples. The signal is
+// considered periodic when the period, the lift amplitude and the mean drag of
+// the last n_cycles cycles all differ from their averages by less than the
+// given relative tolerance.
+class PeriodicityMonitor
+{
+public:
+  // Statistics of a single cycle.
+  struct Cycle
+  {
+    double period;
+    double lift_max;
+    double lift_min;
+    double drag_max;
+    double drag_min;
+    double drag_mean;
+  };
+
+  PeriodicityMonitor(const unsigned int n_cycles_ = 5,
+                     const double tolerance_ = 1e-2)
+      : n_cycles(n_cycles_), tolerance(tolerance_)
+  {
+  }
+
+  // Add the coefficients at the given time. Returns true if a cycle has been
+  // completed.
+  bool
+  add_sample(const double time, const double lift, const double drag)
+  {
+    times.push_back(time);
+    lifts.push_back(lift);
+    drags.push_back(drag);
+
+    // before the first maximum, only the samples of the parabola are needed
+    if (cycle_start < 0.0 && times.size() > 3)
+      discard_samples(times.size() - 3);
+
+    const unsigned int n = times.size();
+    if (n < 3 || !(lifts[n - 2] > lifts[n - 3] && lifts[n - 2] >= lifts[n - 1]))
+      return false;
+
+    // time of the maximum, from the parabola through the last three samples
+    const double t_max = parabola_vertex(n - 3);
+
+    bool completed = false;
+    if (cycle_start >= 0.0)
+    {
+      Cycle cycle;
+      cycle.period = t_max - cycle_start;
+      cycle.lift_max = -std::numeric_limits<double>::max();
+      cycle.lift_min = std::numeric_limits<double>::max();
+      cycle.drag_max = -std::numeric_limits<double>::max();
+      cycle.drag_min = std::numeric_limits<double>::max();
+
+      // time average of the drag with the trapezoidal rule, over the samples
+      // of the cycle
+      double drag_integral = 0.0;
+      double length = 0.0;
+      for (unsigned int k = first_sample; k < n - 1; ++k)
+      {
+        cycle.lift_max = std::max(cycle.lift_max, lifts[k]);
+        cycle.lift_min = std::min(cycle.lift_min, lifts[k]);
+        cycle.drag_max = std::max(cycle.drag_max, drags[k]);
+        cycle.drag_min = std::min(cycle.drag_min, drags[k]);
+        if (k > first_sample)
+        {
+          drag_integral += 0.5 * (drags[k] + drags[k - 1]) * (times[k] - times[k - 1]);
+          length += times[k] - times[k - 1];
+        }
+      }
+      cycle.drag_mean = length > 0.0 ? drag_integral / length : drags[n - 2];
+
+      cycles.push_back(cycle);
+      completed = true;
+    }
+
+    // the new cycle starts at the sample of the maximum: the previous ones are
+    // not needed anymore
+    discard_samples(n - 2);
+    cycle_start = t_max;
+    first_sample = 0;
+    return completed;
+  }
+
+  // Whether the last n_cycles cycles are periodic within the tolerance.
+  bool
+  is_periodic() const
+  {
+    if (cycles.size() < n_cycles)
+      return false;
+
+    const Cycle average = get_average();
+    for (unsigned int c = cycles.size() - n_cycles; c < cycles.size(); ++c)
+    {
+      const Cycle &cycle = cycles[c];
+      if (relative_difference(cycle.period, average.period) > tolerance ||
+          relative_difference(cycle.lift_max - cycle.lift_min,
+                              average.lift_max - average.lift_min) > tolerance ||
+          relative_difference(cycle.drag_mean, average.drag_mean) > tolerance)
+        return false;
+    }
+
+    return true;
+  }
+
+  // Average of the statistics over the last n_cycles cycles (or over all of
+  // them, if fewer). The extrema are the extrema over those cycles.
+  Cycle
+  get_average() const
+  {
+    Cycle average = {0.0,
+                     -std::numeric_limits<double>::max(),
+                     std::numeric_limits<double>::max(),
+                     -std::numeric_limits<double>::max(),
+                     std::numeric_limits<double>::max(),
+                     0.0};
+
+    const unsigned int first =
+        cycles.size() > n_cycles ? cycles.size() - n_cycles : 0;
+    for (unsigned int c = first; c < cycles.size(); ++c)
+    {
+      average.period += cycles[c].period;
+      average.drag_mean += cycles[c].drag_mean;
+      average.lift_max = std::max(average.lift_max, cycles[c].lift_max);
+      average.lift_min = std::min(average.lift_min, cycles[c].lift_min);
+      average.drag_max = std::max(average.drag_max, cycles[c].drag_max);
+      average.drag_min = std::min(average.drag_min, cycles[c].drag_min);
+    }
+    if (cycles.size() > first)
+    {
+      average.period /= cycles.size() - first;
+      average.drag_mean /= cycles.size() - first;
+    }
+
+    return average;
+  }
+
+  // Number of completed cycles.
+  unsigned int
+  n_completed_cycles() const
+  {
+    return cycles.size();
+  }
+
+  // State of the monitor as a sequence of values, to be stored in a
+  // checkpoint: the completed cycles, the time of the last maximum and the
+  // samples still needed, i.e. those of the current cycle (only the last two
+  // before the first maximum).
+  std::vector<double>
+  save_state() const
+  {
+    const unsigned int n = times.size();
+    const unsigned int first =
+        cycle_start >= 0.0 ? first_sample : (n > 2 ? n - 2 : 0);
+
+    std::vector<double> state;
+    state.push_back(cycles.size());
+    for (const Cycle &cycle : cycles)
+      state.insert(state.end(),
+                   {cycle.period,
+                    cycle.lift_max,
+                    cycle.lift_min,
+                    cycle.drag_max,
+                    cycle.drag_min,
+                    cycle.drag_mean});
+    state.push_back(cycle_start);
+    state.push_back(cycle_start >= 0.0 ? first_sample - first : 0);
+    state.push_back(n - first);
+    for (unsigned int k = first; k < n; ++k)
+      state.insert(state.end(), {times[k], lifts[k], drags[k]});
+    return state;
+  }
+
+  // Restore a state returned by save_state(). The number of cycles and the
+  // tolerance are kept.
+  void
+  load_state(const std::vector<double> &state)
+  {
+    unsigned int i = 0;
+    cycles.resize(static_cast<unsigned int>(state[i++]));
+    for (Cycle &cycle : cycles)
+    {
+      cycle.period = state[i++];
+      cycle.lift_max = state[i++];
+      cycle.lift_min = state[i++];
+      cycle.drag_max = state[i++];
+      cycle.drag_min = state[i++];
+      cycle.drag_mean = state[i++];
+    }
+    cycle_start = state[i++];
+    first_sample = static_cast<unsigned int>(state[i++]);
+
+    const unsigned int n = static_cast<unsigned int>(state[i++]);
+    times.resize(n);
+    lifts.resize(n);
+    drags.resize(n);
+    for (unsigned int k = 0; k < n; ++k)
+    {
+      times[k] = state[i++];
+      lifts[k] = state[i++];
+      drags[k] = state[i++];
+    }
+  }
+
+protected:
+  // Remove the first n samples.
+  void
+  discard_samples(const unsigned int n)
+  {
+    times.erase(times.begin(), times.begin() + n);
+    lifts.erase(lifts.begin(), lifts.begin() + n);
+    drags.erase(drags.begin(), drags.begin() + n);
+  }
+
+  // Time of the vertex of the parabola through samples k, k + 1 and k + 2,
+  // falling back to the time of the middle sample if they are aligned.
+  double
+  parabola_vertex(const unsigned int k) const
+  {
+    const double t0 = times[k], t1 = times[k + 1], t2 = times[k + 2];
+    const double y0 = lifts[k], y1 = lifts[k + 1], y2 = lifts[k + 2];
+
+    const double denominator =
+        (t0 - t1) * (y1 - y2) - (t1 - t2) * (y0 - y1);
+    if (std::abs(denominator) < 1e-14)
+      return t1;
+
+    const double numerator = (t0 * t0 - t1 * t1) * (y1 - y2) -
+                             (t1 * t1 - t2 * t2) * (y0 - y1);
+    return std::clamp(0.5 * numerator / denominator, t0, t2);
+  }
+
+  static double
+  relative_difference(const double value, const double reference)
+  {
+    return std::abs(value - reference) / std::max(std::abs(reference), 1e-12);
+  }
+
+  // Number of cycles that must agree.
+  unsigned int n_cycles;
+
+  // Relative tolerance on period, lift amplitude and mean drag.
+  double tolerance;
+
+  // Samples of the coefficients, from the last maximum of the lift on (the
+  // last three before the first one).
+  std::vector<double> times;
+  std::vector<double> lifts;
+  std::vector<double> drags;
+
+  // Time of the last maximum of the lift, negative before the first one.
+  double cycle_start = -1.0;
+
+  // Index of the sample of the last maximum of the lift.
+  unsigned int first_sample = 0;
+
+  // Completed cycles.
+  std::vector<Cycle> cycles;
+};
+
+#endif
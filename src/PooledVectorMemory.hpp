@@ -0,0 +1,96 @@
+#ifndef POOLEDVECTORMEMORY_HPP
+#define POOLEDVECTORMEMORY_HPP
+
+#include <deal.II/lac/vector_memory.h>
+
+#include <memory>
+#include <vector>
+
+using namespace dealii;
+
+// Pool of pre-sized vectors handed to the inner Krylov solvers of the block
+// preconditioners. The vectors are created once by reserve(), which is called
+// when the preconditioner is initialized, and then recycled by alloc() and
+// free() at every application of the preconditioner. Since all the vectors in
+// the pool already share the parallel layout of the block they are used for,
+// the reinit() performed by the solvers does not allocate anything either.
+template <typename VectorType>
+class PooledVectorMemory : public VectorMemory<VectorType>
+{
+public:
+  // Make sure the pool holds at least n vectors with the same layout as the
+  // given one.
+  void
+  reserve(const unsigned int n, const VectorType &layout)
+  {
+    for (auto &v : pool)
+      v->reinit(layout);
+
+    while (pool.size() < n)
+    {
+      pool.emplace_back(std::make_unique<VectorType>(layout));
+      in_use.push_back(false);
+    }
+  }
+
+  // Hand out a free vector of the pool. A new vector is only created if the
+  // pool has been exhausted, in which case the allocation counter is
+  // incremented.
+  virtual VectorType *
+  alloc() override
+  {
+    for (unsigned int i = 0; i < pool.size(); ++i)
+    {
+      if (!in_use[i])
+      {
+        in_use[i] = true;
+        return pool[i].get();
+      }
+    }
+
+    ++allocations;
+    pool.emplace_back(std::make_unique<VectorType>());
+    in_use.push_back(true);
+    return pool.back().get();
+  }
+
+  // Give a vector back to the pool.
+  virtual void
+  free(const VectorType *const v) override
+  {
+    for (unsigned int i = 0; i < pool.size(); ++i)
+    {
+      if (pool[i].get() == v)
+      {
+        in_use[i] = false;
+        return;
+      }
+    }
+    Assert(false, ExcMessage("Vector does not belong to this pool."));
+  }
+
+  // Number of vectors allocated since the last call to reset_allocations().
+  unsigned int
+  n_allocations() const
+  {
+    return allocations;
+  }
+
+  void
+  reset_allocations()
+  {
+    allocations = 0;
+  }
+
+protected:
+  // Vectors owned by the pool.
+  std::vector<std::unique_ptr<VectorType>> pool;
+
+  // Whether each vector of the pool is currently handed out.
+  std::vector<bool> in_use;
+
+  // Vectors created after the pool was sized.
+  unsigned int allocations = 0;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef VECTORKERNELS_HPP
+#define VECTORKERNELS_HPP
+
+#include <deal.II/base/array_view.h>
+#include <deal.II/base/mpi.h>
+
+#include <array>
+#include <cmath>
+
+using namespace dealii;
+
+// Element-wise kernels used in the application of the block preconditioners.
+// Each of them replaces a sequence of separate vector operations (each being a
+// full sweep over memory) with a single sweep over the locally owned entries.
+// The vectors involved must share the same parallel layout.
+
+// dst = factor * (dst + src)
+template <typename VectorType>
+inline void
+fused_add_and_scale(VectorType &dst,
+                    const VectorType &src,
+                    const double factor)
+{
+  AssertDimension(dst.locally_owned_size(), src.locally_owned_size());
+
+  auto *__restrict d = dst.begin();
+  const auto *__restrict s = src.begin();
+  const auto n = dst.locally_owned_size();
+
+  for (decltype(dst.locally_owned_size()) i = 0; i < n; ++i)
+    d[i] = factor * (d[i] + s[i]);
+}
+
+// dst = dst - diag .* v
+template <typename VectorType>
+inline void
+fused_subtract_diagonal_scaled(VectorType &dst,
+                               const VectorType &diag,
+                               const VectorType &v)
+{
+  AssertDimension(dst.locally_owned_size(), diag.locally_owned_size());
+  AssertDimension(dst.locally_owned_size(), v.locally_owned_size());
+
+  auto *__restrict d = dst.begin();
+  const auto *__restrict a = diag.begin();
+  const auto *__restrict x = v.begin();
+  const auto n = dst.locally_owned_size();
+
+  for (decltype(dst.locally_owned_size()) i = 0; i < n; ++i)
+    d[i] -= a[i] * x[i];
+}
+
+// l2 norms of the velocity and pressure blocks of a block vector, computed
+// with a single global reduction instead of one for each block.
+template <typename BlockVectorType>
+inline std::array<double, 2>
+fused_block_l2_norms(const BlockVectorType &v)
+{
+#ifdef NS_USE_TPETRA
+  // Tpetra vectors do not expose their local entries as a plain array.
+  return {{v.block(0).l2_norm(), v.block(1).l2_norm()}};
+#else
+  std::array<double, 2> local_sqr = {{0.0, 0.0}};
+
+  for (unsigned int b = 0; b < 2; ++b)
+  {
+    const auto *__restrict x = v.block(b).begin();
+    const auto n = v.block(b).locally_owned_size();
+
+    for (decltype(v.block(b).locally_owned_size()) i = 0; i < n; ++i)
+      local_sqr[b] += x[i] * x[i];
+  }
+
+  std::array<double, 2> global_sqr;
+  Utilities::MPI::sum(ArrayView<const double>(local_sqr.data(), 2),
+                      v.block(0).get_mpi_communicator(),
+                      ArrayView<double>(global_sqr.data(), 2));
+
+  return {{std::sqrt(global_sqr[0]), std::sqrt(global_sqr[1])}};
+#endif
+}
+
+#endif
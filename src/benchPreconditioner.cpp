@@ -0,0 +1,128 @@
+#include "NSSolver.hpp"
+#include <getopt.h>
+#include <iostream>
+#include <cstdlib>
+
+// Function to print help message
+void print_help() {
+    std::cout << "Usage: ./PreconditionerBenchmark [options]\n\n"
+              << "Options:\n"
+              << "  -D, --dimension N         Space dimension (2 or 3)\n"
+              << "  -M, --read-mesh-from-file Provide mesh file path to load it instead or generating it inside the program\n"
+              << "  -m, --mesh-size X,Y       Set mesh size (two integers separated by a comma)\n"
+              << "  -n, --repetitions N       Number of timed preconditioner applications\n"
+              << "  -p, --preconditioner N    Preconditioner of the linear solve with -O (0: blockDiagonal, 1: blockTriangular, 2: aSIMPLE)\n"
+              << "  -O, --dof-ordering NAME   Benchmark assembly, matrix-vector product and linear solve with the given DoF ordering\n"
+              << "                            (none, cuthill-mckee, hilbert, downstream) instead of the preconditioner\n"
+              << "  -h, --help                Display this help message\n";
+}
+
+// Micro-benchmark of the aSIMPLE preconditioner application, or of the
+// kernels affected by the ordering of the DoFs.
+int main(int argc, char *argv[]) {
+    Utilities::MPI::MPI_InitFinalize mpi_init(argc, argv);
+
+    // Default parameters
+    int dim = 2;
+    bool read_mesh_from_file = false;
+    std::string mesh_path = "";
+    unsigned int degree_velocity = 3;
+    unsigned int degree_pressure = 2;
+    int mesh_size_x = 100, mesh_size_y = 100;
+    unsigned int repetitions = 100;
+    int preconditioner = 2;
+    std::string dof_ordering = "";
+
+    // Define long options
+    static struct option long_options[] = {
+        {"dimension", required_argument, 0, 'D'},
+        {"read-mesh-from-file", required_argument, 0, 'M'},
+        {"mesh-size", required_argument, 0, 'm'},
+        {"repetitions", required_argument, 0, 'n'},
+        {"preconditioner", required_argument, 0, 'p'},
+        {"dof-ordering", required_argument, 0, 'O'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "D:M:m:n:p:O:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'D':
+                dim = std::atoi(optarg);
+                if (dim != 2 && dim != 3) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: dimension must be 2 or 3\n";
+                    return 1;
+                }
+                break;
+            case 'M':
+                read_mesh_from_file = true;
+                mesh_path = optarg;
+                degree_velocity = 2;
+                degree_pressure = 1;
+                break;
+            case 'm': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    mesh_size_x = std::atoi(optarg);
+                    mesh_size_y = std::atoi(comma + 1);
+                } else {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: mesh-size requires two values separated by comma\n";
+                    return 1;
+                }
+                break;
+            }
+            case 'n':
+                repetitions = std::atoi(optarg);
+                break;
+            case 'p':
+                preconditioner = std::atoi(optarg);
+                break;
+            case 'O':
+                dof_ordering = optarg;
+                try {
+                    dof_ordering_from_string(dof_ordering);
+                } catch (const std::invalid_argument &) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: unknown DoF ordering " << dof_ordering << "\n";
+                    return 1;
+                }
+                break;
+            case 'h':
+                if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                    print_help();
+                return 0;
+            default:
+                if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                    print_help();
+                return 1;
+        }
+    }
+
+    if (repetitions == 0) {
+        if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+            std::cerr << "Error: repetitions must be positive\n";
+        return 1;
+    }
+
+    dispatch_dimension(dim, [&](const auto dim_constant) {
+        NSSolver<decltype(dim_constant)::value> problem(mesh_path, degree_velocity, degree_pressure, 1.0, 0.01, mesh_size_x, mesh_size_y, 1, 1e-6, preconditioner, 0.1, read_mesh_from_file);
+
+        if (!dof_ordering.empty())
+        {
+            problem.set_dof_ordering(dof_ordering_from_string(dof_ordering));
+            problem.setup();
+            problem.benchmark_dof_ordering(repetitions);
+        }
+        else
+        {
+            problem.setup();
+            problem.benchmark_preconditioner(repetitions);
+        }
+    });
+
+    return 0;
+}
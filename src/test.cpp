@@ -8,12 +8,31 @@ void print_help() {
     std::cout << "Usage: ./NSSolver [options]\n\n"
               << "Options:\n"
               << "  -T, --time-span and time-step T,D\n"
+              << "  -D, --dimension N         Space dimension (2, or 3 for the channel of square section)\n"
               << "  -M, --read-mesh-from-file Provide mesh file path to load it instead or generating it inside the program\n"
               << "  -m, --mesh-size X,Y       Set mesh size (two integers separated by a comma)\n"
+              << "  -q, --degrees V,P         Velocity and pressure degrees (default 3,2, or 2,1 with -M), V = P for stabilized equal-order elements\n"
+              << "  -G, --cylinder-mesh SIZE  Generate a boundary-fitted mesh instead (coarse, medium, fine or cells on cylinder, walls, inlet NC,NW,NI)\n"
               << "  -v, --viscosity D         Set viscosity value (floating point value)\n"
               << "  -s, --solver N            Select solver (valid values: 0: GMRES, 1: FGMRES, 2: Bicgstab)\n"
               << "  -t, --tolerance D         Set tolerance (floating point value)\n"
               << "  -p, --preconditioner N    Select preconditioner (valid values: 0: blockDiagonal, 1: blockTriangular, 2: aSIMPLE)\n"
+              << "  -g, --mesh-group-size N   Build the serial mesh once per group of N processes (default: once per node)\n"
+              << "  -C, --mesh-cache DIR      Load the distributed mesh, the DoF numbering and the sparsity patterns from a cache in DIR, writing it on the first run\n"
+              << "  -W, --partition-weights O,C Weight of an outlet (O) and a cylinder (C) face relative to a cell when partitioning\n"
+              << "  -V, --partition-vertices  Partition on the vertex connectivity of the cells, to reduce the ghost exchange\n"
+              << "  -O, --dof-ordering NAME   Order the DoFs within each block (none, cuthill-mckee, hilbert, downstream)\n"
+              << "  -A, --adapt-mesh N[,L]    Adapt the mesh every N time steps with the Kelly indicator, up to L levels (default 3)\n"
+              << "  -o, --owner-computes      Assemble only the locally owned rows, on owned and ghost cells\n"
+              << "  -a, --adaptive-time-step D  Adapt the time step to keep the relative local error below D\n"
+              << "  -b, --bdf-order N         Order of the BDF time integration scheme (1, 2 or 3)\n"
+              << "  -i, --semi-implicit       Extrapolate the convection field and do a single linear solve per time step\n"
+              << "  -c, --pressure-correction Use the incremental pressure-correction scheme instead of the coupled solver\n"
+              << "  -d, --detect-periodic N,D Report when lift and drag are periodic over N cycles, within relative tolerance D\n"
+              << "  -e, --stop-when-periodic  Stop the run once the periodic regime is detected\n"
+              << "  -k, --checkpoint N        Write checkpoint.bin every N time steps\n"
+              << "  -R, --restart FILE        Resume the run from a checkpoint (the mesh options must be the same)\n"
+              << "  -I, --initial-condition FILE[,A] Start from a solution written by StationaryNSSolver -w, perturbed with amplitude A (default 0.1)\n"
               << "  -h, --help                Display this help message\n";
 }
 
@@ -22,34 +41,76 @@ int main(int argc, char *argv[]) {
     Utilities::MPI::MPI_InitFinalize mpi_init(argc, argv);
 
     // Default parameters
+    int dim = 2;
     bool read_mesh_from_file = false;
     std::string mesh_path = "";
     unsigned int degree_velocity = 3;
     unsigned int degree_pressure = 2;
+    bool degrees_given = false;
     double nu = 0.1;
     int mesh_size_x = 100, mesh_size_y = 100;
+    std::string cylinder_mesh = "";
     int solver_type = 1;
     double tolerance = 1e-6;
     int preconditioner = 0;
     double time_span = 1.0;
     double time_step = 0.01;
+    bool owner_computes = false;
+    double time_step_tolerance = 0.0;
+    int bdf_order = 1;
+    bool semi_implicit = false;
+    bool pressure_correction = false;
+    int periodic_cycles = 0;
+    double periodic_tolerance = 1e-2;
+    bool stop_when_periodic = false;
+    int checkpoint_interval = 0;
+    int mesh_group_size = 0;
+    std::string mesh_cache_directory = "";
+    double outlet_face_weight = 0.0;
+    double cylinder_face_weight = 0.0;
+    bool partition_vertices = false;
+    std::string dof_ordering = "none";
+    int refinement_interval = 0;
+    int max_refinement_level = 3;
+    std::string restart_file = "";
+    std::string initial_condition_file = "";
+    double perturbation_amplitude = 0.1;
 
     // Define long options
     static struct option long_options[] = {
         {"timespan-step", required_argument, 0, 'T'}, 
+        {"dimension", required_argument, 0, 'D'},
         {"read-mesh-from-file", required_argument, 0, 'M'},
         {"mesh-size", required_argument, 0, 'm'},
+        {"degrees", required_argument, 0, 'q'},
+        {"cylinder-mesh", required_argument, 0, 'G'},
         {"viscosity", required_argument, 0, 'v'},
         {"solver", required_argument, 0, 's'},
         {"tolerance", required_argument, 0, 't'},
         {"preconditioner", required_argument, 0, 'p'},
+        {"mesh-group-size", required_argument, 0, 'g'},
+        {"mesh-cache", required_argument, 0, 'C'},
+        {"partition-weights", required_argument, 0, 'W'},
+        {"partition-vertices", no_argument, 0, 'V'},
+        {"dof-ordering", required_argument, 0, 'O'},
+        {"adapt-mesh", required_argument, 0, 'A'},
+        {"owner-computes", no_argument, 0, 'o'},
+        {"adaptive-time-step", required_argument, 0, 'a'},
+        {"bdf-order", required_argument, 0, 'b'},
+        {"semi-implicit", no_argument, 0, 'i'},
+        {"pressure-correction", no_argument, 0, 'c'},
+        {"detect-periodic", required_argument, 0, 'd'},
+        {"stop-when-periodic", no_argument, 0, 'e'},
+        {"checkpoint", required_argument, 0, 'k'},
+        {"restart", required_argument, 0, 'R'},
+        {"initial-condition", required_argument, 0, 'I'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
     // Modified getopt_long string to match the new format
-    while ((opt = getopt_long(argc, argv, "T:M:m:v:s:t:p:h", long_options, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "T:D:M:m:q:G:v:s:t:p:g:C:W:VO:A:oa:b:icd:ek:R:I:h", long_options, nullptr)) != -1) {
         switch (opt) {
             case 'T': { 
                 char* comma = strchr(optarg, ',');
@@ -75,9 +136,34 @@ int main(int argc, char *argv[]) {
                         std::cerr << "Error: No file path provided for -M option.\n";
                     return 1;
                 }
-                degree_velocity = 2;
-                degree_pressure = 1;
+                if (!degrees_given) {
+                    degree_velocity = 2;
+                    degree_pressure = 1;
+                }
+                break;
+            case 'D':
+                dim = std::atoi(optarg);
+                if (dim != 2 && dim != 3) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: dimension must be 2 or 3\n";
+                    return 1;
+                }
+                break;
+            case 'q': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    degree_velocity = std::atoi(optarg);
+                    degree_pressure = std::atoi(comma + 1);
+                    degrees_given = true;
+                }
+                if (!comma || degree_pressure < 1 || degree_velocity < degree_pressure) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: degrees requires two values V,P separated by comma, with V >= P >= 1\n";
+                    return 1;
+                }
                 break;
+            }
             case 'm': {
                 char* comma = strchr(optarg, ',');
                 if (comma) {
@@ -91,6 +177,16 @@ int main(int argc, char *argv[]) {
                 }
                 break;
             }
+            case 'G':
+                cylinder_mesh = optarg;
+                try {
+                    CylinderMesh::parameters_from_string(cylinder_mesh);
+                } catch (const std::invalid_argument &) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: cylinder-mesh requires coarse, medium, fine or three values separated by commas\n";
+                    return 1;
+                }
+                break;
             case 'v':
                 nu = std::atof(optarg);
                 break;
@@ -103,6 +199,114 @@ int main(int argc, char *argv[]) {
             case 'p':
                 preconditioner = std::atoi(optarg);
                 break;
+            case 'o':
+                owner_computes = true;
+                break;
+            case 'a':
+                time_step_tolerance = std::atof(optarg);
+                if (time_step_tolerance <= 0) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: adaptive-time-step tolerance must be positive\n";
+                    return 1;
+                }
+                break;
+            case 'b':
+                bdf_order = std::atoi(optarg);
+                if (bdf_order < 1 || bdf_order > 3) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: bdf-order must be 1, 2 or 3\n";
+                    return 1;
+                }
+                break;
+            case 'i':
+                semi_implicit = true;
+                break;
+            case 'c':
+                pressure_correction = true;
+                break;
+            case 'd': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    periodic_tolerance = std::atof(comma + 1);
+                }
+                periodic_cycles = std::atoi(optarg);
+                if (periodic_cycles <= 0 || periodic_tolerance <= 0) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: detect-periodic requires a positive number of cycles and tolerance\n";
+                    return 1;
+                }
+                break;
+            }
+            case 'e':
+                stop_when_periodic = true;
+                break;
+            case 'g':
+                mesh_group_size = std::atoi(optarg);
+                break;
+            case 'C':
+                mesh_cache_directory = optarg;
+                break;
+            case 'W': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    outlet_face_weight = std::atof(optarg);
+                    cylinder_face_weight = std::atof(comma + 1);
+                } else {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: partition-weights requires two values separated by comma\n";
+                    return 1;
+                }
+                if (outlet_face_weight < 0 || cylinder_face_weight < 0) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: partition weights must be non-negative\n";
+                    return 1;
+                }
+                break;
+            }
+            case 'V':
+                partition_vertices = true;
+                break;
+            case 'O':
+                dof_ordering = optarg;
+                try {
+                    dof_ordering_from_string(dof_ordering);
+                } catch (const std::invalid_argument &) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: unknown DoF ordering " << dof_ordering << "\n";
+                    return 1;
+                }
+                break;
+            case 'A': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    max_refinement_level = std::atoi(comma + 1);
+                }
+                refinement_interval = std::atoi(optarg);
+                if (refinement_interval <= 0 || max_refinement_level <= 0) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: adapt-mesh requires a positive interval and number of levels\n";
+                    return 1;
+                }
+                break;
+            }
+            case 'k':
+                checkpoint_interval = std::atoi(optarg);
+                break;
+            case 'R':
+                restart_file = optarg;
+                break;
+            case 'I': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    perturbation_amplitude = std::atof(comma + 1);
+                }
+                initial_condition_file = optarg;
+                break;
+            }
             case 'h':
                 if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
                     print_help();
@@ -121,6 +325,13 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Equal-order elements are only stabilized in the coupled solver
+    if (pressure_correction && degree_velocity == degree_pressure) {
+        if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+            std::cerr << "Error: pressure-correction requires V > P\n";
+        return 1;
+    }
+
     // Print the parsed values
     // only the first MPI rank prints the values
     if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
@@ -128,7 +339,14 @@ int main(int argc, char *argv[]) {
         std::cout << "--------- CONFIGURATION PARAMETERS --------- \n";
         std::cout << "Time span: " << time_span << "\n";
         std::cout << "Time step: " << time_step << "\n";    
-        std::cout << "Mesh size: " << mesh_size_x << "x" << mesh_size_y << "\n";
+        std::cout << "Dimension: " << dim << "\n";
+        std::cout << "Degrees: " << degree_velocity << "," << degree_pressure
+                  << (degree_velocity == degree_pressure ? " (SUPG/PSPG/LSIC stabilized)" : "") << "\n";
+        if (!cylinder_mesh.empty()) {
+            std::cout << "Cylinder mesh: " << cylinder_mesh << "\n";
+        } else {
+            std::cout << "Mesh size: " << mesh_size_x << "x" << mesh_size_y << "\n";
+        }
         std::cout << "Viscosity: " << nu << "\n";
         std::cout << "Solver type: ";
         if (solver_type == 0) {
@@ -151,13 +369,64 @@ int main(int argc, char *argv[]) {
         else if(preconditioner == 2) {
             std::cout << "aSIMPLE\n";
         }
+        std::cout << "Assembly: " << (owner_computes ? "owner-computes" : "owned cells") << "\n";
+        std::cout << "Time scheme: BDF" << bdf_order
+                  << (pressure_correction ? ", pressure-correction"
+                      : semi_implicit     ? ", semi-implicit"
+                                          : ", Newton")
+                  << "\n";
+        if (time_step_tolerance > 0) {
+            std::cout << "Adaptive time step tolerance: " << time_step_tolerance << "\n";
+        }
+        if (periodic_cycles > 0) {
+            std::cout << "Periodicity detection: " << periodic_cycles << " cycles, tolerance "
+                      << periodic_tolerance << (stop_when_periodic ? ", stop when periodic" : "") << "\n";
+        }
+        if (checkpoint_interval > 0) {
+            std::cout << "Checkpoint every " << checkpoint_interval << " time steps\n";
+        }
+        if (!restart_file.empty()) {
+            std::cout << "Restart from: " << restart_file << "\n";
+        }
+        if (!initial_condition_file.empty()) {
+            std::cout << "Initial condition: " << initial_condition_file
+                      << ", perturbation " << perturbation_amplitude << "\n";
+        }
         std::cout << "-----------------------------------------------\n";
     }
     
-    NSSolver problem(mesh_path, degree_velocity, degree_pressure, time_span, time_step, mesh_size_x, mesh_size_y, solver_type, tolerance, preconditioner, nu, read_mesh_from_file);
+    // The solver is compiled for 2D and 3D, the dimension is chosen here.
+    dispatch_dimension(dim, [&](const auto dim_constant) {
+        NSSolver<decltype(dim_constant)::value> problem(mesh_path, degree_velocity, degree_pressure, time_span, time_step, mesh_size_x, mesh_size_y, solver_type, tolerance, preconditioner, nu, read_mesh_from_file);
+
+        problem.set_owner_computes_assembly(owner_computes);
+        if (!cylinder_mesh.empty())
+            problem.set_cylinder_mesh(CylinderMesh::parameters_from_string(cylinder_mesh));
+        if (mesh_group_size > 0)
+            problem.set_mesh_group_size(mesh_group_size);
+        if (!mesh_cache_directory.empty())
+            problem.set_mesh_cache_directory(mesh_cache_directory);
+        problem.set_partitioning(outlet_face_weight, cylinder_face_weight, partition_vertices);
+        problem.set_dof_ordering(dof_ordering_from_string(dof_ordering));
+        if (refinement_interval > 0)
+            problem.set_adaptive_refinement(refinement_interval, max_refinement_level);
+        problem.set_bdf_order(bdf_order);
+        problem.set_semi_implicit(semi_implicit);
+        problem.set_projection_scheme(pressure_correction);
+        if (periodic_cycles > 0)
+            problem.set_periodicity_detection(periodic_cycles, periodic_tolerance, stop_when_periodic);
+        if (checkpoint_interval > 0)
+            problem.set_checkpoint_interval(checkpoint_interval);
+        if (!restart_file.empty())
+            problem.set_restart_file(restart_file);
+        if (!initial_condition_file.empty())
+            problem.set_initial_condition_file(initial_condition_file, perturbation_amplitude);
+        if (time_step_tolerance > 0)
+            problem.set_adaptive_time_stepping(time_step_tolerance);
 
-    problem.setup();
-    problem.solve();
+        problem.setup();
+        problem.solve();
+    });
 
     return 0;
 }
@@ -0,0 +1,172 @@
+#include "Parareal.hpp"
+#include <getopt.h>
+#include <iostream>
+#include <cstdlib>
+
+// Function to print help message
+void print_help() {
+    std::cout << "Usage: ./PararealNSSolver [options]\n\n"
+              << "Options:\n"
+              << "  -T, --time-span and time-step T,D\n"
+              << "  -M, --read-mesh-from-file Provide mesh file path to load it instead or generating it inside the program\n"
+              << "  -m, --mesh-size X,Y       Set mesh size (two integers separated by a comma)\n"
+              << "  -v, --viscosity D         Set viscosity value (floating point value)\n"
+              << "  -s, --solver N            Select solver (valid values: 0: GMRES, 1: FGMRES, 2: Bicgstab)\n"
+              << "  -t, --tolerance D         Set tolerance (floating point value)\n"
+              << "  -p, --preconditioner N    Select preconditioner (valid values: 0: blockDiagonal, 1: blockTriangular, 2: aSIMPLE)\n"
+              << "  -n, --time-slices N       Number of time slices (must divide the number of MPI processes)\n"
+              << "  -C, --coarse-time-step D  Time step of the coarse propagator\n"
+              << "  -i, --coarse-semi-implicit Use the semi-implicit mode in the coarse propagator\n"
+              << "  -k, --iterations N        Maximum number of Parareal iterations\n"
+              << "  -e, --parareal-tolerance D Tolerance on the relative change of the slice end values\n"
+              << "  -h, --help                Display this help message\n";
+}
+
+// Main function.
+int main(int argc, char *argv[]) {
+    Utilities::MPI::MPI_InitFinalize mpi_init(argc, argv);
+
+    // Default parameters
+    bool read_mesh_from_file = false;
+    std::string mesh_path = "";
+    unsigned int degree_velocity = 3;
+    unsigned int degree_pressure = 2;
+    double nu = 0.1;
+    int mesh_size_x = 100, mesh_size_y = 100;
+    int solver_type = 1;
+    double tolerance = 1e-6;
+    int preconditioner = 0;
+    double time_span = 1.0;
+    double time_step = 0.01;
+    int n_slices = Utilities::MPI::n_mpi_processes(MPI_COMM_WORLD);
+    double coarse_time_step = 0.0;
+    bool coarse_semi_implicit = false;
+    int iterations = 0;
+    double parareal_tolerance = 1e-6;
+
+    // Define long options
+    static struct option long_options[] = {
+        {"timespan-step", required_argument, 0, 'T'},
+        {"read-mesh-from-file", required_argument, 0, 'M'},
+        {"mesh-size", required_argument, 0, 'm'},
+        {"viscosity", required_argument, 0, 'v'},
+        {"solver", required_argument, 0, 's'},
+        {"tolerance", required_argument, 0, 't'},
+        {"preconditioner", required_argument, 0, 'p'},
+        {"time-slices", required_argument, 0, 'n'},
+        {"coarse-time-step", required_argument, 0, 'C'},
+        {"coarse-semi-implicit", no_argument, 0, 'i'},
+        {"iterations", required_argument, 0, 'k'},
+        {"parareal-tolerance", required_argument, 0, 'e'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "T:M:m:v:s:t:p:n:C:ik:e:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'T': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    time_span = std::atof(optarg);
+                    time_step = std::atof(comma + 1);
+                } else {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: timespan-step requires two values separated by comma\n";
+                    return 1;
+                }
+                break;
+            }
+            case 'M':
+                read_mesh_from_file = true;
+                mesh_path = optarg;
+                degree_velocity = 2;
+                degree_pressure = 1;
+                break;
+            case 'm': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    mesh_size_x = std::atoi(optarg);
+                    mesh_size_y = std::atoi(comma + 1);
+                } else {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: mesh-size requires two values separated by comma\n";
+                    return 1;
+                }
+                break;
+            }
+            case 'v':
+                nu = std::atof(optarg);
+                break;
+            case 's':
+                solver_type = std::atoi(optarg);
+                break;
+            case 't':
+                tolerance = std::atof(optarg);
+                break;
+            case 'p':
+                preconditioner = std::atoi(optarg);
+                break;
+            case 'n':
+                n_slices = std::atoi(optarg);
+                break;
+            case 'C':
+                coarse_time_step = std::atof(optarg);
+                break;
+            case 'i':
+                coarse_semi_implicit = true;
+                break;
+            case 'k':
+                iterations = std::atoi(optarg);
+                break;
+            case 'e':
+                parareal_tolerance = std::atof(optarg);
+                break;
+            case 'h':
+                if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                    print_help();
+                return 0;
+            default:
+                if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                    print_help();
+                return 1;
+        }
+    }
+
+    // By default the coarse propagator takes ten fine steps at a time, and
+    // the iteration is run until it is exact.
+    if (coarse_time_step <= 0)
+        coarse_time_step = 10 * time_step;
+    if (iterations <= 0)
+        iterations = n_slices;
+
+    if (time_step <= 0 || time_span <= 0 || tolerance <= 0 || n_slices <= 0) {
+        if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+            std::cerr << "Error: time_step, time_span, tolerance and time-slices must be positive\n";
+        return 1;
+    }
+
+    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+    {
+        std::cout << "--------- CONFIGURATION PARAMETERS --------- \n";
+        std::cout << "Time span: " << time_span << "\n";
+        std::cout << "Fine time step: " << time_step << "\n";
+        std::cout << "Coarse time step: " << coarse_time_step
+                  << (coarse_semi_implicit ? " (semi-implicit)" : " (Newton)") << "\n";
+        std::cout << "Time slices: " << n_slices << "\n";
+        std::cout << "Parareal iterations: " << iterations << ", tolerance "
+                  << parareal_tolerance << "\n";
+        std::cout << "Mesh size: " << mesh_size_x << "x" << mesh_size_y << "\n";
+        std::cout << "Viscosity: " << nu << "\n";
+        std::cout << "-----------------------------------------------\n";
+    }
+
+    Parareal parareal(n_slices, iterations, parareal_tolerance, mesh_path, degree_velocity, degree_pressure, time_span, time_step, coarse_time_step, coarse_semi_implicit, mesh_size_x, mesh_size_y, solver_type, tolerance, preconditioner, nu, read_mesh_from_file);
+
+    parareal.setup();
+    parareal.run();
+
+    return 0;
+}
@@ -9,10 +9,14 @@ void print_help() {
               << "Options:\n"
               << "  -M, --read-mesh-from-file Provide mesh file path to load it instead or generating it inside the program\n"
               << "  -m, --mesh-size X,Y       Set mesh size (two integers separated by a comma)\n"
+              << "  -G, --cylinder-mesh SIZE  Generate a boundary-fitted mesh instead (coarse, medium, fine or cells on cylinder, walls, inlet NC,NW,NI)\n"
               << "  -v, --viscosity D         Set viscosity value (floating point value)\n"
               << "  -s, --solver N            Select solver (valid values: 0: GMRES, 1: FGMRES, 2: Bicgstab)\n"
               << "  -t, --tolerance D         Set tolerance (floating point value)\n"
               << "  -p, --preconditioner N    Select preconditioner (valid values: 0: blockDiagonal, 1: blockTriangular, 2: aSIMPLE)\n"
+              << "  -w, --write-solution FILE Write the converged solution, to be used as initial condition by NSSolver -I\n"
+              << "  -D, --dwr N[,L]           Estimate the drag and lift errors, refining the mesh N-1 times with the DWR indicators up to L levels (default 3)\n"
+              << "  -S, --mesh-sequencing N[,K] Solve on the generated mesh, then refine it N-1 times starting from the coarser solution, with at most K Newton iterations (default 2)\n"
               << "  -h, --help                Display this help message\n";
 }
 
@@ -26,25 +30,35 @@ int main(int argc, char *argv[]) {
     std::string mesh_path = "";
     double nu = 0.1;
     int mesh_size_x = 100, mesh_size_y = 100;
+    std::string cylinder_mesh = "";
     int solver_type = 1;
     double tolerance = 1e-6;
     int preconditioner = 0;
+    std::string solution_file = "";
+    int dwr_cycles = 0;
+    int max_refinement_level = 3;
+    int sequencing_levels = 0;
+    int sequencing_newton_steps = 2;
 
     // Define long options
     static struct option long_options[] = {
         {"read-mesh-from-file", required_argument, 0, 'M'},
         {"mesh-size", required_argument, 0, 'm'},
+        {"cylinder-mesh", required_argument, 0, 'G'},
         {"viscosity", required_argument, 0, 'v'},
         {"solver", required_argument, 0, 's'},
         {"tolerance", required_argument, 0, 't'},
         {"preconditioner", required_argument, 0, 'p'},
+        {"write-solution", required_argument, 0, 'w'},
+        {"dwr", required_argument, 0, 'D'},
+        {"mesh-sequencing", required_argument, 0, 'S'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
     // Modified getopt_long string to match the required format
-    while ((opt = getopt_long(argc, argv, "M:m:v:s:t:p:h", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "M:m:G:v:s:t:p:w:D:S:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'M':
                 read_mesh_from_file = true;
@@ -73,6 +87,16 @@ int main(int argc, char *argv[]) {
                 }
                 break;
             }
+            case 'G':
+                cylinder_mesh = optarg;
+                try {
+                    CylinderMesh::parameters_from_string(cylinder_mesh);
+                } catch (const std::invalid_argument &) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: cylinder-mesh requires coarse, medium, fine or three values separated by commas\n";
+                    return 1;
+                }
+                break;
             case 'v':
                 nu = std::atof(optarg);
                 break;
@@ -85,6 +109,37 @@ int main(int argc, char *argv[]) {
             case 'p':
                 preconditioner = std::atoi(optarg);
                 break;
+            case 'w':
+                solution_file = optarg;
+                break;
+            case 'D': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    max_refinement_level = std::atoi(comma + 1);
+                }
+                dwr_cycles = std::atoi(optarg);
+                if (dwr_cycles <= 0 || max_refinement_level <= 0) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: dwr requires a positive number of cycles and of levels\n";
+                    return 1;
+                }
+                break;
+            }
+            case 'S': {
+                char* comma = strchr(optarg, ',');
+                if (comma) {
+                    *comma = '\0';
+                    sequencing_newton_steps = std::atoi(comma + 1);
+                }
+                sequencing_levels = std::atoi(optarg);
+                if (sequencing_levels <= 0 || sequencing_newton_steps <= 0) {
+                    if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+                        std::cerr << "Error: mesh-sequencing requires a positive number of levels and of Newton iterations\n";
+                    return 1;
+                }
+                break;
+            }
             case 'h':
                 if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
                     print_help();
@@ -103,11 +158,27 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Mesh sequencing refines the mesh like goal-oriented refinement
+    if (sequencing_levels > 1 && dwr_cycles > 0) {
+        if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+            std::cerr << "Error: mesh-sequencing cannot be combined with dwr\n";
+        return 1;
+    }
+    if ((sequencing_levels > 1 || dwr_cycles > 1) && !solution_file.empty()) {
+        if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
+            std::cerr << "Error: a solution on a refined mesh cannot be written\n";
+        return 1;
+    }
+
     // Print the parsed values
     if(Utilities::MPI::this_mpi_process(MPI_COMM_WORLD) == 0)
     {
         std::cout << "--------- CONFIGURATION PARAMETERS --------- \n";
-        std::cout << "Mesh size: " << mesh_size_x << "x" << mesh_size_y << "\n";
+        if (!cylinder_mesh.empty()) {
+            std::cout << "Cylinder mesh: " << cylinder_mesh << "\n";
+        } else {
+            std::cout << "Mesh size: " << mesh_size_x << "x" << mesh_size_y << "\n";
+        }
         std::cout << "Viscosity: " << nu << "\n";
         std::cout << "Solver type: ";
         if (solver_type == 0) {
@@ -130,17 +201,43 @@ int main(int argc, char *argv[]) {
         else if(preconditioner == 2) {
         std::cout << "aSIMPLE\n";
         }
+        if (sequencing_levels > 1) {
+        std::cout << "Mesh sequencing: " << sequencing_levels << " levels, "
+                  << sequencing_newton_steps << " Newton iterations\n";
+        }
         std::cout << "-----------------------------------------------\n";
     }
     
     NSSolverStationary problem(mesh_path, degree_velocity, degree_pressure, mesh_size_x, mesh_size_y, solver_type, tolerance, preconditioner, nu, read_mesh_from_file);
 
+    if (!cylinder_mesh.empty())
+        problem.set_cylinder_mesh(CylinderMesh::parameters_from_string(cylinder_mesh));
+    if (dwr_cycles > 0)
+        problem.set_goal_oriented_refinement(dwr_cycles, max_refinement_level);
+    if (sequencing_levels > 1)
+        problem.set_mesh_sequencing(sequencing_levels, sequencing_newton_steps);
+
     problem.setup();
-    problem.solve_newton();
-    problem.output();
-    problem.compute_lift_drag();
-    problem.print_lift_coeff();
-    problem.print_drag_coeff();
+    if (dwr_cycles > 0)
+    {
+        problem.solve_goal_oriented();
+        if (!solution_file.empty())
+            problem.write_solution(solution_file);
+    }
+    else if (sequencing_levels > 1)
+    {
+        problem.solve_mesh_sequencing();
+    }
+    else
+    {
+        problem.solve_newton();
+        problem.output();
+        if (!solution_file.empty())
+            problem.write_solution(solution_file);
+        problem.compute_lift_drag();
+        problem.print_lift_coeff();
+        problem.print_drag_coeff();
+    }
 
   return 0;
 }
\ No newline at end of file